@@ -0,0 +1,32 @@
+set autoscale
+unset log
+unset label
+
+set colorsequence default
+set terminal qt size 1300,600
+set multiplot layout 1,2 title "single and batched lookups"
+
+set logscale x
+set xtic auto
+set ytic auto
+set xlabel "#entries"
+
+set key left top
+
+set ylabel "total lookup time [ms]"
+set yrange[0:*]
+set title "absolute lookup time"
+plot \
+  "plot/data/phtree_lookup_batch.dat" every 2::0 using 1:3 with linespoints pt 6 ps 1 lc 1 t 'single',\
+  "plot/data/phtree_lookup_batch.dat" every 2::1 using 1:3 with linespoints pt 7 ps 1 lc 2 t 'batch'
+
+set key right top
+set ylabel "lookups per ms"
+unset yrange
+set title "Throughput"
+plot \
+  "plot/data/phtree_lookup_batch.dat" every 2::0 using 1:4 with linespoints pt 6 ps 1 lc 1 t 'single',\
+  "plot/data/phtree_lookup_batch.dat" every 2::1 using 1:4 with linespoints pt 7 ps 1 lc 2 t 'batch'
+
+unset multiplot
+unset output
@@ -0,0 +1,32 @@
+set autoscale
+unset log
+unset label
+
+set colorsequence default
+set terminal qt size 1300,600
+set multiplot layout 1,2 title "parallel bulk load"
+
+set xrange[1:*]
+set xtic 1
+set ytic auto
+set xlabel "#threads"
+
+set key right top
+
+set ylabel "total load time [ms]"
+set yrange[0:*]
+set title "absolute load time"
+plot \
+  "plot/data/phtree_parallel_bulk_load.dat" every 2::0 using 1:3 with linespoints pt 6 ps 1 lc 1 t 'clustered',\
+  "plot/data/phtree_parallel_bulk_load.dat" every 2::1 using 1:3 with linespoints pt 7 ps 1 lc 2 t 'uniform'
+
+set key left top
+set ylabel "entries per ms"
+unset yrange
+set title "Throughput"
+plot \
+  "plot/data/phtree_parallel_bulk_load.dat" every 2::0 using 1:4 with linespoints pt 6 ps 1 lc 1 t 'clustered',\
+  "plot/data/phtree_parallel_bulk_load.dat" every 2::1 using 1:4 with linespoints pt 7 ps 1 lc 2 t 'uniform'
+
+unset multiplot
+unset output
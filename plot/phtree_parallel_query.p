@@ -0,0 +1,36 @@
+set autoscale
+unset log
+unset label
+
+set colorsequence default
+set terminal qt size 1300,600
+set multiplot layout 1,2 title "parallel intersection queries"
+
+set xrange[1:*]
+set xtic 1
+set ytic auto
+set xlabel "#threads"
+
+set key right top
+
+set ylabel "total query time [ms]"
+set yrange[0:*]
+set title "absolute query time"
+plot \
+  "plot/data/phtree_parallel_query.dat" every 4::0 using 1:3 with linespoints pt 6 ps 1 lc 1 t 'static split - skewed',\
+  "plot/data/phtree_parallel_query.dat" every 4::1 using 1:3 with linespoints pt 6 ps 1 lc 2 t 'static split - uniform',\
+  "plot/data/phtree_parallel_query.dat" every 4::2 using 1:3 with linespoints pt 7 ps 1 dashtype 2 lc 1 t 'work stealing - skewed',\
+  "plot/data/phtree_parallel_query.dat" every 4::3 using 1:3 with linespoints pt 7 ps 1 dashtype 2 lc 2 t 'work stealing - uniform'
+
+set key left top
+set ylabel "queries per ms"
+unset yrange
+set title "Throughput"
+plot \
+  "plot/data/phtree_parallel_query.dat" every 4::0 using 1:4 with linespoints pt 6 ps 1 lc 1 t 'static split - skewed',\
+  "plot/data/phtree_parallel_query.dat" every 4::1 using 1:4 with linespoints pt 6 ps 1 lc 2 t 'static split - uniform',\
+  "plot/data/phtree_parallel_query.dat" every 4::2 using 1:4 with linespoints pt 7 ps 1 dashtype 2 lc 1 t 'work stealing - skewed',\
+  "plot/data/phtree_parallel_query.dat" every 4::3 using 1:4 with linespoints pt 7 ps 1 dashtype 2 lc 2 t 'work stealing - uniform'
+
+unset multiplot
+unset output
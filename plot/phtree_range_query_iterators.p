@@ -0,0 +1,41 @@
+set autoscale
+unset log
+unset label
+set xtic auto
+set ytic auto
+
+set xlabel "selectivity"
+set terminal qt size 1500,1000
+
+set multiplot layout 1,2 title "same dimension - same number of entries - different ranges"
+
+set key right top
+set style data histograms
+set style histogram clustered
+set boxwidth 0.9 relative
+set style fill solid 1.0 border -1
+set ylabel "total range query time [ms]"
+set title "Range query iterators"
+
+plot \
+  "plot/data/phtree_range_query_iterators.dat" using 3:xticlabels(2) t 'reference iterator',\
+  "" using 4 t 'fast iterator',\
+  "" using 5 t 'IDs only',\
+  "" using 6 t 'IDs via callback',\
+  "" using 7 t 'count only'
+
+set ylabel "#elements in range"
+set boxwidth 0.9
+set style fill solid
+set key left top
+set yrange[0:*]
+set style data histogram
+set style fill solid 1.0 border -1
+set xtic scale 0
+
+set title "Number of elements per range"
+plot \
+  "plot/data/phtree_range_query_iterators.dat" using 8:xtic(2) t '#entries in range' ls 5
+
+unset multiplot
+unset output
@@ -0,0 +1,212 @@
+/*
+ * DynamicPHTree.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_DYNAMICPHTREE_H_
+#define SRC_DYNAMICPHTREE_H_
+
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include "Entry.h"
+#include "PHTree.h"
+
+// PH-Tree with the number of dimensions and the bit width chosen at runtime.
+// create() dispatches once to a pre-instantiated PHTree<DIM, WIDTH> so that all operations
+// on the nodes stay specialized. Other combinations use the next larger instantiated one:
+// the additional dimensions are always 0 and the values are stored with more bits.
+class DynamicPHTree {
+public:
+	virtual ~DynamicPHTree() {}
+
+	// throws if there is no instantiated tree with at least the given dimensions and width
+	static DynamicPHTree* create(unsigned int dim, unsigned int width);
+
+	// all values have dim() entries that fit into width() bits
+	virtual void insert(const std::vector<unsigned long>& values, int id) = 0;
+	virtual std::pair<bool, int> remove(const std::vector<unsigned long>& values) = 0;
+	virtual bool update(const std::vector<unsigned long>& oldValues, const std::vector<unsigned long>& newValues, int id) = 0;
+	virtual std::pair<bool, int> lookup(const std::vector<unsigned long>& values) const = 0;
+	// appends the values (dim() per entry) and the IDs of the entries in the range (both are optional)
+	// and returns the number of entries in the range
+	virtual size_t rangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues,
+			std::vector<unsigned long>* outValues, std::vector<int>* outIds) const = 0;
+	virtual size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const = 0;
+	virtual size_t size() const = 0;
+
+	unsigned int dim() const { return dim_; }
+	unsigned int width() const { return width_; }
+	// dimensions and width of the tree that stores the entries
+	virtual unsigned int storedDim() const = 0;
+	virtual unsigned int storedWidth() const = 0;
+
+protected:
+	DynamicPHTree(unsigned int dim, unsigned int width) : dim_(dim), width_(width) {}
+
+	const unsigned int dim_;
+	const unsigned int width_;
+};
+
+template <unsigned int DIM, unsigned int WIDTH>
+class DynamicPHTreeInstance : public DynamicPHTree {
+public:
+	DynamicPHTreeInstance(unsigned int dim, unsigned int width);
+	virtual ~DynamicPHTreeInstance();
+
+	void insert(const std::vector<unsigned long>& values, int id) override;
+	std::pair<bool, int> remove(const std::vector<unsigned long>& values) override;
+	bool update(const std::vector<unsigned long>& oldValues, const std::vector<unsigned long>& newValues, int id) override;
+	std::pair<bool, int> lookup(const std::vector<unsigned long>& values) const override;
+	size_t rangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues,
+			std::vector<unsigned long>* outValues, std::vector<int>* outIds) const override;
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const override;
+	size_t size() const override;
+	unsigned int storedDim() const override { return DIM; }
+	unsigned int storedWidth() const override { return WIDTH; }
+
+private:
+	PHTree<DIM, WIDTH> tree_;
+
+	// pads the values with 0 if the tree has more dimensions
+	inline Entry<DIM, WIDTH> toEntry(const std::vector<unsigned long>& values, int id) const;
+};
+
+#include <assert.h>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include "util/NodeTypeUtil.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+DynamicPHTreeInstance<DIM, WIDTH>::DynamicPHTreeInstance(unsigned int dim, unsigned int width)
+	: DynamicPHTree(dim, width), tree_() {
+	assert (dim <= DIM && width <= WIDTH);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+DynamicPHTreeInstance<DIM, WIDTH>::~DynamicPHTreeInstance() { }
+
+template <unsigned int DIM, unsigned int WIDTH>
+Entry<DIM, WIDTH> DynamicPHTreeInstance<DIM, WIDTH>::toEntry(const vector<unsigned long>& values, int id) const {
+	assert (values.size() == dim_);
+	unsigned long paddedValues[DIM] = {};
+	for (unsigned d = 0; d < dim_; ++d) {
+		assert (width_ == 8 * sizeof (unsigned long) || values[d] < (1uL << width_));
+		paddedValues[d] = values[d];
+	}
+
+	Entry<DIM, WIDTH> entry;
+	entry.id_ = id;
+	MultiDimBitset<DIM>::template toBitset<WIDTH>(paddedValues, entry.values_);
+	return entry;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicPHTreeInstance<DIM, WIDTH>::insert(const vector<unsigned long>& values, int id) {
+	tree_.insert(toEntry(values, id));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool, int> DynamicPHTreeInstance<DIM, WIDTH>::remove(const vector<unsigned long>& values) {
+	return tree_.remove(toEntry(values, 0));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool DynamicPHTreeInstance<DIM, WIDTH>::update(const vector<unsigned long>& oldValues,
+		const vector<unsigned long>& newValues, int id) {
+	return tree_.update(toEntry(oldValues, id), toEntry(newValues, id));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool, int> DynamicPHTreeInstance<DIM, WIDTH>::lookup(const vector<unsigned long>& values) const {
+	return tree_.lookup(toEntry(values, 0));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t DynamicPHTreeInstance<DIM, WIDTH>::rangeQuery(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, vector<unsigned long>* outValues, vector<int>* outIds) const {
+	const unsigned int dim = dim_;
+	size_t nEntries = 0;
+	if (!outValues) {
+		tree_.forEachIdInRange(toEntry(lowerLeftValues, 0), toEntry(upperRightValues, 0), [&nEntries, outIds] (int id) {
+			++nEntries;
+			if (outIds) {
+				outIds->push_back(id);
+			}
+		});
+		return nEntries;
+	}
+
+	tree_.forEachInRange(toEntry(lowerLeftValues, 0), toEntry(upperRightValues, 0),
+			[&nEntries, dim, outValues, outIds] (const Entry<DIM, WIDTH>& entry) {
+		++nEntries;
+		unsigned long values[DIM];
+		MultiDimBitset<DIM>::toLongs(entry.values_, DIM * WIDTH, values);
+		outValues->insert(outValues->end(), values, values + dim);
+		if (outIds) {
+			outIds->push_back(entry.id_);
+		}
+	});
+	return nEntries;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t DynamicPHTreeInstance<DIM, WIDTH>::rangeCount(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	return tree_.rangeCount(toEntry(lowerLeftValues, 0), toEntry(upperRightValues, 0));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t DynamicPHTreeInstance<DIM, WIDTH>::size() const {
+	return tree_.size();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+inline DynamicPHTree* newDynamicPHTree(unsigned int dim, unsigned int width, std::true_type) {
+	return new DynamicPHTreeInstance<DIM, WIDTH>(dim, width);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+inline DynamicPHTree* newDynamicPHTree(unsigned int dim, unsigned int width, std::false_type) {
+	throw runtime_error("no instantiated PH-Tree with " + to_string(dim) + " dimensions of "
+			+ to_string(width) + " bits");
+}
+
+// the prefixes of the nodes must fit into NodeTypeUtil::maxPrefixBlocks
+template <unsigned int DIM, unsigned int WIDTH>
+inline DynamicPHTree* newDynamicPHTree(unsigned int dim, unsigned int width) {
+	return newDynamicPHTree<DIM, WIDTH>(dim, width, std::integral_constant<bool,
+			DIM * (WIDTH - 1) <= NodeTypeUtil<DIM>::maxPrefixBlocks * 8 * sizeof (unsigned long)>());
+}
+
+template <unsigned int WIDTH>
+inline DynamicPHTree* createDynamicPHTree(unsigned int dim, unsigned int width) {
+	// instantiated dimensions (others use the next larger one)
+	if (dim <= 2) return newDynamicPHTree<2, WIDTH>(dim, width);
+	if (dim <= 3) return newDynamicPHTree<3, WIDTH>(dim, width);
+	if (dim <= 4) return newDynamicPHTree<4, WIDTH>(dim, width);
+	if (dim <= 6) return newDynamicPHTree<6, WIDTH>(dim, width);
+	if (dim <= 8) return newDynamicPHTree<8, WIDTH>(dim, width);
+	if (dim <= 10) return newDynamicPHTree<10, WIDTH>(dim, width);
+	if (dim <= 12) return newDynamicPHTree<12, WIDTH>(dim, width);
+	if (dim <= 16) return newDynamicPHTree<16, WIDTH>(dim, width);
+	throw runtime_error("no instantiated PH-Tree with " + to_string(dim) + " dimensions");
+}
+
+inline DynamicPHTree* DynamicPHTree::create(unsigned int dim, unsigned int width) {
+	if (dim == 0 || width == 0) {
+		throw runtime_error("the dimensions and the width must be positive");
+	}
+
+	// instantiated widths (others use the next larger one)
+	if (width <= 32) return createDynamicPHTree<32>(dim, width);
+	if (width <= 64) return createDynamicPHTree<64>(dim, width);
+	throw runtime_error("no instantiated PH-Tree with a width of " + to_string(width) + " bits");
+}
+
+#endif /* SRC_DYNAMICPHTREE_H_ */
@@ -0,0 +1,288 @@
+/*
+ * HighDimPHTree.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_HIGHDIMPHTREE_H_
+#define SRC_HIGHDIMPHTREE_H_
+
+#include <vector>
+#include "Entry.h"
+#include "PHTree.h"
+
+template <unsigned int DIM>
+class Node;
+template <unsigned int DIM>
+struct NodeContentArrays;
+
+// PH-Tree for many dimensions (e.g. 32 - 128) where one node cannot hold the 2^DIM hypercube.
+// Each hypercube of DIM dimensions is split into DIM / NODE_DIM nested sub-hypercubes with
+// NODE_DIM dimensions each: the interleaved bits of an entry are stored unchanged in a
+// PHTree<NODE_DIM, DIM * WIDTH / NODE_DIM> so that every node has at most 2^NODE_DIM slots.
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM = 8>
+class HighDimPHTree {
+	static_assert (DIM % NODE_DIM == 0, "the dimensions must be split into sub-hypercubes of equal size");
+	static_assert (WIDTH <= 8 * sizeof (unsigned long), "values are stored as unsigned long");
+public:
+	static const unsigned int treeWidth = DIM * WIDTH / NODE_DIM;
+
+	HighDimPHTree();
+	HighDimPHTree(const HighDimPHTree<DIM, WIDTH, NODE_DIM>& other) = delete;
+	~HighDimPHTree();
+
+	void insert(const std::vector<unsigned long>& values, int id);
+	std::pair<bool, int> remove(const std::vector<unsigned long>& values);
+	bool update(const std::vector<unsigned long>& oldValues, const std::vector<unsigned long>& newValues, int id);
+	std::pair<bool, int> lookup(const std::vector<unsigned long>& values) const;
+	// calls callback(const unsigned long* values, int id) with the DIM values of every entry in the range
+	template <typename Callback>
+	void forEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// number of entries in the tree
+	size_t size() const;
+
+private:
+	typedef Entry<NODE_DIM, treeWidth> TreeEntry;
+	static const unsigned int bitsPerBlock = 8 * sizeof (unsigned long);
+	static const unsigned int nBlocks = 1 + (DIM * WIDTH - 1) / bitsPerBlock;
+
+	PHTree<NODE_DIM, treeWidth> tree_;
+
+	// bit i of dimension d is bit (DIM * i + d) of the interleaved bits (same as MultiDimBitset)
+	static inline TreeEntry toEntry(const std::vector<unsigned long>& values, int id);
+	// only the bits starting at the given index are set
+	static inline void toValues(const unsigned long* interleavedBits, unsigned int fromLsbIndex, unsigned long* outValues);
+	template <typename Callback>
+	static void forEachInRange(const Node<NODE_DIM>* node, const unsigned long* higherBits, unsigned int index,
+			bool parentFullyContained, const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+	template <typename Callback>
+	static inline void forEachInRangeVisitReference(const NodeContentArrays<NODE_DIM>& arrays,
+			const unsigned long* nodeBits, unsigned int currentIndex, bool fullyContained,
+			unsigned long hcAddress, std::uintptr_t reference,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+};
+
+#include <assert.h>
+#include "nodes/Node.h"
+#include "nodes/NodeContentArrays.h"
+#include "util/MultiDimBitset.h"
+#include "util/RangeQueryMaskUtil.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+HighDimPHTree<DIM, WIDTH, NODE_DIM>::HighDimPHTree() : tree_() { }
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+HighDimPHTree<DIM, WIDTH, NODE_DIM>::~HighDimPHTree() { }
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+typename HighDimPHTree<DIM, WIDTH, NODE_DIM>::TreeEntry HighDimPHTree<DIM, WIDTH, NODE_DIM>::toEntry(
+		const vector<unsigned long>& values, int id) {
+	assert (values.size() == DIM);
+	TreeEntry entry;
+	entry.id_ = id;
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (WIDTH == bitsPerBlock || values[d] < (1uL << WIDTH));
+		const unsigned long value = values[d];
+		for (unsigned i = 0; i < WIDTH; ++i) {
+			const unsigned int bitIndex = DIM * i + d;
+			entry.values_[bitIndex / bitsPerBlock] |= ((value >> i) & 1uL) << (bitIndex % bitsPerBlock);
+		}
+	}
+
+	return entry;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+void HighDimPHTree<DIM, WIDTH, NODE_DIM>::toValues(const unsigned long* interleavedBits,
+		unsigned int fromLsbIndex, unsigned long* outValues) {
+	for (unsigned d = 0; d < DIM; ++d) {
+		outValues[d] = 0;
+	}
+
+	// the unset lower bits are 0 so only the blocks from the given index on are read
+	for (unsigned blockIndex = fromLsbIndex / bitsPerBlock; blockIndex < nBlocks; ++blockIndex) {
+		unsigned long block = interleavedBits[blockIndex];
+		while (block != 0) {
+			const unsigned int bitIndex = blockIndex * bitsPerBlock + __builtin_ctzl(block);
+			outValues[bitIndex % DIM] |= 1uL << (bitIndex / DIM);
+			block &= block - 1;
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+void HighDimPHTree<DIM, WIDTH, NODE_DIM>::insert(const vector<unsigned long>& values, int id) {
+	tree_.insert(toEntry(values, id));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+pair<bool, int> HighDimPHTree<DIM, WIDTH, NODE_DIM>::remove(const vector<unsigned long>& values) {
+	return tree_.remove(toEntry(values, 0));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+bool HighDimPHTree<DIM, WIDTH, NODE_DIM>::update(const vector<unsigned long>& oldValues,
+		const vector<unsigned long>& newValues, int id) {
+	return tree_.update(toEntry(oldValues, id), toEntry(newValues, id));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+pair<bool, int> HighDimPHTree<DIM, WIDTH, NODE_DIM>::lookup(const vector<unsigned long>& values) const {
+	return tree_.lookup(toEntry(values, 0));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+template <typename Callback>
+void HighDimPHTree<DIM, WIDTH, NODE_DIM>::forEachInRange(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	assert (lowerLeftValues.size() == DIM && upperRightValues.size() == DIM);
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			return;
+		}
+	}
+
+	const unsigned long rootBits[nBlocks] = {};
+	forEachInRange(tree_.root_, rootBits, 0, false, lowerLeftValues.data(), upperRightValues.data(), callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+size_t HighDimPHTree<DIM, WIDTH, NODE_DIM>::rangeCount(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	size_t nEntries = 0;
+	forEachInRange(lowerLeftValues, upperRightValues, [&nEntries] (const unsigned long*, int) { ++nEntries; });
+	return nEntries;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+size_t HighDimPHTree<DIM, WIDTH, NODE_DIM>::size() const {
+	return tree_.size();
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+template <typename Callback>
+void HighDimPHTree<DIM, WIDTH, NODE_DIM>::forEachInRange(const Node<NODE_DIM>* node,
+		const unsigned long* higherBits, unsigned int index, bool parentFullyContained,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	typedef RangeQueryMaskUtil<NODE_DIM, treeWidth> MaskUtil;
+	NodeContentArrays<NODE_DIM> arrays;
+	node->getContentArrays(arrays);
+	const unsigned int currentIndex = index + arrays.prefixLength;
+	assert (currentIndex < treeWidth);
+
+	unsigned long bits[nBlocks];
+	for (unsigned i = 0; i < nBlocks; ++i) {
+		bits[i] = higherBits[i];
+	}
+	if (arrays.prefixLength > 0) {
+		MaskUtil::pushBackBits(arrays.prefixStartBlock, NODE_DIM * arrays.prefixLength,
+				bits, NODE_DIM * (treeWidth - currentIndex));
+	}
+
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = parentFullyContained;
+	if (!parentFullyContained) {
+		// all bits from this index on are known, the HC address of the node holds the bits right below
+		const unsigned int knownFromBit = NODE_DIM * (treeWidth - currentIndex);
+		const unsigned int addressFromBit = knownFromBit - NODE_DIM;
+		unsigned long nodeLowerValues[DIM];
+		toValues(bits, knownFromBit, nodeLowerValues);
+		fullyContained = true;
+		for (unsigned d = 0; d < DIM; ++d) {
+			const unsigned int freeBits = (knownFromBit > d)? (knownFromBit - d + DIM - 1) / DIM : 0;
+			const unsigned long freeMask = (freeBits == bitsPerBlock)? -1uL : (1uL << freeBits) - 1uL;
+			const unsigned long nodeLower = nodeLowerValues[d];
+			const unsigned long nodeUpper = nodeLower | freeMask;
+			if (nodeUpper < lowerLeft[d] || upperRight[d] < nodeLower) {
+				// the node is not in the range
+				return;
+			}
+
+			fullyContained &= lowerLeft[d] <= nodeLower && nodeUpper <= upperRight[d];
+		}
+
+		// the address of the sub-hypercube splits NODE_DIM of the dimensions (see calculateMasks)
+		for (unsigned j = 0; j < NODE_DIM; ++j) {
+			const unsigned int d = (addressFromBit + j) % DIM;
+			const unsigned long middle = nodeLowerValues[d] | (1uL << ((addressFromBit + j) / DIM));
+			lowerMask |= (unsigned long)(lowerLeft[d] >= middle) << j;
+			upperMask &= ~((unsigned long)(upperRight[d] < middle) << j);
+		}
+	}
+
+	if (arrays.isAhc) {
+		unsigned long hcAddress = lowerMask;
+		while (true) {
+			const uintptr_t reference = arrays.references[hcAddress];
+			if (reference != 0) {
+				forEachInRangeVisitReference(arrays, bits, currentIndex, fullyContained,
+						hcAddress, reference, lowerLeft, upperRight, callback);
+			}
+
+			if (hcAddress == upperMask) {
+				break;
+			}
+			hcAddress = MaskUtil::nextInMaskRange(hcAddress, lowerMask, upperMask);
+		}
+	} else {
+		for (unsigned long row = MaskUtil::lowerBoundLhcRow(arrays.addresses, arrays.nReferences, lowerMask);
+				row < arrays.nReferences; ++row) {
+			const unsigned long hcAddress = MaskUtil::lookupLhcAddress(arrays.addresses, row);
+			if (hcAddress > upperMask) {
+				break;
+			}
+
+			if (MaskUtil::isInMaskRange(hcAddress, lowerMask, upperMask)) {
+				forEachInRangeVisitReference(arrays, bits, currentIndex, fullyContained,
+						hcAddress, arrays.references[row], lowerLeft, upperRight, callback);
+			}
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH, unsigned int NODE_DIM>
+template <typename Callback>
+void HighDimPHTree<DIM, WIDTH, NODE_DIM>::forEachInRangeVisitReference(
+		const NodeContentArrays<NODE_DIM>& arrays, const unsigned long* nodeBits,
+		unsigned int currentIndex, bool fullyContained,
+		unsigned long hcAddress, std::uintptr_t reference,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	// flags in the 2 lowest bits: isPointer | isSuffix
+	const bool isPointer = (reference >> 1uL) & 1uL;
+	const bool isSuffix = reference & 1uL;
+	assert ((isPointer || isSuffix) && "special pointers are only used during parallel inserts");
+
+	unsigned long bits[nBlocks];
+	for (unsigned i = 0; i < nBlocks; ++i) {
+		bits[i] = nodeBits[i];
+	}
+	const unsigned int suffixLength = treeWidth - currentIndex - 1;
+	MultiDimBitset<NODE_DIM>::pushBackValue(hcAddress, bits, NODE_DIM * suffixLength);
+
+	if (isPointer && !isSuffix) {
+		const Node<NODE_DIM>* subnode = reinterpret_cast<const Node<NODE_DIM>*>(reference & (~3uL));
+		forEachInRange(subnode, bits, currentIndex + 1, fullyContained, lowerLeft, upperRight, callback);
+		return;
+	}
+
+	RangeQueryMaskUtil<NODE_DIM, treeWidth>::pushBackSuffix(arrays, currentIndex, reference, bits);
+	unsigned long values[DIM];
+	toValues(bits, 0, values);
+	bool inRange = true;
+	for (unsigned d = 0; !fullyContained && d < DIM; ++d) {
+		inRange &= lowerLeft[d] <= values[d] && values[d] <= upperRight[d];
+	}
+
+	if (inRange) {
+		const int id = reference >> 32;
+		callback(static_cast<const unsigned long*>(values), id);
+	}
+}
+
+#endif /* SRC_HIGHDIMPHTREE_H_ */
@@ -12,6 +12,7 @@
 #include <vector>
 #include <thread>
 #include "Entry.h"
+#include "util/DistanceUtil.h"
 #include <thread>
 
 template <unsigned int DIM>
@@ -24,6 +25,19 @@ template <unsigned int DIM, unsigned int WIDTH>
 class RangeQueryIterator;
 template <unsigned int DIM, unsigned int WIDTH>
 class InsertionThreadPool;
+template <unsigned int DIM, unsigned int WIDTH>
+class KnnQueryIterator;
+template <unsigned int DIM, unsigned int WIDTH>
+class FastRangeQueryIterator;
+template <unsigned int DIM, unsigned int WIDTH>
+class ParallelQueryResults;
+template <unsigned int DIM, unsigned int WIDTH>
+class PHTreeSnapshot;
+template <unsigned int DIM>
+class VersionManager;
+class NodeArena;
+class EpochManager;
+class ThreadPool;
 
 template <unsigned int DIM, unsigned int WIDTH>
 class PHTree {
@@ -35,59 +49,188 @@ class PHTree {
 	friend class DynamicNodeOperationsUtil;
 	template <unsigned int D, unsigned int W>
 	friend class InsertionThreadPool;
+	template <unsigned int D, unsigned int W>
+	friend class RangeQueryThreadPool;
+	template <unsigned int D, unsigned int W, unsigned int N>
+	friend class HighDimPHTree;
+	template <unsigned int D, unsigned int W>
+	friend class CopyOnWriteUtil;
 public:
 	PHTree();
 	explicit PHTree(const PHTree<DIM, WIDTH>& other);
 	virtual ~PHTree();
 	void insert(const Entry<DIM, WIDTH>& e);
 	void insert(const std::vector<unsigned long>& values, int id);
+	// inserts the entry or, if the values are already stored, replaces their ID by merge(int storedId)
+	// with the same traversal: returns true if the entry was inserted
+	template <typename Merge>
+	bool insertOrMerge(const Entry<DIM, WIDTH>& e, Merge&& merge);
 	void parallelInsert(const Entry<DIM,WIDTH>& entry);
 	void parallelBulkInsert(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>* ids = NULL, size_t nThreads = std::thread::hardware_concurrency());
 	void insertHyperRect(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, int id);
 	void bulkInsert(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>& ids);
 	void bulkInsert(const std::vector<Entry<DIM,WIDTH>>& entries);
+	// builds the whole tree at once from the entries (much faster than inserting them but the tree must be empty)
+	void bulkLoad(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>& ids);
+	void bulkLoad(std::vector<Entry<DIM,WIDTH>> entries);
+	// same as bulkLoad but the entries are sorted and the subtrees are built with several threads
+	void parallelBulkLoad(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>* ids = NULL, size_t nThreads = std::thread::hardware_concurrency());
+	void parallelBulkLoad(std::vector<Entry<DIM,WIDTH>> entries, size_t nThreads = std::thread::hardware_concurrency());
+	// removes the entry with the given values and returns the ID it was stored with
+	std::pair<bool,int> remove(const Entry<DIM, WIDTH>& e);
+	std::pair<bool,int> remove(const std::vector<unsigned long>& values);
+	// moves the entry with the given ID from the old to the new values
+	bool update(const Entry<DIM, WIDTH>& oldEntry, const Entry<DIM, WIDTH>& newEntry);
+	bool update(const std::vector<unsigned long>& oldValues, const std::vector<unsigned long>& newValues, int id);
 
 	std::pair<bool,int> lookup(const Entry<DIM, WIDTH>& e) const;
 	std::pair<bool,int> lookup(const std::vector<unsigned long>& values) const;
+	// looks up n entries at once: outResults[i] is the result of lookup(entries[i])
+	void lookupBatch(const Entry<DIM, WIDTH>* entries, size_t n, std::pair<bool,int>* outResults) const;
+	// lookup that is safe while another thread changes the tree: nodes are read without locks and
+	// validated with their versions (entries in the buffers of a running parallel insert are not found)
+	std::pair<bool,int> optimisticLookup(const Entry<DIM, WIDTH>& e) const;
+	std::pair<bool,int> optimisticLookup(const std::vector<unsigned long>& values) const;
 	std::pair<bool,int> lookupHyperRect(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
 	RangeQueryIterator<DIM, WIDTH>* rangeQuery(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
 	RangeQueryIterator<DIM, WIDTH>* rangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// same results as rangeQuery but without allocations and virtual calls per visited address
+	FastRangeQueryIterator<DIM, WIDTH>* fastRangeQuery(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
+	FastRangeQueryIterator<DIM, WIDTH>* fastRangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// only returns the IDs of the entries in the range (use nextId() on the iterator)
+	FastRangeQueryIterator<DIM, WIDTH>* rangeQueryIds(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
+	FastRangeQueryIterator<DIM, WIDTH>* rangeQueryIds(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// number of entries in the range
+	size_t rangeCount(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// push-based range query: calls callback(const Entry<DIM, WIDTH>&) for every entry in the range
+	template <typename Callback>
+	void forEachInRange(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const;
+	template <typename Callback>
+	void forEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	// calls callback(int id) for every entry in the range without reconstructing the values if possible
+	template <typename Callback>
+	void forEachIdInRange(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const;
+	template <typename Callback>
+	void forEachIdInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	// same as forEachInRange but safe while another thread changes the tree (like optimisticLookup):
+	// every entry is passed once and in Z-order even if the traversal has to restart
+	template <typename Callback>
+	void optimisticForEachInRange(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const;
+	template <typename Callback>
+	void optimisticForEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
 	RangeQueryIterator<DIM, WIDTH>* intersectionQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
 	RangeQueryIterator<DIM, WIDTH>* intersectionQuery(const std::vector<unsigned long>& values) const;
-	// TODO what exactly to return?
-	void parallelIntersectionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads = std::thread::hardware_concurrency()) const;
 	RangeQueryIterator<DIM, WIDTH>* inclusionQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
 	RangeQueryIterator<DIM, WIDTH>* inclusionQuery(const std::vector<unsigned long>& values) const;
-	void parallelInclusionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads = std::thread::hardware_concurrency()) const;
-
+	// answers the queries (DIM values: lower left, upper right) in parallel and returns the results of every query
+	ParallelQueryResults<DIM, WIDTH>* parallelIntersectionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads = std::thread::hardware_concurrency()) const;
+	ParallelQueryResults<DIM, WIDTH>* parallelInclusionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads = std::thread::hardware_concurrency()) const;
+	// streaming forms: call callback(size_t queryIndex, const Entry<DIM, WIDTH>&) for every result
+	// concurrently from all threads (the callback has to be thread safe)
+	template <typename Callback>
+	void parallelForEachIntersecting(const std::vector<std::vector<unsigned long>>& values, Callback&& callback, size_t nThreads = std::thread::hardware_concurrency()) const;
+	template <typename Callback>
+	void parallelForEachIncluded(const std::vector<std::vector<unsigned long>>& values, Callback&& callback, size_t nThreads = std::thread::hardware_concurrency()) const;
+	// answers a single range query with several threads that each traverse a part of the subtrees
+	// in the range: the results are in the same order as the ones of forEachInRange
+	ParallelQueryResults<DIM, WIDTH>* parallelRangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, size_t nThreads = std::thread::hardware_concurrency()) const;
+	// calls callback(size_t threadIndex, const Entry<DIM, WIDTH>&) for every entry in the range
+	// concurrently from all threads (results with the same thread index are never passed concurrently)
+	template <typename Callback>
+	void parallelForEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback, size_t nThreads = std::thread::hardware_concurrency()) const;
+	// returns the k entries closest to the point in ascending order of their distance
+	// (isFloat: values are doubles encoded as by FileInputUtil)
+	KnnQueryIterator<DIM, WIDTH>* knnQuery(const std::vector<unsigned long>& point, size_t k, DistanceMetric metric = euclidean_distance, bool isFloat = false) const;
+
+	// replaces the ID of every entry by mapping(id) (called in ascending Z-order of the entries)
+	template <typename Mapping>
+	void mapIds(Mapping&& mapping);
+
+	// parallel operations use the threads of the pool (and ignore their nThreads argument) instead of
+	// starting new threads for every call: the pool has to outlive the binding (NULL removes it)
+	void bindThreadPool(ThreadPool* threads);
+
+	// from now on insert, remove and update copy the nodes they change and publish a new version
+	// of the tree once they are done (the batch and parallel changes and mapIds throw exceptions):
+	// must be called before other threads access the tree
+	void enableCopyOnWrite();
+	// immutable current version of a tree in copy-on-write mode that other threads can query while the
+	// tree is changed (the caller deletes the snapshot before the tree to release the version)
+	PHTreeSnapshot<DIM, WIDTH>* snapshot() const;
+
+	// number of entries in the tree
+	size_t size() const;
 	void accept(Visitor<DIM>* visitor);
 
 private:
+	// contains all nodes and suffix storages of the tree
+	NodeArena* arena_;
+	// replaced nodes are only freed once no optimistic reader can access them
+	EpochManager* epochs_;
+	// NULL unless the tree is in copy-on-write mode
+	VersionManager<DIM>* versions_;
 	Node<DIM>* root_;
+	// the bound pool and the state of parallel bulk inserts that is kept for it
+	ThreadPool* threads_;
+	InsertionThreadPool<DIM, WIDTH>* insertionPool_;
+
+	// throws an exception for changes that cannot copy the nodes they change
+	void requireInPlaceChanges(const char* operation) const;
+	// calls operation(ThreadPool&) with the bound pool or with a pool of nThreads new threads
+	template <typename Operation>
+	void withThreads(size_t nThreads, Operation&& operation) const;
+	// reorders the entries
+	void parallelBulkLoad(std::vector<Entry<DIM,WIDTH>>& entries, ThreadPool& threads);
+
+	template <bool WITH_VALUES, typename Callback>
+	void forEachInRange(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, Callback& callback) const;
 };
 
 #include <assert.h>
+#include <stdexcept>
 #include "nodes/LHC.h"
+#include "util/NodeArena.h"
+#include "util/EpochManager.h"
+#include "util/VersionManager.h"
 #include "util/DynamicNodeOperationsUtil.h"
+#include "util/CopyOnWriteUtil.h"
+#include "util/BulkLoadUtil.h"
 #include "util/SpatialSelectionOperationsUtil.h"
 #include "util/NodeTypeUtil.h"
+#include "util/ThreadPool.h"
 #include "util/InsertionThreadPool.h"
 #include "util/RangeQueryThreadPool.h"
+#include "util/ParallelRangeQueryUtil.h"
+#include "iterators/KnnQueryIterator.h"
+#include "iterators/FastRangeQueryIterator.h"
+#include "PHTreeSnapshot.h"
 
 using namespace std;
 
 template <unsigned int DIM, unsigned int WIDTH>
-PHTree<DIM, WIDTH>::PHTree() {
+PHTree<DIM, WIDTH>::PHTree() : arena_(new NodeArena()), epochs_(new EpochManager()), versions_(NULL), threads_(NULL), insertionPool_(NULL) {
+	NodeArenaScope arenaScope(arena_);
 	const unsigned int blocksForFirstSuffix = 1 + ((WIDTH - 1) * DIM - 1) / (8 * sizeof (unsigned long));
 	root_ = NodeTypeUtil<DIM>::template buildNodeWithSuffixes<WIDTH>(0, 1, 1, blocksForFirstSuffix);
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-PHTree<DIM, WIDTH>::PHTree(const PHTree<DIM, WIDTH>& other) : root_(other.root_) { }
+PHTree<DIM, WIDTH>::PHTree(const PHTree<DIM, WIDTH>& other) : arena_(other.arena_), epochs_(other.epochs_), versions_(other.versions_), root_(other.root_),
+		threads_(other.threads_), insertionPool_(NULL) { }
 
 template <unsigned int DIM, unsigned int WIDTH>
 PHTree<DIM, WIDTH>::~PHTree() {
-	root_->recursiveDelete();
+	delete insertionPool_;
+	if (versions_) {
+		// the nodes of old versions are retired like the other replaced nodes
+		EpochGuard epochGuard(epochs_);
+		delete versions_;
+	}
+	// the retired nodes are returned to the arena
+	delete epochs_;
+	// frees all nodes at once
+	delete arena_;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -96,6 +239,16 @@ void PHTree<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& e) {
 		cout << "inserting: " << e << endl;
 	#endif
 
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	if (versions_) {
+		// snapshots keep reading the published version while the copied path is changed
+		CopyOnWriteUtil<DIM, WIDTH>::copyPathForInsert(e, *this);
+		DynamicNodeOperationsUtil<DIM, WIDTH>::insert(e, *this);
+		versions_->publish(root_);
+		return;
+	}
+
 	DynamicNodeOperationsUtil<DIM, WIDTH>::insert(e, *this);
 }
 
@@ -106,17 +259,55 @@ void PHTree<DIM, WIDTH>::insert(const vector<unsigned long>& values, int id) {
 	insert(entry);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Merge>
+bool PHTree<DIM, WIDTH>::insertOrMerge(const Entry<DIM, WIDTH>& e, Merge&& merge) {
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	if (versions_) {
+		// the copied path also contains the node of an already stored entry
+		CopyOnWriteUtil<DIM, WIDTH>::copyPathForInsert(e, *this);
+		const bool inserted = DynamicNodeOperationsUtil<DIM, WIDTH>::insertOrMerge(e, *this, merge);
+		versions_->publish(root_);
+		return inserted;
+	}
+
+	return DynamicNodeOperationsUtil<DIM, WIDTH>::insertOrMerge(e, *this, merge);
+}
+
 
 template <unsigned int DIM, unsigned int WIDTH>
 void PHTree<DIM, WIDTH>::parallelInsert(const Entry<DIM,WIDTH>& entry) {
+	requireInPlaceChanges("parallelInsert");
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
 	DynamicNodeOperationsUtil<DIM,WIDTH>::parallelInsert(entry, this);
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
 void PHTree<DIM, WIDTH>::parallelBulkInsert(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>* ids, size_t nThreads) {
 	assert (nThreads > 0);
-	InsertionThreadPool<DIM,WIDTH>* pool = new InsertionThreadPool<DIM,WIDTH>(nThreads - 1, values, ids, this);
-	pool->joinPool();
+	requireInPlaceChanges("parallelBulkInsert");
+	if (InsertionThreadPool<DIM,WIDTH>::approach_ == bulk_load && size() == 0) {
+		// nothing needs to be synchronized if the whole tree is built at once
+		parallelBulkLoad(values, ids, nThreads);
+		return;
+	}
+
+	// the insertion pool enters the epochs itself
+	NodeArenaScope arenaScope(arena_);
+	if (threads_) {
+		// the buffers of the previous inserts are reused
+		if (!insertionPool_) {
+			insertionPool_ = new InsertionThreadPool<DIM,WIDTH>(*threads_, this);
+		}
+		insertionPool_->insert(values, ids);
+		return;
+	}
+
+	ThreadPool threads(nThreads);
+	InsertionThreadPool<DIM,WIDTH>* pool = new InsertionThreadPool<DIM,WIDTH>(threads, this);
+	pool->insert(values, ids);
 	delete pool;
 }
 
@@ -126,7 +317,7 @@ void PHTree<DIM, WIDTH>::bulkInsert(
 		const vector<vector<unsigned long>>& values,
 		const vector<int>& ids) {
 	assert (values.size() == ids.size());
-
+	requireInPlaceChanges("bulkInsert");
 
 	vector<Entry<DIM,WIDTH>>* entries = new vector<Entry<DIM,WIDTH>>();
 	const size_t size = values.size();
@@ -141,9 +332,84 @@ void PHTree<DIM, WIDTH>::bulkInsert(
 
 template <unsigned int DIM, unsigned int WIDTH>
 void PHTree<DIM, WIDTH>::bulkInsert(const vector<Entry<DIM,WIDTH>>& entries) {
+	requireInPlaceChanges("bulkInsert");
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
 	DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(entries, *this);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::bulkLoad(
+		const vector<vector<unsigned long>>& values,
+		const vector<int>& ids) {
+	assert (values.size() == ids.size());
+	vector<Entry<DIM,WIDTH>> entries;
+	entries.reserve(values.size());
+	for (size_t i = 0; i < values.size(); ++i) {
+		entries.emplace_back(values[i], ids[i]);
+	}
+
+	bulkLoad(move(entries));
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::bulkLoad(vector<Entry<DIM,WIDTH>> entries) {
+	requireInPlaceChanges("bulkLoad");
+	if (size() > 0) {
+		throw runtime_error("bulk loading requires an empty tree");
+	}
+	if (entries.empty()) {
+		return;
+	}
+
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	BulkLoadUtil<DIM, WIDTH>::sortAndRemoveDuplicates(entries);
+	Node<DIM>* newRoot = BulkLoadUtil<DIM, WIDTH>::build(entries);
+	DynamicNodeOperationsUtil<DIM, WIDTH>::replaceRoot(*this, newRoot);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::parallelBulkLoad(const vector<vector<unsigned long>>& values,
+		const vector<int>* ids, size_t nThreads) {
+	assert (!ids || values.size() == ids->size());
+	withThreads(nThreads, [this, &values, ids] (ThreadPool& threads) {
+		vector<Entry<DIM,WIDTH>> entries(values.size());
+		const size_t nEntries = values.size();
+		const size_t nThreads = threads.nThreads();
+		auto createEntries = [&values, ids, &entries, nEntries, nThreads] (size_t threadIndex) {
+			for (size_t i = threadIndex * nEntries / nThreads; i < (threadIndex + 1) * nEntries / nThreads; ++i) {
+				entries[i] = Entry<DIM,WIDTH>(values[i], (ids)? (*ids)[i] : i);
+			}
+		};
+		threads.run(createEntries);
+		parallelBulkLoad(entries, threads);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::parallelBulkLoad(vector<Entry<DIM,WIDTH>> entries, size_t nThreads) {
+	withThreads(nThreads, [this, &entries] (ThreadPool& threads) {
+		parallelBulkLoad(entries, threads);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::parallelBulkLoad(vector<Entry<DIM,WIDTH>>& entries, ThreadPool& threads) {
+	requireInPlaceChanges("parallelBulkLoad");
+	if (size() > 0) {
+		throw runtime_error("bulk loading requires an empty tree");
+	}
+	if (entries.empty()) {
+		return;
+	}
+
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	Node<DIM>* newRoot = BulkLoadUtil<DIM, WIDTH>::parallelBuild(entries, threads);
+	DynamicNodeOperationsUtil<DIM, WIDTH>::replaceRoot(*this, newRoot);
+}
+
 template <unsigned int DIM, unsigned int WIDTH>
 void PHTree<DIM, WIDTH>::insertHyperRect(
 		const vector<unsigned long>& lowerLeftValues,
@@ -162,6 +428,69 @@ void PHTree<DIM, WIDTH>::insertHyperRect(
 	insert(combinedValues, id);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTree<DIM, WIDTH>::remove(const Entry<DIM, WIDTH>& e) {
+	#ifdef PRINT
+		cout << "removing: " << e << endl;
+	#endif
+
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	if (versions_) {
+		// nothing is copied if the entry is not stored
+		if (!lookup(e).first) {
+			return pair<bool, int>(false, 0);
+		}
+
+		CopyOnWriteUtil<DIM, WIDTH>::copyPathForRemove(e, *this);
+		const pair<bool, int> result = DynamicNodeOperationsUtil<DIM, WIDTH>::remove(e, *this);
+		versions_->publish(root_);
+		return result;
+	}
+
+	return DynamicNodeOperationsUtil<DIM, WIDTH>::remove(e, *this);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTree<DIM, WIDTH>::remove(const std::vector<unsigned long>& values) {
+	assert (values.size() == DIM);
+	const Entry<DIM, WIDTH> entry(values, 0);
+	return remove(entry);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool PHTree<DIM, WIDTH>::update(const Entry<DIM, WIDTH>& oldEntry, const Entry<DIM, WIDTH>& newEntry) {
+	#ifdef PRINT
+		cout << "updating: " << oldEntry << " -> " << newEntry << endl;
+	#endif
+
+	NodeArenaScope arenaScope(arena_);
+	EpochGuard epochGuard(epochs_);
+	if (versions_) {
+		// the removal and the insertion are published as a single version
+		const pair<bool, int> stored = lookup(oldEntry);
+		if (!stored.first || stored.second != oldEntry.id_) {
+			return false;
+		}
+
+		CopyOnWriteUtil<DIM, WIDTH>::copyPathsForUpdate(oldEntry, newEntry, *this);
+		const bool updated = DynamicNodeOperationsUtil<DIM, WIDTH>::update(oldEntry, newEntry, *this);
+		versions_->publish(root_);
+		return updated;
+	}
+
+	return DynamicNodeOperationsUtil<DIM, WIDTH>::update(oldEntry, newEntry, *this);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool PHTree<DIM, WIDTH>::update(const std::vector<unsigned long>& oldValues,
+		const std::vector<unsigned long>& newValues, int id) {
+	assert (oldValues.size() == DIM && newValues.size() == DIM);
+	const Entry<DIM, WIDTH> oldEntry(oldValues, id);
+	const Entry<DIM, WIDTH> newEntry(newValues, id);
+	return update(oldEntry, newEntry);
+}
+
 template <unsigned int DIM, unsigned int WIDTH>
 pair<bool,int> PHTree<DIM, WIDTH>::lookup(const Entry<DIM, WIDTH>& e) const {
 	#ifdef PRINT
@@ -176,6 +505,26 @@ pair<bool,int> PHTree<DIM, WIDTH>::lookup(const std::vector<unsigned long>& valu
 	return lookup(entry);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTree<DIM, WIDTH>::optimisticLookup(const Entry<DIM, WIDTH>& e) const {
+	// the nodes that are read are not freed before the guard is left
+	EpochGuard epochGuard(epochs_);
+	return SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticLookup(e, &root_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTree<DIM, WIDTH>::optimisticLookup(const std::vector<unsigned long>& values) const {
+	const Entry<DIM, WIDTH> entry(values, 0);
+	return optimisticLookup(entry);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::lookupBatch(const Entry<DIM, WIDTH>* entries, size_t n,
+		pair<bool,int>* outResults) const {
+	assert (entries || n == 0);
+	SpatialSelectionOperationsUtil<DIM, WIDTH>::lookupBatch(entries, n, root_, outResults);
+}
+
 template<unsigned int DIM, unsigned int WIDTH>
 pair<bool, int> PHTree<DIM, WIDTH>::lookupHyperRect(
 		const std::vector<unsigned long>& lowerLeftValues,
@@ -214,6 +563,137 @@ RangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::rangeQuery(
 	return rangeQuery(lowerLeft, upperRight);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::fastRangeQuery(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight) const {
+	return new FastRangeQueryIterator<DIM, WIDTH>(root_, lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::fastRangeQuery(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	return fastRangeQuery(lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::rangeQueryIds(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight) const {
+	return new FastRangeQueryIterator<DIM, WIDTH>(root_, lowerLeft, upperRight, true);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::rangeQueryIds(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	return rangeQueryIds(lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTree<DIM, WIDTH>::rangeCount(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight) const {
+	FastRangeQueryIterator<DIM, WIDTH> it(root_, lowerLeft, upperRight, true);
+	return it.count();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTree<DIM, WIDTH>::rangeCount(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	return rangeCount(lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::forEachInRange(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const {
+	forEachInRange<true>(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::forEachInRange(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	forEachInRange<true>(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::forEachIdInRange(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const {
+	forEachInRange<false>(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::forEachIdInRange(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	forEachInRange<false>(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void PHTree<DIM, WIDTH>::forEachInRange(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight, Callback& callback) const {
+	assert (root_ && root_->getPrefixLength() == 0);
+	unsigned long lowerLeftValues[DIM];
+	unsigned long upperRightValues[DIM];
+	MultiDimBitset<DIM>::toLongs(lowerLeft.values_, DIM * WIDTH, lowerLeftValues);
+	MultiDimBitset<DIM>::toLongs(upperRight.values_, DIM * WIDTH, upperRightValues);
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			return;
+		}
+	}
+
+	const unsigned long rootValues[RangeQueryMaskUtil<DIM, WIDTH>::nBlocks] = {};
+	SpatialSelectionOperationsUtil<DIM, WIDTH>::template forEachInRange<WITH_VALUES>(root_, rootValues, 0, false,
+			lowerLeftValues, upperRightValues, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::optimisticForEachInRange(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const {
+	unsigned long lowerLeftValues[DIM];
+	unsigned long upperRightValues[DIM];
+	MultiDimBitset<DIM>::toLongs(lowerLeft.values_, DIM * WIDTH, lowerLeftValues);
+	MultiDimBitset<DIM>::toLongs(upperRight.values_, DIM * WIDTH, upperRightValues);
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			return;
+		}
+	}
+
+	EpochGuard epochGuard(epochs_);
+	SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticForEachInRange(&root_,
+			lowerLeftValues, upperRightValues, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::optimisticForEachInRange(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	optimisticForEachInRange(lowerLeft, upperRight, callback);
+}
+
 template <unsigned int DIM, unsigned int WIDTH>
 RangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::inclusionQuery(
 		const std::vector<unsigned long>& lowerLeftValues,
@@ -281,19 +761,148 @@ RangeQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::intersectionQuery(
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void PHTree<DIM, WIDTH>::parallelIntersectionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads) const {
-	RangeQueryThreadPool<DIM, WIDTH>* pool = new RangeQueryThreadPool<DIM, WIDTH>(nThreads - 1, values, this, intersection_query);
-	pool->joinPool();
-	// TODO values extracted but what to return?
-	delete pool;
+template <typename Operation>
+void PHTree<DIM, WIDTH>::withThreads(size_t nThreads, Operation&& operation) const {
+	if (threads_) {
+		operation(*threads_);
+	} else {
+		ThreadPool threads(max(nThreads, size_t(1)));
+		operation(threads);
+	}
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void PHTree<DIM, WIDTH>::parallelInclusionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads) const {
-	RangeQueryThreadPool<DIM, WIDTH>* pool = new RangeQueryThreadPool<DIM, WIDTH>(nThreads - 1, values, this, inclusion_query);
-	pool->joinPool();
-	// TODO values extracted but what to return?
-	delete pool;
+ParallelQueryResults<DIM, WIDTH>* PHTree<DIM, WIDTH>::parallelIntersectionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads) const {
+	ParallelQueryResults<DIM, WIDTH>* results = NULL;
+	withThreads(nThreads, [this, &values, &results] (ThreadPool& threads) {
+		results = new ParallelQueryResults<DIM, WIDTH>(values.size(), threads.nThreads());
+		RangeQueryThreadPool<DIM, WIDTH> pool(threads, values, this, intersection_query);
+		pool.collect(*results);
+	});
+	return results;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+ParallelQueryResults<DIM, WIDTH>* PHTree<DIM, WIDTH>::parallelInclusionQuery(const std::vector<std::vector<unsigned long>>& values, size_t nThreads) const {
+	ParallelQueryResults<DIM, WIDTH>* results = NULL;
+	withThreads(nThreads, [this, &values, &results] (ThreadPool& threads) {
+		results = new ParallelQueryResults<DIM, WIDTH>(values.size(), threads.nThreads());
+		RangeQueryThreadPool<DIM, WIDTH> pool(threads, values, this, inclusion_query);
+		pool.collect(*results);
+	});
+	return results;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::parallelForEachIntersecting(const std::vector<std::vector<unsigned long>>& values,
+		Callback&& callback, size_t nThreads) const {
+	withThreads(nThreads, [this, &values, &callback] (ThreadPool& threads) {
+		RangeQueryThreadPool<DIM, WIDTH> pool(threads, values, this, intersection_query);
+		pool.forEach(callback);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::parallelForEachIncluded(const std::vector<std::vector<unsigned long>>& values,
+		Callback&& callback, size_t nThreads) const {
+	withThreads(nThreads, [this, &values, &callback] (ThreadPool& threads) {
+		RangeQueryThreadPool<DIM, WIDTH> pool(threads, values, this, inclusion_query);
+		pool.forEach(callback);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+ParallelQueryResults<DIM, WIDTH>* PHTree<DIM, WIDTH>::parallelRangeQuery(const std::vector<unsigned long>& lowerLeftValues,
+		const std::vector<unsigned long>& upperRightValues, size_t nThreads) const {
+	assert (lowerLeftValues.size() == DIM && upperRightValues.size() == DIM);
+	ParallelQueryResults<DIM, WIDTH>* results = NULL;
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			results = new ParallelQueryResults<DIM, WIDTH>(1, 1);
+			results->finish();
+			return results;
+		}
+	}
+
+	withThreads(nThreads, [this, &lowerLeftValues, &upperRightValues, &results] (ThreadPool& threads) {
+		results = new ParallelQueryResults<DIM, WIDTH>(1, threads.nThreads());
+		ParallelRangeQueryUtil<DIM, WIDTH>::collect(root_, lowerLeftValues.data(), upperRightValues.data(),
+				threads, *results);
+	});
+	return results;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTree<DIM, WIDTH>::parallelForEachInRange(const std::vector<unsigned long>& lowerLeftValues,
+		const std::vector<unsigned long>& upperRightValues, Callback&& callback, size_t nThreads) const {
+	assert (lowerLeftValues.size() == DIM && upperRightValues.size() == DIM);
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			return;
+		}
+	}
+
+	withThreads(nThreads, [this, &lowerLeftValues, &upperRightValues, &callback] (ThreadPool& threads) {
+		ParallelRangeQueryUtil<DIM, WIDTH>::forEach(root_, lowerLeftValues.data(), upperRightValues.data(),
+				threads, callback);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+KnnQueryIterator<DIM, WIDTH>* PHTree<DIM, WIDTH>::knnQuery(const std::vector<unsigned long>& point,
+		size_t k, DistanceMetric metric, bool isFloat) const {
+	assert (point.size() == DIM);
+	return new KnnQueryIterator<DIM, WIDTH>(root_, point, k, metric, isFloat);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Mapping>
+void PHTree<DIM, WIDTH>::mapIds(Mapping&& mapping) {
+	requireInPlaceChanges("mapIds");
+	DynamicNodeOperationsUtil<DIM, WIDTH>::mapIds(root_, mapping);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::bindThreadPool(ThreadPool* threads) {
+	if (threads != threads_) {
+		// the buffers of the inserts are sized for the threads of the pool
+		delete insertionPool_;
+		insertionPool_ = NULL;
+		threads_ = threads;
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::enableCopyOnWrite() {
+	if (!versions_) {
+		versions_ = new VersionManager<DIM>(root_);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+PHTreeSnapshot<DIM, WIDTH>* PHTree<DIM, WIDTH>::snapshot() const {
+	if (!versions_) {
+		throw runtime_error("snapshots require the copy-on-write mode (see enableCopyOnWrite)");
+	}
+
+	return new PHTreeSnapshot<DIM, WIDTH>(versions_, epochs_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PHTree<DIM, WIDTH>::requireInPlaceChanges(const char* operation) const {
+	if (versions_) {
+		throw runtime_error(string(operation) + " is not supported in copy-on-write mode");
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTree<DIM, WIDTH>::size() const {
+	return root_->getNumberOfSubtreeEntries();
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -0,0 +1,286 @@
+/*
+ * PHTreeBox.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_PHTREEBOX_H_
+#define SRC_PHTREEBOX_H_
+
+#include <vector>
+#include <thread>
+#include "Entry.h"
+#include "PHTree.h"
+#include "util/ThreadPool.h"
+
+// PH-Tree for K-dimensional boxes (hyper rectangles) with WIDTH bits per value.
+// Every box is stored as the 2K-dimensional point (lower left, upper right) so that
+// all window queries are range queries on the underlying PHTree<2K, WIDTH>.
+template <unsigned int K, unsigned int WIDTH>
+class PHTreeBox {
+public:
+	struct Box {
+		unsigned long lowerLeft[K];
+		unsigned long upperRight[K];
+	};
+
+	PHTreeBox();
+	PHTreeBox(const PHTreeBox<K, WIDTH>& other) = delete;
+	~PHTreeBox();
+
+	void insert(const Box& box, int id);
+	// removes the box and returns the ID it was stored with
+	std::pair<bool, int> remove(const Box& box);
+	std::pair<bool, int> lookup(const Box& box) const;
+
+	// IDs of all stored boxes that intersect the box (touching boxes intersect)
+	std::vector<int> queryIntersect(const Box& box) const;
+	// IDs of all stored boxes that contain the box
+	std::vector<int> queryContains(const Box& box) const;
+	// IDs of all stored boxes that are inside of the box
+	std::vector<int> queryContainedIn(const Box& box) const;
+	// push-based forms: call callback(int id) for every matching stored box
+	template <typename Callback>
+	void forEachIntersecting(const Box& box, Callback&& callback) const;
+	template <typename Callback>
+	void forEachContaining(const Box& box, Callback&& callback) const;
+	template <typename Callback>
+	void forEachContainedIn(const Box& box, Callback&& callback) const;
+
+	// answers all queries with the given number of threads: outIds[i] contains the result of query i
+	void parallelQueryIntersect(const std::vector<Box>& boxes, std::vector<std::vector<int>>& outIds,
+			size_t nThreads = std::thread::hardware_concurrency()) const;
+	void parallelQueryContains(const std::vector<Box>& boxes, std::vector<std::vector<int>>& outIds,
+			size_t nThreads = std::thread::hardware_concurrency()) const;
+	void parallelQueryContainedIn(const std::vector<Box>& boxes, std::vector<std::vector<int>>& outIds,
+			size_t nThreads = std::thread::hardware_concurrency()) const;
+
+	// the parallel queries use the threads of the pool instead of new ones (see PHTree::bindThreadPool)
+	void bindThreadPool(ThreadPool* threads);
+
+	// number of boxes in the tree
+	size_t size() const;
+	// the tree that stores the boxes as 2K-dimensional points
+	const PHTree<2 * K, WIDTH>& index() const;
+
+private:
+	enum BoxQueryType {
+		intersect_query,
+		contains_query,
+		contained_in_query
+	};
+
+	PHTree<2 * K, WIDTH> tree_;
+	ThreadPool* threads_;
+
+	static inline Entry<2 * K, WIDTH> toEntry(const Box& box, int id);
+	// range of 2K-dimensional points that answers the query
+	static inline void toWindow(const Box& box, BoxQueryType type,
+			Entry<2 * K, WIDTH>& outLowerLeft, Entry<2 * K, WIDTH>& outUpperRight);
+	template <typename Callback>
+	inline void forEachInWindow(const Box& box, BoxQueryType type, Callback& callback) const;
+	void parallelQuery(const std::vector<Box>& boxes, BoxQueryType type,
+			std::vector<std::vector<int>>& outIds, size_t nThreads) const;
+};
+
+#include <assert.h>
+#include "util/MultiDimBitset.h"
+#include "util/WorkStealingExecutor.h"
+
+using namespace std;
+
+template <unsigned int K, unsigned int WIDTH>
+PHTreeBox<K, WIDTH>::PHTreeBox() : tree_(), threads_(NULL) { }
+
+template <unsigned int K, unsigned int WIDTH>
+PHTreeBox<K, WIDTH>::~PHTreeBox() { }
+
+template <unsigned int K, unsigned int WIDTH>
+Entry<2 * K, WIDTH> PHTreeBox<K, WIDTH>::toEntry(const Box& box, int id) {
+	unsigned long values[2 * K];
+	for (unsigned k = 0; k < K; ++k) {
+		assert (box.lowerLeft[k] <= box.upperRight[k]);
+		values[k] = box.lowerLeft[k];
+		values[k + K] = box.upperRight[k];
+	}
+
+	Entry<2 * K, WIDTH> entry;
+	entry.id_ = id;
+	MultiDimBitset<2 * K>::template toBitset<WIDTH>(values, entry.values_);
+	return entry;
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::toWindow(const Box& box, BoxQueryType type,
+		Entry<2 * K, WIDTH>& outLowerLeft, Entry<2 * K, WIDTH>& outUpperRight) {
+	// with unsigned values 0 is the lowest and max the highest possible value
+	const unsigned long max = (WIDTH == 8 * sizeof (unsigned long))? -1uL : (1uL << WIDTH) - 1;
+	unsigned long lowerLeftValues[2 * K];
+	unsigned long upperRightValues[2 * K];
+	for (unsigned k = 0; k < K; ++k) {
+		assert (box.lowerLeft[k] <= box.upperRight[k]);
+		switch (type) {
+		case intersect_query:
+			// stored lower left <= upper right and stored upper right >= lower left
+			lowerLeftValues[k] = 0;
+			upperRightValues[k] = box.upperRight[k];
+			lowerLeftValues[k + K] = box.lowerLeft[k];
+			upperRightValues[k + K] = max;
+			break;
+		case contains_query:
+			// stored lower left <= lower left and stored upper right >= upper right
+			lowerLeftValues[k] = 0;
+			upperRightValues[k] = box.lowerLeft[k];
+			lowerLeftValues[k + K] = box.upperRight[k];
+			upperRightValues[k + K] = max;
+			break;
+		case contained_in_query:
+			// both corners of the stored box are inside of the box
+			lowerLeftValues[k] = box.lowerLeft[k];
+			upperRightValues[k] = box.upperRight[k];
+			lowerLeftValues[k + K] = box.lowerLeft[k];
+			upperRightValues[k + K] = box.upperRight[k];
+			break;
+		default: throw runtime_error("unknown query type");
+		}
+	}
+
+	MultiDimBitset<2 * K>::template toBitset<WIDTH>(lowerLeftValues, outLowerLeft.values_);
+	MultiDimBitset<2 * K>::template toBitset<WIDTH>(upperRightValues, outUpperRight.values_);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::insert(const Box& box, int id) {
+	tree_.insert(toEntry(box, id));
+}
+
+template <unsigned int K, unsigned int WIDTH>
+pair<bool, int> PHTreeBox<K, WIDTH>::remove(const Box& box) {
+	return tree_.remove(toEntry(box, 0));
+}
+
+template <unsigned int K, unsigned int WIDTH>
+pair<bool, int> PHTreeBox<K, WIDTH>::lookup(const Box& box) const {
+	return tree_.lookup(toEntry(box, 0));
+}
+
+template <unsigned int K, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeBox<K, WIDTH>::forEachInWindow(const Box& box, BoxQueryType type, Callback& callback) const {
+	Entry<2 * K, WIDTH> lowerLeft;
+	Entry<2 * K, WIDTH> upperRight;
+	toWindow(box, type, lowerLeft, upperRight);
+	tree_.forEachIdInRange(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeBox<K, WIDTH>::forEachIntersecting(const Box& box, Callback&& callback) const {
+	forEachInWindow(box, intersect_query, callback);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeBox<K, WIDTH>::forEachContaining(const Box& box, Callback&& callback) const {
+	forEachInWindow(box, contains_query, callback);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeBox<K, WIDTH>::forEachContainedIn(const Box& box, Callback&& callback) const {
+	forEachInWindow(box, contained_in_query, callback);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+vector<int> PHTreeBox<K, WIDTH>::queryIntersect(const Box& box) const {
+	vector<int> ids;
+	forEachIntersecting(box, [&ids] (int id) { ids.push_back(id); });
+	return ids;
+}
+
+template <unsigned int K, unsigned int WIDTH>
+vector<int> PHTreeBox<K, WIDTH>::queryContains(const Box& box) const {
+	vector<int> ids;
+	forEachContaining(box, [&ids] (int id) { ids.push_back(id); });
+	return ids;
+}
+
+template <unsigned int K, unsigned int WIDTH>
+vector<int> PHTreeBox<K, WIDTH>::queryContainedIn(const Box& box) const {
+	vector<int> ids;
+	forEachContainedIn(box, [&ids] (int id) { ids.push_back(id); });
+	return ids;
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::parallelQuery(const vector<Box>& boxes, BoxQueryType type,
+		vector<vector<int>>& outIds, size_t nThreads) const {
+	outIds.clear();
+	outIds.resize(boxes.size());
+	// every thread starts with a contiguous block of queries and takes the lowest index first:
+	// idle threads steal the remaining queries of busy ones (see WorkStealingExecutor)
+	auto answerQueries = [this, &boxes, type, &outIds] (ThreadPool& threads) {
+		const size_t nThreads = threads.nThreads();
+		WorkStealingExecutor<size_t> executor(nThreads);
+		const size_t chunkSize = 1 + boxes.size() / nThreads;
+		for (size_t threadIndex = 0; threadIndex < nThreads; ++threadIndex) {
+			const size_t start = chunkSize * threadIndex;
+			const size_t end = min(chunkSize * (threadIndex + 1), boxes.size());
+			for (size_t i = end; i > start; --i) {
+				executor.push(threadIndex, i - 1);
+			}
+		}
+
+		// each query only writes its own results
+		auto answerQuery = [this, &boxes, type, &outIds] (size_t, size_t queryIndex) {
+			vector<int>& ids = outIds[queryIndex];
+			auto append = [&ids] (int id) { ids.push_back(id); };
+			forEachInWindow(boxes[queryIndex], type, append);
+		};
+		executor.run(answerQuery, threads);
+	};
+
+	if (threads_) {
+		answerQueries(*threads_);
+	} else {
+		ThreadPool threads(nThreads);
+		answerQueries(threads);
+	}
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::parallelQueryIntersect(const vector<Box>& boxes,
+		vector<vector<int>>& outIds, size_t nThreads) const {
+	parallelQuery(boxes, intersect_query, outIds, nThreads);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::parallelQueryContains(const vector<Box>& boxes,
+		vector<vector<int>>& outIds, size_t nThreads) const {
+	parallelQuery(boxes, contains_query, outIds, nThreads);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::parallelQueryContainedIn(const vector<Box>& boxes,
+		vector<vector<int>>& outIds, size_t nThreads) const {
+	parallelQuery(boxes, contained_in_query, outIds, nThreads);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+void PHTreeBox<K, WIDTH>::bindThreadPool(ThreadPool* threads) {
+	threads_ = threads;
+	tree_.bindThreadPool(threads);
+}
+
+template <unsigned int K, unsigned int WIDTH>
+size_t PHTreeBox<K, WIDTH>::size() const {
+	return tree_.size();
+}
+
+template <unsigned int K, unsigned int WIDTH>
+const PHTree<2 * K, WIDTH>& PHTreeBox<K, WIDTH>::index() const {
+	return tree_;
+}
+
+#endif /* SRC_PHTREEBOX_H_ */
@@ -0,0 +1,226 @@
+/*
+ * PHTreeD.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_PHTREED_H_
+#define SRC_PHTREED_H_
+
+#include <vector>
+#include <type_traits>
+#include "Entry.h"
+#include "PHTree.h"
+
+template <unsigned int DIM, unsigned int WIDTH>
+class KnnQueryIterator;
+
+// PH-Tree with floating point keys (T is double or float). All points, hyper rectangles and
+// query windows are converted with the order preserving encoding of FileInputUtil so that
+// callers do not need to convert anything. -0.0 and +0.0 are the same key.
+template <unsigned int DIM, typename T = double>
+class PHTreeD {
+	static_assert (std::is_floating_point<T>::value && sizeof (T) <= sizeof (unsigned long),
+			"keys must be double or float");
+public:
+	static const unsigned int WIDTH = 8 * sizeof (unsigned long);
+
+	PHTreeD();
+	PHTreeD(const PHTreeD<DIM, T>& other) = delete;
+	~PHTreeD();
+
+	void insert(const std::vector<T>& values, int id);
+	// removes the entry with the given values and returns the ID it was stored with
+	std::pair<bool, int> remove(const std::vector<T>& values);
+	// moves the entry with the given ID from the old to the new values
+	bool update(const std::vector<T>& oldValues, const std::vector<T>& newValues, int id);
+	std::pair<bool, int> lookup(const std::vector<T>& values) const;
+	// calls callback(const T* values, int id) for every entry in the range (bounds are inclusive)
+	template <typename Callback>
+	void forEachInRange(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues, Callback&& callback) const;
+	size_t rangeCount(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues) const;
+	// returns the k entries closest to the point in ascending order of their distance (see toValues)
+	KnnQueryIterator<DIM, WIDTH>* knnQuery(const std::vector<T>& point, size_t k, DistanceMetric metric = euclidean_distance) const;
+
+	// hyper rectangles of DIM / 2 dimensions are stored as points (lower left, upper right) like in PHTree
+	void insertHyperRect(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues, int id);
+	std::pair<bool, int> lookupHyperRect(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues) const;
+	// calls callback(const T* values, int id) for every hyper rectangle that intersects the given one
+	template <typename Callback>
+	void forEachIntersecting(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues, Callback&& callback) const;
+	// calls callback(const T* values, int id) for every hyper rectangle that is inside of the given one
+	template <typename Callback>
+	void forEachIncluded(const std::vector<T>& lowerLeftValues, const std::vector<T>& upperRightValues, Callback&& callback) const;
+
+	// number of entries in the tree
+	size_t size() const;
+	// the tree that stores the encoded values
+	const PHTree<DIM, WIDTH>& index() const;
+
+	static inline unsigned long encode(T value);
+	static inline T decode(unsigned long encodedValue);
+	static inline std::vector<unsigned long> encode(const std::vector<T>& values);
+	// decodes the DIM values of an entry returned by the index
+	static inline void toValues(const Entry<DIM, WIDTH>& entry, T* outValues);
+
+private:
+	PHTree<DIM, WIDTH> tree_;
+
+	template <typename Callback>
+	inline void forEachInEncodedRange(const std::vector<unsigned long>& lowerLeft, const std::vector<unsigned long>& upperRight, Callback& callback) const;
+};
+
+#include <assert.h>
+#include <math.h>
+#include "util/FileInputUtil.h"
+#include "util/MultiDimBitset.h"
+#include "iterators/KnnQueryIterator.h"
+
+using namespace std;
+
+template <unsigned int DIM, typename T>
+PHTreeD<DIM, T>::PHTreeD() : tree_() { }
+
+template <unsigned int DIM, typename T>
+PHTreeD<DIM, T>::~PHTreeD() { }
+
+template <unsigned int DIM, typename T>
+unsigned long PHTreeD<DIM, T>::encode(T value) {
+	assert (!isnan(value) && "NaN is not ordered");
+	// floats are converted to doubles without losing precision
+	return FileInputUtil::encodeFloat(double(value));
+}
+
+template <unsigned int DIM, typename T>
+T PHTreeD<DIM, T>::decode(unsigned long encodedValue) {
+	return T(FileInputUtil::decodeFloat(encodedValue));
+}
+
+template <unsigned int DIM, typename T>
+vector<unsigned long> PHTreeD<DIM, T>::encode(const vector<T>& values) {
+	vector<unsigned long> encodedValues(values.size());
+	for (unsigned d = 0; d < values.size(); ++d) {
+		encodedValues[d] = encode(values[d]);
+	}
+
+	return encodedValues;
+}
+
+template <unsigned int DIM, typename T>
+void PHTreeD<DIM, T>::toValues(const Entry<DIM, WIDTH>& entry, T* outValues) {
+	unsigned long encodedValues[DIM];
+	MultiDimBitset<DIM>::toLongs(entry.values_, DIM * WIDTH, encodedValues);
+	for (unsigned d = 0; d < DIM; ++d) {
+		outValues[d] = decode(encodedValues[d]);
+	}
+}
+
+template <unsigned int DIM, typename T>
+void PHTreeD<DIM, T>::insert(const vector<T>& values, int id) {
+	assert (values.size() == DIM);
+	tree_.insert(encode(values), id);
+}
+
+template <unsigned int DIM, typename T>
+pair<bool, int> PHTreeD<DIM, T>::remove(const vector<T>& values) {
+	return tree_.remove(encode(values));
+}
+
+template <unsigned int DIM, typename T>
+bool PHTreeD<DIM, T>::update(const vector<T>& oldValues, const vector<T>& newValues, int id) {
+	return tree_.update(encode(oldValues), encode(newValues), id);
+}
+
+template <unsigned int DIM, typename T>
+pair<bool, int> PHTreeD<DIM, T>::lookup(const vector<T>& values) const {
+	return tree_.lookup(encode(values));
+}
+
+template <unsigned int DIM, typename T>
+template <typename Callback>
+void PHTreeD<DIM, T>::forEachInEncodedRange(const vector<unsigned long>& lowerLeft,
+		const vector<unsigned long>& upperRight, Callback& callback) const {
+	tree_.forEachInRange(lowerLeft, upperRight, [&callback] (const Entry<DIM, WIDTH>& entry) {
+		T values[DIM];
+		toValues(entry, values);
+		callback(static_cast<const T*>(values), entry.id_);
+	});
+}
+
+template <unsigned int DIM, typename T>
+template <typename Callback>
+void PHTreeD<DIM, T>::forEachInRange(const vector<T>& lowerLeftValues,
+		const vector<T>& upperRightValues, Callback&& callback) const {
+	assert (lowerLeftValues.size() == DIM && upperRightValues.size() == DIM);
+	forEachInEncodedRange(encode(lowerLeftValues), encode(upperRightValues), callback);
+}
+
+template <unsigned int DIM, typename T>
+size_t PHTreeD<DIM, T>::rangeCount(const vector<T>& lowerLeftValues, const vector<T>& upperRightValues) const {
+	return tree_.rangeCount(encode(lowerLeftValues), encode(upperRightValues));
+}
+
+template <unsigned int DIM, typename T>
+KnnQueryIterator<DIM, PHTreeD<DIM, T>::WIDTH>* PHTreeD<DIM, T>::knnQuery(const vector<T>& point,
+		size_t k, DistanceMetric metric) const {
+	return tree_.knnQuery(encode(point), k, metric, true);
+}
+
+template <unsigned int DIM, typename T>
+void PHTreeD<DIM, T>::insertHyperRect(const vector<T>& lowerLeftValues,
+		const vector<T>& upperRightValues, int id) {
+	tree_.insertHyperRect(encode(lowerLeftValues), encode(upperRightValues), id);
+}
+
+template <unsigned int DIM, typename T>
+pair<bool, int> PHTreeD<DIM, T>::lookupHyperRect(const vector<T>& lowerLeftValues,
+		const vector<T>& upperRightValues) const {
+	return tree_.lookupHyperRect(encode(lowerLeftValues), encode(upperRightValues));
+}
+
+template <unsigned int DIM, typename T>
+template <typename Callback>
+void PHTreeD<DIM, T>::forEachIntersecting(const vector<T>& lowerLeftValues,
+		const vector<T>& upperRightValues, Callback&& callback) const {
+	static_assert (DIM % 2 == 0, "hyper rectangles need an even number of dimensions");
+	assert ((2 * lowerLeftValues.size() == DIM) && (2 * upperRightValues.size() == DIM));
+	// same window as PHTree::intersectionQuery: the encoding of -inf is 0 and the one of +inf is -1
+	vector<unsigned long> lowerLeftHyperRect(DIM, 0);
+	vector<unsigned long> upperRightHyperRect(DIM, -1uL);
+	for (unsigned k = 0; k < DIM / 2; ++k) {
+		assert (lowerLeftValues[k] <= upperRightValues[k]);
+		upperRightHyperRect[k] = encode(upperRightValues[k]);
+		lowerLeftHyperRect[k + DIM / 2] = encode(lowerLeftValues[k]);
+	}
+
+	forEachInEncodedRange(lowerLeftHyperRect, upperRightHyperRect, callback);
+}
+
+template <unsigned int DIM, typename T>
+template <typename Callback>
+void PHTreeD<DIM, T>::forEachIncluded(const vector<T>& lowerLeftValues,
+		const vector<T>& upperRightValues, Callback&& callback) const {
+	static_assert (DIM % 2 == 0, "hyper rectangles need an even number of dimensions");
+	assert ((2 * lowerLeftValues.size() == DIM) && (2 * upperRightValues.size() == DIM));
+	vector<unsigned long> lowerLeftHyperRect(DIM);
+	vector<unsigned long> upperRightHyperRect(DIM);
+	for (unsigned k = 0; k < DIM; ++k) {
+		lowerLeftHyperRect[k] = encode(lowerLeftValues[k % (DIM / 2)]);
+		upperRightHyperRect[k] = encode(upperRightValues[k % (DIM / 2)]);
+	}
+
+	forEachInEncodedRange(lowerLeftHyperRect, upperRightHyperRect, callback);
+}
+
+template <unsigned int DIM, typename T>
+size_t PHTreeD<DIM, T>::size() const {
+	return tree_.size();
+}
+
+template <unsigned int DIM, typename T>
+const PHTree<DIM, PHTreeD<DIM, T>::WIDTH>& PHTreeD<DIM, T>::index() const {
+	return tree_;
+}
+
+#endif /* SRC_PHTREED_H_ */
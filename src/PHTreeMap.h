@@ -0,0 +1,240 @@
+/*
+ * PHTreeMap.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_PHTREEMAP_H_
+#define SRC_PHTREEMAP_H_
+
+#include <vector>
+#include <type_traits>
+#include "Entry.h"
+#include "PHTree.h"
+#include "util/ValueColumn.h"
+
+// PH-Tree that maps each key to a value of type T (e.g. 64 bit IDs or other POD payloads).
+// The layout is chosen at compile time: values with up to 32 bits are stored in the nodes like
+// the IDs of PHTree (InlineValues), larger values in a separate column (ValueColumn).
+// The column is not kept per node: bulkLoad() stores the values in the order of the keys but
+// later inserts append their values (or reuse removed rows), so range queries read them
+// sequentially again only after clusterValues().
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+class PHTreeMap {
+public:
+	PHTreeMap();
+	PHTreeMap(const PHTreeMap<DIM, WIDTH, T>& other) = delete;
+	~PHTreeMap();
+
+	// returns false if the key is already stored (the stored value is kept)
+	bool insert(const std::vector<unsigned long>& values, const T& value);
+	// builds the map at once (the map must be empty) and clusters the values by their keys
+	// (one value of duplicate keys is kept)
+	void bulkLoad(const std::vector<std::vector<unsigned long>>& keys, const std::vector<T>& values);
+	// removes the key and returns the value it was stored with
+	std::pair<bool, T> remove(const std::vector<unsigned long>& values);
+	// moves the value of the old key to the new key
+	bool update(const std::vector<unsigned long>& oldValues, const std::vector<unsigned long>& newValues);
+	// replaces the value of a stored key
+	bool replace(const std::vector<unsigned long>& values, const T& value);
+
+	std::pair<bool, T> lookup(const std::vector<unsigned long>& values) const;
+	// looks up n keys at once: outResults[i] is the result of lookup(keys[i]) (the IDs of the keys are ignored)
+	void lookupBatch(const Entry<DIM, WIDTH>* keys, size_t n, std::pair<bool, T>* outResults) const;
+	// calls callback(const Entry<DIM, WIDTH>& key, const T& value) for every key in the range
+	template <typename Callback>
+	void forEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	// calls callback(const T& value) for every key in the range
+	template <typename Callback>
+	void forEachValueInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// reorders the column of large values in the order of the keys so that the values of each
+	// subtree are stored contiguously and range queries read them sequentially
+	void clusterValues();
+
+	// number of keys in the map
+	size_t size() const;
+	// the tree that stores the keys with the IDs of their values (see value(int))
+	const PHTree<DIM, WIDTH>& index() const;
+	// value stored with the ID that the iterators of the index return
+	T value(int id) const;
+
+private:
+	typedef typename std::conditional<sizeof (T) <= sizeof (int), InlineValues<T>, ValueColumn<T>>::type Values;
+
+	PHTree<DIM, WIDTH> tree_;
+	Values values_;
+};
+
+#include <assert.h>
+#include <stdexcept>
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+PHTreeMap<DIM, WIDTH, T>::PHTreeMap() : tree_(), values_() { }
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+PHTreeMap<DIM, WIDTH, T>::~PHTreeMap() { }
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMap<DIM, WIDTH, T>::insert(const vector<unsigned long>& values, const T& value) {
+	assert (values.size() == DIM);
+	const size_t sizeBefore = tree_.size();
+	const int id = values_.store(value);
+	tree_.insert(values, id);
+	if (tree_.size() == sizeBefore) {
+		// the key already exists and keeps its value
+		values_.release(id);
+		return false;
+	}
+
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+void PHTreeMap<DIM, WIDTH, T>::bulkLoad(const vector<vector<unsigned long>>& keys, const vector<T>& values) {
+	assert (keys.size() == values.size());
+	if (size() > 0) {
+		throw runtime_error("bulk loading requires an empty map");
+	}
+
+	vector<int> ids;
+	ids.reserve(values.size());
+	values_.reserve(values.size());
+	for (const T& value : values) {
+		ids.push_back(values_.store(value));
+	}
+
+	tree_.bulkLoad(keys, ids);
+	// also drops the values of duplicate keys that the tree did not keep
+	clusterValues();
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+pair<bool, T> PHTreeMap<DIM, WIDTH, T>::remove(const vector<unsigned long>& values) {
+	const pair<bool, int> removed = tree_.remove(values);
+	if (!removed.first) {
+		return pair<bool, T>(false, T());
+	}
+
+	const T value = values_.load(removed.second);
+	values_.release(removed.second);
+	return pair<bool, T>(true, value);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMap<DIM, WIDTH, T>::update(const vector<unsigned long>& oldValues,
+		const vector<unsigned long>& newValues) {
+	const pair<bool, int> stored = tree_.lookup(oldValues);
+	if (!stored.first) {
+		return false;
+	}
+
+	// the value stays at its ID
+	return tree_.update(oldValues, newValues, stored.second);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMap<DIM, WIDTH, T>::replace(const vector<unsigned long>& values, const T& value) {
+	const pair<bool, int> stored = tree_.lookup(values);
+	if (!stored.first) {
+		return false;
+	}
+
+	if (!Values::isInline) {
+		values_.replace(stored.second, value);
+		return true;
+	}
+
+	// the value is the ID itself: update the ID in place
+	const Entry<DIM, WIDTH> oldEntry(values, stored.second);
+	const Entry<DIM, WIDTH> newEntry(values, values_.store(value));
+	return tree_.update(oldEntry, newEntry);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+pair<bool, T> PHTreeMap<DIM, WIDTH, T>::lookup(const vector<unsigned long>& values) const {
+	const pair<bool, int> stored = tree_.lookup(values);
+	if (!stored.first) {
+		return pair<bool, T>(false, T());
+	}
+
+	return pair<bool, T>(true, values_.load(stored.second));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+void PHTreeMap<DIM, WIDTH, T>::lookupBatch(const Entry<DIM, WIDTH>* keys, size_t n,
+		pair<bool, T>* outResults) const {
+	assert (keys || n == 0);
+	const size_t batchSize = 64;
+	pair<bool, int> stored[batchSize];
+	for (size_t from = 0; from < n; from += batchSize) {
+		const size_t nKeys = (n - from < batchSize)? n - from : batchSize;
+		tree_.lookupBatch(keys + from, nKeys, stored);
+		for (size_t i = 0; i < nKeys; ++i) {
+			outResults[from + i].first = stored[i].first;
+			outResults[from + i].second = (stored[i].first)? T(values_.load(stored[i].second)) : T();
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMap<DIM, WIDTH, T>::forEachInRange(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Values& column = values_;
+	tree_.forEachInRange(lowerLeftValues, upperRightValues, [&column, &callback] (const Entry<DIM, WIDTH>& entry) {
+		callback(entry, column.load(entry.id_));
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMap<DIM, WIDTH, T>::forEachValueInRange(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Values& column = values_;
+	tree_.forEachIdInRange(lowerLeftValues, upperRightValues, [&column, &callback] (int id) {
+		callback(column.load(id));
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMap<DIM, WIDTH, T>::rangeCount(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	return tree_.rangeCount(lowerLeftValues, upperRightValues);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+void PHTreeMap<DIM, WIDTH, T>::clusterValues() {
+	if (Values::isInline) {
+		// the values are already stored in the nodes
+		return;
+	}
+
+	Values clusteredValues;
+	clusteredValues.reserve(values_.size());
+	const Values& oldValues = values_;
+	tree_.mapIds([&clusteredValues, &oldValues] (int id) {
+		return clusteredValues.store(oldValues.load(id));
+	});
+	values_.swap(clusteredValues);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMap<DIM, WIDTH, T>::size() const {
+	return tree_.size();
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+const PHTree<DIM, WIDTH>& PHTreeMap<DIM, WIDTH, T>::index() const {
+	return tree_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+T PHTreeMap<DIM, WIDTH, T>::value(int id) const {
+	return values_.load(id);
+}
+
+#endif /* SRC_PHTREEMAP_H_ */
@@ -0,0 +1,304 @@
+/*
+ * PHTreeMultiMap.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_PHTREEMULTIMAP_H_
+#define SRC_PHTREEMULTIMAP_H_
+
+#include <vector>
+#include <type_traits>
+#include "Entry.h"
+#include "PHTree.h"
+#include "util/PostingLists.h"
+
+// PH-Tree that allows multiple values (e.g. IDs) per key: the nodes store one ID per key which
+// refers to a posting list with all values of the key (see PostingLists). A key with a single
+// integral value that fits into 31 bits stores the value itself (lowest bit of the ID set)
+// until a second value arrives.
+template <unsigned int DIM, unsigned int WIDTH, typename T = int>
+class PHTreeMultiMap {
+public:
+	PHTreeMultiMap();
+	PHTreeMultiMap(const PHTreeMultiMap<DIM, WIDTH, T>& other) = delete;
+	~PHTreeMultiMap();
+
+	// adds the value to the values of the key
+	void insert(const std::vector<unsigned long>& values, const T& value);
+	// removes the key with all of its values and returns the number of removed values
+	size_t remove(const std::vector<unsigned long>& values);
+	// removes one occurrence of the value from the key (requires T::operator==)
+	bool remove(const std::vector<unsigned long>& values, const T& value);
+
+	// appends all values of the key and returns their number
+	size_t lookup(const std::vector<unsigned long>& values, std::vector<T>& outValues) const;
+	// number of values of the key
+	size_t count(const std::vector<unsigned long>& values) const;
+	// calls callback(const Entry<DIM, WIDTH>& key, const T& value) for every value of the keys in the range
+	template <typename Callback>
+	void forEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	// calls callback(const T& value) for every value of the keys in the range
+	template <typename Callback>
+	void forEachValueInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+	// number of values of the keys in the range
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+
+	// number of values in the map
+	size_t size() const;
+	// number of distinct keys in the map
+	size_t nKeys() const;
+	// the tree that stores the keys with their single (inline) value or the ID of their posting list
+	const PHTree<DIM, WIDTH>& index() const;
+
+private:
+	// integral values can be stored in the IDs of the tree
+	typedef std::integral_constant<bool, std::is_integral<T>::value && sizeof (T) <= sizeof (int)> CanInline;
+
+	PHTree<DIM, WIDTH> tree_;
+	PostingLists<T> lists_;
+	size_t nValues_;
+
+	static inline bool isInline(int id);
+	static inline int toListId(int list);
+	static inline int toList(int id);
+	// returns false if the value does not fit into the ID
+	static inline bool toInlineId(const T& value, int* outId, std::true_type canInline);
+	static inline bool toInlineId(const T& value, int* outId, std::false_type canInline);
+	// calls callback(const T& value) with the value stored in the ID
+	template <typename Callback>
+	static inline void callWithInlineValue(int id, Callback& callback, std::true_type canInline);
+	template <typename Callback>
+	static inline void callWithInlineValue(int id, Callback& callback, std::false_type canInline);
+	// calls callback(const T& value) for all values stored with the ID
+	template <typename Callback>
+	inline void forEachValue(int id, Callback& callback) const;
+	inline size_t nValuesOf(int id) const;
+};
+
+#include <assert.h>
+#include <climits>
+#include <stdexcept>
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+PHTreeMultiMap<DIM, WIDTH, T>::PHTreeMultiMap() : tree_(), lists_(), nValues_(0) { }
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+PHTreeMultiMap<DIM, WIDTH, T>::~PHTreeMultiMap() { }
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMultiMap<DIM, WIDTH, T>::isInline(int id) {
+	return id & 1;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+int PHTreeMultiMap<DIM, WIDTH, T>::toListId(int list) {
+	assert (list >= 0);
+	if (list > (INT_MAX >> 1)) {
+		throw runtime_error("too many posting lists: the list indices must fit into 30 bits");
+	}
+
+	return list << 1;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+int PHTreeMultiMap<DIM, WIDTH, T>::toList(int id) {
+	assert (!isInline(id) && id >= 0);
+	return id >> 1;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMultiMap<DIM, WIDTH, T>::toInlineId(const T& value, int* outId, std::true_type) {
+	const long longValue = (long) value;
+	if (longValue < -(1L << 30) || longValue >= (1L << 30)) {
+		return false;
+	}
+
+	(*outId) = (int) (2 * longValue + 1);
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMultiMap<DIM, WIDTH, T>::toInlineId(const T&, int*, std::false_type) {
+	return false;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMultiMap<DIM, WIDTH, T>::callWithInlineValue(int id, Callback& callback, std::true_type) {
+	assert (isInline(id));
+	const T value = (T) ((id - 1) / 2);
+	callback(value);
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMultiMap<DIM, WIDTH, T>::callWithInlineValue(int, Callback&, std::false_type) {
+	assert (false && "only integral values are stored in the IDs");
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMultiMap<DIM, WIDTH, T>::forEachValue(int id, Callback& callback) const {
+	if (isInline(id)) {
+		callWithInlineValue(id, callback, CanInline());
+	} else {
+		lists_.forEach(toList(id), callback);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::nValuesOf(int id) const {
+	return (isInline(id))? 1 : lists_.size(toList(id));
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+void PHTreeMultiMap<DIM, WIDTH, T>::insert(const vector<unsigned long>& values, const T& value) {
+	assert (values.size() == DIM);
+	int newId;
+	const bool inlineValue = toInlineId(value, &newId, CanInline());
+	if (!inlineValue) {
+		newId = toListId(lists_.create(value));
+	}
+
+	// a duplicate key only changes the ID at the slot the insertion already found
+	auto addToKey = [this, &value, inlineValue, newId] (int storedId) {
+		if (!inlineValue) {
+			// the key already has a value so the new list is not needed
+			lists_.release(toList(newId));
+		}
+
+		int list;
+		if (isInline(storedId)) {
+			// second value of the key: the inline value moves into a new list
+			auto createList = [this, &list] (const T& storedValue) { list = lists_.create(storedValue); };
+			callWithInlineValue(storedId, createList, CanInline());
+		} else {
+			list = toList(storedId);
+		}
+
+		lists_.add(list, value);
+		return toListId(list);
+	};
+
+	const Entry<DIM, WIDTH> entry(values, newId);
+	tree_.insertOrMerge(entry, addToKey);
+	++nValues_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::remove(const vector<unsigned long>& values) {
+	const pair<bool, int> removed = tree_.remove(values);
+	if (!removed.first) {
+		return 0;
+	}
+
+	const size_t nRemoved = nValuesOf(removed.second);
+	if (!isInline(removed.second)) {
+		lists_.release(toList(removed.second));
+	}
+
+	nValues_ -= nRemoved;
+	return nRemoved;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+bool PHTreeMultiMap<DIM, WIDTH, T>::remove(const vector<unsigned long>& values, const T& value) {
+	const pair<bool, int> stored = tree_.lookup(values);
+	if (!stored.first) {
+		return false;
+	}
+
+	if (isInline(stored.second)) {
+		bool equal = false;
+		auto compare = [&value, &equal] (const T& storedValue) { equal = storedValue == value; };
+		callWithInlineValue(stored.second, compare, CanInline());
+		if (!equal) {
+			return false;
+		}
+
+		tree_.remove(values);
+	} else {
+		const int list = toList(stored.second);
+		if (!lists_.remove(list, value)) {
+			return false;
+		}
+
+		if (lists_.empty(list)) {
+			// the last value of the key was removed
+			tree_.remove(values);
+			lists_.release(list);
+		}
+	}
+
+	--nValues_;
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::lookup(const vector<unsigned long>& values, vector<T>& outValues) const {
+	const pair<bool, int> stored = tree_.lookup(values);
+	if (!stored.first) {
+		return 0;
+	}
+
+	const size_t nValuesBefore = outValues.size();
+	auto append = [&outValues] (const T& value) { outValues.push_back(value); };
+	forEachValue(stored.second, append);
+	return outValues.size() - nValuesBefore;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::count(const vector<unsigned long>& values) const {
+	const pair<bool, int> stored = tree_.lookup(values);
+	return (stored.first)? nValuesOf(stored.second) : 0;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMultiMap<DIM, WIDTH, T>::forEachInRange(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	tree_.forEachInRange(lowerLeftValues, upperRightValues, [this, &callback] (const Entry<DIM, WIDTH>& entry) {
+		auto callWithKey = [&entry, &callback] (const T& value) { callback(entry, value); };
+		forEachValue(entry.id_, callWithKey);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+template <typename Callback>
+void PHTreeMultiMap<DIM, WIDTH, T>::forEachValueInRange(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	tree_.forEachIdInRange(lowerLeftValues, upperRightValues, [this, &callback] (int id) {
+		forEachValue(id, callback);
+	});
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::rangeCount(const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	size_t nValues = 0;
+	tree_.forEachIdInRange(lowerLeftValues, upperRightValues, [this, &nValues] (int id) {
+		nValues += nValuesOf(id);
+	});
+	return nValues;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::size() const {
+	return nValues_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+size_t PHTreeMultiMap<DIM, WIDTH, T>::nKeys() const {
+	return tree_.size();
+}
+
+template <unsigned int DIM, unsigned int WIDTH, typename T>
+const PHTree<DIM, WIDTH>& PHTreeMultiMap<DIM, WIDTH, T>::index() const {
+	return tree_;
+}
+
+#endif /* SRC_PHTREEMULTIMAP_H_ */
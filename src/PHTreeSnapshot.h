@@ -0,0 +1,174 @@
+/*
+ * PHTreeSnapshot.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_PHTREESNAPSHOT_H_
+#define SRC_PHTREESNAPSHOT_H_
+
+#include <vector>
+#include "Entry.h"
+
+template <unsigned int DIM>
+class Node;
+template <unsigned int DIM>
+class VersionManager;
+template <unsigned int DIM, unsigned int WIDTH>
+class PHTree;
+template <unsigned int DIM, unsigned int WIDTH>
+class RangeQueryIterator;
+class EpochManager;
+
+// Immutable version of a PH-Tree in copy-on-write mode (see PHTree::snapshot). Writers never change
+// the nodes of a published version so the queries read them without locks or validation while
+// other threads change the tree. The version is kept until the snapshot is deleted which has to
+// happen after its iterators are deleted and before the tree is deleted.
+template <unsigned int DIM, unsigned int WIDTH>
+class PHTreeSnapshot {
+	friend class PHTree<DIM, WIDTH>;
+public:
+	PHTreeSnapshot(const PHTreeSnapshot<DIM, WIDTH>& other) = delete;
+	~PHTreeSnapshot();
+
+	std::pair<bool,int> lookup(const Entry<DIM, WIDTH>& e) const;
+	std::pair<bool,int> lookup(const std::vector<unsigned long>& values) const;
+	RangeQueryIterator<DIM, WIDTH>* rangeQuery(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
+	RangeQueryIterator<DIM, WIDTH>* rangeQuery(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// number of entries in the range
+	size_t rangeCount(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) const;
+	size_t rangeCount(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues) const;
+	// push-based range query: calls callback(const Entry<DIM, WIDTH>&) for every entry in the range
+	template <typename Callback>
+	void forEachInRange(const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const;
+	template <typename Callback>
+	void forEachInRange(const std::vector<unsigned long>& lowerLeftValues, const std::vector<unsigned long>& upperRightValues, Callback&& callback) const;
+
+	// number of entries in the version
+	size_t size() const;
+	// versions increase with every change of the tree
+	unsigned long version() const;
+
+private:
+	VersionManager<DIM>* versions_;
+	// the retired nodes of released versions are passed on to the epochs of the tree
+	EpochManager* epochs_;
+	const Node<DIM>* root_;
+	unsigned long version_;
+
+	PHTreeSnapshot(VersionManager<DIM>* versions, EpochManager* epochs);
+};
+
+#include <assert.h>
+#include "nodes/Node.h"
+#include "util/EpochManager.h"
+#include "util/VersionManager.h"
+#include "util/MultiDimBitset.h"
+#include "util/RangeQueryMaskUtil.h"
+#include "util/SpatialSelectionOperationsUtil.h"
+#include "iterators/RangeQueryIterator.h"
+#include "iterators/FastRangeQueryIterator.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+PHTreeSnapshot<DIM, WIDTH>::PHTreeSnapshot(VersionManager<DIM>* versions, EpochManager* epochs)
+		: versions_(versions), epochs_(epochs), root_(NULL), version_(0) {
+	assert (versions_);
+	root_ = versions_->acquire(&version_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+PHTreeSnapshot<DIM, WIDTH>::~PHTreeSnapshot() {
+	// optimistic readers of the tree might still read the nodes that are freed
+	EpochGuard epochGuard(epochs_);
+	versions_->release(version_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTreeSnapshot<DIM, WIDTH>::lookup(const Entry<DIM, WIDTH>& e) const {
+	return SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(e, root_, NULL);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool,int> PHTreeSnapshot<DIM, WIDTH>::lookup(const vector<unsigned long>& values) const {
+	const Entry<DIM, WIDTH> entry(values, 0);
+	return lookup(entry);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+RangeQueryIterator<DIM, WIDTH>* PHTreeSnapshot<DIM, WIDTH>::rangeQuery(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight) const {
+	vector<pair<unsigned long, const Node<DIM>*>> visitedNodes;
+	SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(lowerLeft, root_, &visitedNodes);
+	return new RangeQueryIterator<DIM, WIDTH>(&visitedNodes, lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+RangeQueryIterator<DIM, WIDTH>* PHTreeSnapshot<DIM, WIDTH>::rangeQuery(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	return rangeQuery(lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTreeSnapshot<DIM, WIDTH>::rangeCount(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight) const {
+	FastRangeQueryIterator<DIM, WIDTH> it(root_, lowerLeft, upperRight, true);
+	return it.count();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTreeSnapshot<DIM, WIDTH>::rangeCount(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	return rangeCount(lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeSnapshot<DIM, WIDTH>::forEachInRange(const Entry<DIM, WIDTH>& lowerLeft,
+		const Entry<DIM, WIDTH>& upperRight, Callback&& callback) const {
+	assert (root_ && root_->getPrefixLength() == 0);
+	unsigned long lowerLeftValues[DIM];
+	unsigned long upperRightValues[DIM];
+	MultiDimBitset<DIM>::toLongs(lowerLeft.values_, DIM * WIDTH, lowerLeftValues);
+	MultiDimBitset<DIM>::toLongs(upperRight.values_, DIM * WIDTH, upperRightValues);
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeftValues[d] <= upperRightValues[d] && "should be: lower left < upper right");
+		if (lowerLeftValues[d] > upperRightValues[d]) {
+			return;
+		}
+	}
+
+	const unsigned long rootValues[RangeQueryMaskUtil<DIM, WIDTH>::nBlocks] = {};
+	SpatialSelectionOperationsUtil<DIM, WIDTH>::template forEachInRange<true>(root_, rootValues, 0, false,
+			lowerLeftValues, upperRightValues, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void PHTreeSnapshot<DIM, WIDTH>::forEachInRange(
+		const vector<unsigned long>& lowerLeftValues,
+		const vector<unsigned long>& upperRightValues, Callback&& callback) const {
+	const Entry<DIM, WIDTH> lowerLeft(lowerLeftValues, 0);
+	const Entry<DIM, WIDTH> upperRight(upperRightValues, 0);
+	forEachInRange(lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t PHTreeSnapshot<DIM, WIDTH>::size() const {
+	return root_->getNumberOfSubtreeEntries();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned long PHTreeSnapshot<DIM, WIDTH>::version() const {
+	return version_;
+}
+
+#endif /* SRC_PHTREESNAPSHOT_H_ */
@@ -0,0 +1,340 @@
+/*
+ * FastRangeQueryIterator.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_ITERATORS_FASTRANGEQUERYITERATOR_H_
+#define SRC_ITERATORS_FASTRANGEQUERYITERATOR_H_
+
+#include <cstdint>
+#include "nodes/Node.h"
+#include "nodes/NodeContentArrays.h"
+#include "iterators/FastRangeQueryStackContent.h"
+#include "util/RangeQueryMaskUtil.h"
+#include "Entry.h"
+
+template <unsigned int DIM>
+class Node;
+
+// Range query iterator that does not allocate memory after construction:
+// uses a fixed size stack (each node consumes at least one level) and walks the
+// reference arrays of LHC and AHC nodes instead of the virtual node iterators.
+// RangeQueryIterator remains the reference implementation.
+template <unsigned int DIM, unsigned int WIDTH>
+class FastRangeQueryIterator {
+public:
+	FastRangeQueryIterator(const Node<DIM>* root,
+			const Entry<DIM, WIDTH>& lowerLeft,
+			const Entry<DIM, WIDTH>& upperRight, bool idsOnly = false);
+	virtual ~FastRangeQueryIterator();
+
+	// only valid if the iterator does not skip the values (idsOnly = false)
+	Entry<DIM, WIDTH> next();
+	// returns the ID of the next entry without reconstructing its values
+	int nextId();
+	bool hasNext() const;
+	// consumes the iterator and returns the number of the remaining entries
+	size_t count();
+
+private:
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	static const unsigned long highestAddress = MaskUtil::highestAddress;
+	static const unsigned int bitsPerBlock = MaskUtil::bitsPerBlock;
+	static const unsigned int nBlocks = MaskUtil::nBlocks;
+
+	bool hasNext_;
+	// values of entries in fully contained nodes are not reconstructed
+	const bool idsOnly_;
+	// number of nodes on the stack
+	unsigned int depth_;
+	FastRangeQueryStackContent<DIM, WIDTH> stack_[WIDTH];
+
+	// per dimension values of the range
+	unsigned long lowerLeft_[DIM];
+	unsigned long upperRight_[DIM];
+
+	// interleaved bits and ID of the entry that is returned by the next call of next()
+	unsigned long nextValues_[nBlocks];
+	int nextId_;
+
+#ifndef NDEBUG
+	const Node<DIM>* root_;
+#endif
+
+	bool stepDown(const Node<DIM>* node, const unsigned long* values,
+			unsigned int index, bool parentFullyContained);
+	void goToNextValidSuffix();
+	inline void copyValuesWithAddress(const FastRangeQueryStackContent<DIM, WIDTH>& content,
+			unsigned long hcAddress, unsigned long* outValues) const;
+	inline bool isSuffixInRange(const unsigned long* values) const;
+	inline bool nextReference(FastRangeQueryStackContent<DIM, WIDTH>& content,
+			unsigned long* outHcAddress, std::uintptr_t* outReference) const;
+};
+
+#include <assert.h>
+#include "util/MultiDimBitset.h"
+#include "util/SpatialSelectionOperationsUtil.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>::FastRangeQueryIterator(const Node<DIM>* root,
+		const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight, bool idsOnly)
+		: hasNext_(false), idsOnly_(idsOnly), depth_(0), stack_(), lowerLeft_(), upperRight_(),
+		  nextValues_(), nextId_(0) {
+	assert (DIM < bitsPerBlock && WIDTH <= bitsPerBlock);
+	assert (root && root->getPrefixLength() == 0);
+
+#ifndef NDEBUG
+	root_ = root;
+#endif
+
+	MultiDimBitset<DIM>::toLongs(lowerLeft.values_, DIM * WIDTH, lowerLeft_);
+	MultiDimBitset<DIM>::toLongs(upperRight.values_, DIM * WIDTH, upperRight_);
+	bool validRange = true;
+	for (unsigned d = 0; d < DIM; ++d) {
+		validRange &= lowerLeft_[d] <= upperRight_[d];
+	}
+
+	assert (validRange && "should be: lower left < upper right");
+	if (validRange) {
+		const unsigned long rootValues[nBlocks] = {};
+		stepDown(root, rootValues, 0, false);
+		goToNextValidSuffix();
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+FastRangeQueryIterator<DIM, WIDTH>::~FastRangeQueryIterator() { }
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool FastRangeQueryIterator<DIM, WIDTH>::hasNext() const {
+	return hasNext_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Entry<DIM, WIDTH> FastRangeQueryIterator<DIM, WIDTH>::next() {
+	assert (hasNext() && !idsOnly_);
+
+	Entry<DIM, WIDTH> entry(nextValues_, nextId_);
+
+#ifndef NDEBUG
+	// validation only: is the retrieved entry part of the tree?
+	std::pair<bool, int> lookup = SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(entry, root_, NULL);
+	assert (lookup.first && lookup.second == entry.id_);
+	unsigned long values[DIM];
+	MultiDimBitset<DIM>::toLongs(nextValues_, DIM * WIDTH, values);
+	assert (MaskUtil::isInRange(values, lowerLeft_, upperRight_));
+#endif
+
+	goToNextValidSuffix();
+	return entry;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+int FastRangeQueryIterator<DIM, WIDTH>::nextId() {
+	assert (hasNext());
+	const int id = nextId_;
+	goToNextValidSuffix();
+	return id;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t FastRangeQueryIterator<DIM, WIDTH>::count() {
+	size_t nEntries = (hasNext_)? 1 : 0;
+	hasNext_ = false;
+	while (depth_ > 0) {
+		FastRangeQueryStackContent<DIM, WIDTH>& content = stack_[depth_ - 1];
+		unsigned long hcAddress;
+		uintptr_t reference;
+		if (!nextReference(content, &hcAddress, &reference)) {
+			--depth_;
+			continue;
+		}
+
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		assert ((isPointer || isSuffix) && "special pointers are only used during parallel inserts");
+		if (isPointer && !isSuffix) {
+			const Node<DIM>* subnode = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+			if (content.fullyContained) {
+				// all entries below a fully contained node are in the range
+				nEntries += subnode->getNumberOfSubtreeEntries();
+			} else {
+				unsigned long values[nBlocks];
+				copyValuesWithAddress(content, hcAddress, values);
+				stepDown(subnode, values, content.currentIndex_ + 1, false);
+			}
+		} else if (content.fullyContained) {
+			++nEntries;
+		} else {
+			unsigned long values[nBlocks];
+			copyValuesWithAddress(content, hcAddress, values);
+			MaskUtil::pushBackSuffix(content.arrays_, content.currentIndex_, reference, values);
+			nEntries += isSuffixInRange(values);
+		}
+	}
+
+	return nEntries;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void FastRangeQueryIterator<DIM, WIDTH>::goToNextValidSuffix() {
+	while (depth_ > 0) {
+		FastRangeQueryStackContent<DIM, WIDTH>& content = stack_[depth_ - 1];
+		unsigned long hcAddress;
+		uintptr_t reference;
+		if (!nextReference(content, &hcAddress, &reference)) {
+			// ascend to the previous level if the end of the node was reached
+			--depth_;
+			continue;
+		}
+
+		// flags in the 2 lowest bits: isPointer | isSuffix
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		assert ((isPointer || isSuffix) && "special pointers are only used during parallel inserts");
+
+		if (isPointer && !isSuffix) {
+			// descend to the next level in case of a subnode
+			const Node<DIM>* subnode = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+			unsigned long values[nBlocks];
+			copyValuesWithAddress(content, hcAddress, values);
+			stepDown(subnode, values, content.currentIndex_ + 1, content.fullyContained);
+			continue;
+		}
+
+		if (idsOnly_ && content.fullyContained) {
+			// no need to reconstruct the values of the suffix
+			nextId_ = reference >> 32;
+			hasNext_ = true;
+			return;
+		}
+
+		unsigned long values[nBlocks];
+		copyValuesWithAddress(content, hcAddress, values);
+		MaskUtil::pushBackSuffix(content.arrays_, content.currentIndex_, reference, values);
+		if (content.fullyContained || isSuffixInRange(values)) {
+			// found a suffix in the range
+			for (unsigned i = 0; i < nBlocks; ++i) {
+				nextValues_[i] = values[i];
+			}
+			nextId_ = reference >> 32;
+			hasNext_ = true;
+			return;
+		}
+	}
+
+	hasNext_ = false;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void FastRangeQueryIterator<DIM, WIDTH>::copyValuesWithAddress(
+		const FastRangeQueryStackContent<DIM, WIDTH>& content,
+		unsigned long hcAddress, unsigned long* outValues) const {
+	// msb       [interleaved format]       lsb
+	// [ higher levels |curr|    suffix     ]
+	for (unsigned i = 0; i < nBlocks; ++i) {
+		outValues[i] = content.values_[i];
+	}
+	const unsigned int suffixLength = WIDTH - content.currentIndex_ - 1;
+	MultiDimBitset<DIM>::pushBackValue(hcAddress, outValues, DIM * suffixLength);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool FastRangeQueryIterator<DIM, WIDTH>::isSuffixInRange(const unsigned long* values) const {
+	return MaskUtil::isSuffixInRange(values, lowerLeft_, upperRight_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool FastRangeQueryIterator<DIM, WIDTH>::stepDown(const Node<DIM>* node, const unsigned long* values,
+		unsigned int index, bool parentFullyContained) {
+	assert (depth_ < WIDTH);
+	FastRangeQueryStackContent<DIM, WIDTH>& content = stack_[depth_];
+	node->getContentArrays(content.arrays_);
+	const size_t prefixLength = content.arrays_.prefixLength;
+	const unsigned int currentIndex = index + prefixLength;
+	assert (currentIndex < WIDTH);
+
+	// add the prefix to the bits of the higher levels
+	for (unsigned i = 0; i < nBlocks; ++i) {
+		content.values_[i] = values[i];
+	}
+	if (prefixLength > 0) {
+		MaskUtil::pushBackBits(content.arrays_.prefixStartBlock, DIM * prefixLength,
+				content.values_, DIM * (WIDTH - currentIndex));
+	}
+
+	content.fullyContained = parentFullyContained;
+	content.lowerMask_ = 0;
+	content.upperMask_ = highestAddress;
+	if (!parentFullyContained && !MaskUtil::calculateMasks(content.values_, currentIndex,
+			lowerLeft_, upperRight_, &content.lowerMask_, &content.upperMask_, &content.fullyContained)) {
+		// the prefix is not in the range
+		return false;
+	}
+
+	assert ((content.lowerMask_ & content.upperMask_) == content.lowerMask_);
+	content.currentIndex_ = currentIndex;
+	if (content.arrays_.isAhc) {
+		content.position_ = content.lowerMask_;
+		content.endPosition_ = content.upperMask_;
+		content.done_ = false;
+	} else {
+		// binary search for the first row that can contain an address in the range
+		const unsigned long l = MaskUtil::lowerBoundLhcRow(content.arrays_.addresses,
+				content.arrays_.nReferences, content.lowerMask_);
+		content.position_ = l;
+		content.endPosition_ = content.arrays_.nReferences;
+		content.done_ = l >= content.endPosition_;
+	}
+
+	++depth_;
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool FastRangeQueryIterator<DIM, WIDTH>::nextReference(FastRangeQueryStackContent<DIM, WIDTH>& content,
+		unsigned long* outHcAddress, std::uintptr_t* outReference) const {
+	const unsigned long lowerMask = content.lowerMask_;
+	const unsigned long upperMask = content.upperMask_;
+	if (content.arrays_.isAhc) {
+		while (!content.done_) {
+			const unsigned long hcAddress = content.position_;
+			if (hcAddress == content.endPosition_) {
+				content.done_ = true;
+			} else {
+				content.position_ = MaskUtil::nextInMaskRange(hcAddress, lowerMask, upperMask);
+			}
+
+			const uintptr_t reference = content.arrays_.references[hcAddress];
+			if (reference != 0) {
+				(*outHcAddress) = hcAddress;
+				(*outReference) = reference;
+				return true;
+			}
+		}
+	} else {
+		while (!content.done_) {
+			const unsigned long row = content.position_;
+			const unsigned long hcAddress = MaskUtil::lookupLhcAddress(content.arrays_.addresses, row);
+			++content.position_;
+			content.done_ = content.position_ >= content.endPosition_ || hcAddress >= upperMask;
+			if (hcAddress > upperMask) {
+				break;
+			}
+
+			if (MaskUtil::isInMaskRange(hcAddress, lowerMask, upperMask)) {
+				(*outHcAddress) = hcAddress;
+				(*outReference) = content.arrays_.references[row];
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+#endif /* SRC_ITERATORS_FASTRANGEQUERYITERATOR_H_ */
@@ -0,0 +1,35 @@
+/*
+ * FastRangeQueryStackContent.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_ITERATORS_FASTRANGEQUERYSTACKCONTENT_H_
+#define SRC_ITERATORS_FASTRANGEQUERYSTACKCONTENT_H_
+
+#include "nodes/NodeContentArrays.h"
+
+template <unsigned int DIM, unsigned int WIDTH>
+struct FastRangeQueryStackContent {
+public:
+	bool fullyContained;
+
+	unsigned long lowerMask_;
+	unsigned long upperMask_;
+
+	// level of the HC addresses of the node
+	unsigned int currentIndex_;
+	// AHC: next HC address to visit, LHC: next row to visit
+	unsigned long position_;
+	// AHC: last HC address to visit, LHC: row after the last row to visit
+	unsigned long endPosition_;
+	// no more addresses of the node can be in the range
+	bool done_;
+
+	NodeContentArrays<DIM> arrays_;
+	// interleaved bits of all levels above the HC address (lower bits are 0)
+	unsigned long values_[1 + (DIM * WIDTH - 1) / (sizeof (unsigned long) * 8)];
+};
+
+#endif /* SRC_ITERATORS_FASTRANGEQUERYSTACKCONTENT_H_ */
@@ -0,0 +1,217 @@
+/*
+ * KnnQueryIterator.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_ITERATORS_KNNQUERYITERATOR_H_
+#define SRC_ITERATORS_KNNQUERYITERATOR_H_
+
+#include <queue>
+#include <vector>
+#include "nodes/Node.h"
+#include "iterators/KnnQueueContent.h"
+#include "util/DistanceUtil.h"
+#include "Entry.h"
+
+template <unsigned int DIM>
+class Node;
+
+template <unsigned int DIM, unsigned int WIDTH>
+class KnnQueryIterator {
+public:
+	KnnQueryIterator(const Node<DIM>* root, const std::vector<unsigned long>& point,
+			size_t k, DistanceMetric metric, bool isFloat);
+	virtual ~KnnQueryIterator();
+
+	Entry<DIM, WIDTH> next();
+	bool hasNext() const;
+	// distance between the query point and the entry last returned by next()
+	double getDistance() const;
+
+private:
+	const size_t k_;
+	size_t nReturned_;
+	const DistanceMetric metric_;
+	const bool isFloat_;
+	double lastDistance_;
+	unsigned long point_[DIM];
+
+	// best-first queue of nodes and entries ordered by their (minimum) distance
+	std::priority_queue<KnnQueueContent<DIM>> queue_;
+	// distances of the k closest entries found so far (max-heap): once there are k of them,
+	// regions and entries farther away than the k-th one cannot be a result and are skipped
+	std::priority_queue<double> kDistances_;
+
+	inline void goToNextEntry();
+	void expand(const KnnQueueContent<DIM>& content);
+	inline bool isPruned(double distance) const;
+	inline void addResultCandidate(double distance);
+	static inline void setLevel(unsigned long* values, size_t msbIndex, unsigned long hcAddress);
+};
+
+#include <assert.h>
+#include "util/MultiDimBitset.h"
+#include "iterators/NodeIterator.h"
+#include "nodes/NodeAddressContent.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+KnnQueryIterator<DIM, WIDTH>::KnnQueryIterator(const Node<DIM>* root,
+		const vector<unsigned long>& point, size_t k, DistanceMetric metric, bool isFloat)
+		: k_(k), nReturned_(0), metric_(metric), isFloat_(isFloat),
+		  lastDistance_(0.0), point_(), queue_(), kDistances_() {
+	assert (point.size() == DIM);
+	assert (!isFloat || WIDTH == 8 * sizeof (unsigned long));
+
+	for (unsigned d = 0; d < DIM; ++d) {
+		point_[d] = point[d];
+	}
+
+	KnnQueueContent<DIM> rootContent;
+	rootContent.distance_ = 0.0;
+	rootContent.node_ = root;
+	rootContent.index_ = 0;
+	rootContent.id_ = 0;
+	for (unsigned d = 0; d < DIM; ++d) {
+		rootContent.values_[d] = 0;
+	}
+
+	queue_.push(rootContent);
+	if (k_ > 0) {
+		goToNextEntry();
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+KnnQueryIterator<DIM, WIDTH>::~KnnQueryIterator() { }
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool KnnQueryIterator<DIM, WIDTH>::hasNext() const {
+	return nReturned_ < k_ && !queue_.empty();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+double KnnQueryIterator<DIM, WIDTH>::getDistance() const {
+	assert (nReturned_ > 0);
+	return lastDistance_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Entry<DIM, WIDTH> KnnQueryIterator<DIM, WIDTH>::next() {
+	assert (hasNext());
+	const KnnQueueContent<DIM> content = queue_.top();
+	queue_.pop();
+	assert (!content.node_);
+
+	++nReturned_;
+	lastDistance_ = content.distance_;
+	if (nReturned_ < k_) {
+		goToNextEntry();
+	}
+
+	const vector<unsigned long> values(content.values_, content.values_ + DIM);
+	return Entry<DIM, WIDTH>(values, content.id_);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void KnnQueryIterator<DIM, WIDTH>::goToNextEntry() {
+	// an entry on top of the queue is at least as close as all remaining regions
+	while (!queue_.empty() && queue_.top().node_) {
+		const KnnQueueContent<DIM> content = queue_.top();
+		queue_.pop();
+		expand(content);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void KnnQueryIterator<DIM, WIDTH>::expand(const KnnQueueContent<DIM>& content) {
+	const Node<DIM>* node = content.node_;
+	unsigned long values[DIM];
+	for (unsigned d = 0; d < DIM; ++d) {
+		values[d] = content.values_[d];
+	}
+
+	// restore the levels stored in the prefix
+	const size_t prefixLength = node->getPrefixLength();
+	const unsigned long* prefixStartBlock = node->getFixPrefixStartBlock();
+	for (size_t i = 0; i < prefixLength; ++i) {
+		const unsigned long prefixAddress = MultiDimBitset<DIM>::interleaveBits(prefixStartBlock, i, DIM * prefixLength);
+		setLevel(values, content.index_ + i, prefixAddress);
+	}
+
+	const size_t currentIndex = content.index_ + prefixLength;
+	assert (currentIndex < WIDTH);
+	const size_t suffixLength = WIDTH - currentIndex - 1;
+	NodeIterator<DIM>* it = node->begin();
+	NodeIterator<DIM>* endIt = node->end();
+	for (; (*it) != *endIt; ++(*it)) {
+		const NodeAddressContent<DIM> addressContent = *(*it);
+		assert (addressContent.exists && !addressContent.hasSpecialPointer);
+
+		KnnQueueContent<DIM> child;
+		for (unsigned d = 0; d < DIM; ++d) {
+			child.values_[d] = values[d];
+		}
+		setLevel(child.values_, currentIndex, addressContent.address);
+
+		if (addressContent.hasSubnode) {
+			child.node_ = addressContent.subnode;
+			child.index_ = currentIndex + 1;
+			child.id_ = 0;
+			child.distance_ = DistanceUtil<DIM, WIDTH>::minDistance(child.values_,
+					currentIndex + 1, point_, metric_, isFloat_);
+			if (isPruned(child.distance_)) {
+				continue;
+			}
+		} else {
+			const unsigned long* suffixStartBlock = addressContent.getSuffixStartBlock();
+			for (size_t i = 0; i < suffixLength; ++i) {
+				const unsigned long suffixAddress = MultiDimBitset<DIM>::interleaveBits(suffixStartBlock, i, DIM * suffixLength);
+				setLevel(child.values_, currentIndex + 1 + i, suffixAddress);
+			}
+
+			child.node_ = NULL;
+			child.index_ = WIDTH;
+			child.id_ = addressContent.id;
+			child.distance_ = DistanceUtil<DIM, WIDTH>::distance(child.values_,
+					point_, metric_, isFloat_);
+			if (isPruned(child.distance_)) {
+				continue;
+			}
+			addResultCandidate(child.distance_);
+		}
+
+		queue_.push(child);
+	}
+
+	delete it;
+	delete endIt;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool KnnQueryIterator<DIM, WIDTH>::isPruned(double distance) const {
+	// ties with the k-th closest entry are kept
+	return kDistances_.size() == k_ && distance > kDistances_.top();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void KnnQueryIterator<DIM, WIDTH>::addResultCandidate(double distance) {
+	assert (!isPruned(distance));
+	if (kDistances_.size() == k_) {
+		kDistances_.pop();
+	}
+	kDistances_.push(distance);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void KnnQueryIterator<DIM, WIDTH>::setLevel(unsigned long* values, size_t msbIndex, unsigned long hcAddress) {
+	assert (msbIndex < WIDTH);
+	for (unsigned d = 0; d < DIM; ++d) {
+		values[d] |= ((hcAddress >> d) & 1uL) << (WIDTH - 1 - msbIndex);
+	}
+}
+
+#endif /* SRC_ITERATORS_KNNQUERYITERATOR_H_ */
@@ -0,0 +1,38 @@
+/*
+ * KnnQueueContent.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_ITERATORS_KNNQUEUECONTENT_H_
+#define SRC_ITERATORS_KNNQUEUECONTENT_H_
+
+#include <stddef.h>
+
+template <unsigned int DIM>
+class Node;
+
+template <unsigned int DIM>
+struct KnnQueueContent {
+public:
+	// minimum distance of the node's region or exact distance of the entry
+	double distance_;
+	// node that still needs to be expanded or NULL if the content is an entry
+	const Node<DIM>* node_;
+	// level of the highest prefix bit of the node
+	size_t index_;
+	int id_;
+	// per dimension values of all levels above the node (all levels for entries)
+	unsigned long values_[DIM];
+
+	// inverse order for a min-heap on the distance, entries precede nodes on ties
+	bool operator<(const KnnQueueContent<DIM>& other) const {
+		if (distance_ != other.distance_) {
+			return distance_ > other.distance_;
+		}
+		return node_ && !other.node_;
+	}
+};
+
+#endif /* SRC_ITERATORS_KNNQUEUECONTENT_H_ */
@@ -13,6 +13,7 @@
 #include "iterators/NodeIterator.h"
 #include "iterators/RangeQueryStackContent.h"
 #include "util/MultiDimBitset.h"
+#include "util/RangeQueryMaskUtil.h"
 #include "Entry.h"
 
 template <unsigned int DIM>
@@ -21,7 +22,6 @@ class Node;
 template <unsigned int DIM, unsigned int WIDTH>
 class RangeQueryIterator {
 public:
-	// TODO add version that does not recreate the spatial data but only returns IDs
 	RangeQueryIterator(std::vector<std::pair<unsigned long, const Node<DIM>*>>* nodeStack,
 			const Entry<DIM, WIDTH>& lowerLeft,
 			const Entry<DIM, WIDTH>& upperRight);
@@ -31,7 +31,8 @@ public:
 	bool hasNext() const;
 
 private:
-	static const size_t highestAddress = (1u << DIM) - 1;
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	static const unsigned long highestAddress = MaskUtil::highestAddress;
 
 	bool hasNext_;
 	size_t currentIndex_;
@@ -43,38 +44,22 @@ private:
 	RangeQueryStackContent<DIM> currentContent;
 	// storage for bits from higher nodes (lower levels from stack)
 	// Combined with a suffix this defines an entry.
-	unsigned long currentValue[1 + (DIM * WIDTH - 1) / (sizeof (unsigned long) * 8)];
+	unsigned long currentValue[MaskUtil::nBlocks];
 	// The address contents of the currently processed address in the currently processed node
 	NodeAddressContent<DIM> currentAddressContent;
 
-	const Entry<DIM, WIDTH> lowerLeftCorner_;
-	const Entry<DIM, WIDTH> upperRightCorner_;
+	// per dimension values of the range
+	unsigned long lowerLeft_[DIM];
+	unsigned long upperRight_[DIM];
 
 
 	void stepUp();
 	bool stepDown(const Node<DIM>* nextNode, unsigned long hcAddress);
 	inline bool isInMaskRange(unsigned long hcAddress) const;
 	inline bool isSuffixInRange();
-	inline void createCurrentContent(const Node<DIM>* nextNode, unsigned long hcAddress, unsigned int prefixLength);
+	inline void createCurrentContent(const Node<DIM>* nextNode, unsigned int prefixLength,
+			unsigned long lowerMask, unsigned long upperMask, bool fullyContained);
 	inline void goToNextValidSuffix();
-
-	// utility functions for local calculations:
-	inline void compareLocalLower(unsigned long prevLeft, unsigned long currLeft,
-				unsigned long prevAddress,
-				unsigned long* outCompEqual, unsigned long* outCompSmaller) const;
-	inline void compareLocalUpper(unsigned long prevRight, unsigned long currRight,
-				unsigned long prevAddress,
-				unsigned long* outCompEqual, unsigned long* outCompSmaller) const;
-	inline void compareLocalRangeLower(unsigned int skipLowerNBits, unsigned int compareNBits,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const;
-	inline void compareLocalRangeUpper(unsigned int skipLowerNBits, unsigned int compareNBits,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const;
-	inline void connectLocalToPrevLower(unsigned long prevEqualComp, unsigned long prevSmallerComp,
-			unsigned long localEqualComp, unsigned long localSmallerComp,
-			unsigned long* outNewEqualComp, unsigned long* outNewSmallerComp) const;
-	inline void connectLocalToPrevUpper(unsigned long prevEqualComp, unsigned long prevSmallerComp,
-			unsigned long localEqualComp, unsigned long localSmallerComp,
-			unsigned long* outNewEqualComp, unsigned long* outNewSmallerlComp) const;
 };
 
 #include <assert.h>
@@ -87,31 +72,29 @@ template <unsigned int DIM, unsigned int WIDTH>
 RangeQueryIterator<DIM, WIDTH>::RangeQueryIterator(vector<pair<unsigned long, const Node<DIM>*>>* visitedNodes,
 		const Entry<DIM, WIDTH>& lowerLeft, const Entry<DIM, WIDTH>& upperRight) : hasNext_(true),
 		currentIndex_(0), stack_(),
-		currentValue(), lowerLeftCorner_(lowerLeft),
-		upperRightCorner_(upperRight) {
+		currentValue(), lowerLeft_(), upperRight_() {
 
+	MultiDimBitset<DIM>::toLongs(lowerLeft.values_, DIM * WIDTH, lowerLeft_);
+	MultiDimBitset<DIM>::toLongs(upperRight.values_, DIM * WIDTH, upperRight_);
 #ifndef NDEBUG
 	// validation only: lower left < upper right
-	pair<unsigned long, unsigned long> comp = MultiDimBitset<DIM>::
-				compareSmallerEqual(lowerLeftCorner_.values_, upperRightCorner_.values_, DIM * WIDTH, 0, highestAddress);
-	assert ((comp.first == highestAddress) && "should be: lower left < upper right");
+	for (unsigned d = 0; d < DIM; ++d) {
+		assert (lowerLeft_[d] <= upperRight_[d] && "should be: lower left < upper right");
+	}
 #endif
 
 	assert (!visitedNodes->empty() && "at least the root node must have been visited");
 	if (visitedNodes->empty()) {
 		hasNext_ = false;
 	} else {
-		currentContent.fullyContained = false;
-		currentContent.lowerContained = false;
-		currentContent.upperContained = false;
-		// start: range window is fully included in domain
-		currentContent.lowerCompEqual = highestAddress;
-		currentContent.lowerCompSmaller = 0;
-		currentContent.upperCompEqual = highestAddress;
-		currentContent.upperCompSmaller = 0;
 		// the first node has to be the root node which does not have a prefix!
 		const Node<DIM>* root = (*visitedNodes)[0].second;
-		createCurrentContent(root, 0, 0);
+		unsigned long lowerMask;
+		unsigned long upperMask;
+		bool fullyContained;
+		// the root covers the whole domain so the range always intersects it
+		MaskUtil::calculateMasks(currentValue, 0, lowerLeft_, upperRight_, &lowerMask, &upperMask, &fullyContained);
+		createCurrentContent(root, 0, lowerMask, upperMask, fullyContained);
 		for (unsigned int i = 1; i < visitedNodes->size(); ++i) {
 			const pair<unsigned long, const Node<DIM>*> nextNode = (*visitedNodes)[i];
 			// TODO actually no need to validate prefixes since the lookup already did that?!
@@ -188,13 +171,7 @@ Entry<DIM, WIDTH> RangeQueryIterator<DIM, WIDTH>::next() {
 	assert (lookup.first && lookup.second == entry.id_);
 
 	// validation only: lower left <= entry <= upper right
-	// i.e. if in any dimension the inverse operation for < is not 0 there is an error
-	pair<unsigned long, unsigned long> lowerComp = MultiDimBitset<DIM>::
-				compareSmallerEqual(lowerLeftCorner_.values_, entry.values_, DIM * WIDTH, 0, highestAddress);
-	pair<unsigned long, unsigned long> upperComp = MultiDimBitset<DIM>::
-				compareSmallerEqual(entry.values_, upperRightCorner_.values_, DIM * WIDTH, 0, highestAddress);
-	assert (((lowerComp.first | lowerComp.second) == highestAddress) && "should be: lower left <= entry");
-	assert (((upperComp.first | upperComp.second) == highestAddress) && "should be: entry <= upper right");
+	assert (MaskUtil::isSuffixInRange(entry.values_, lowerLeft_, upperRight_) && "should be: lower left <= entry <= upper right");
 #endif
 
 	++(*currentContent.startIt_);
@@ -251,9 +228,8 @@ bool RangeQueryIterator<DIM, WIDTH>::isInMaskRange(unsigned long hcAddress) cons
 	assert (currentContent.lowerMask_ <= currentContent.upperMask_);
 	assert (currentContent.lowerMask_ <= hcAddress && hcAddress <= currentContent.upperMask_);
 
-	const bool addressMatch = currentContent.fullyContained
-			|| (((hcAddress | currentContent.lowerMask_) & currentContent.upperMask_) == hcAddress);
-	return addressMatch;
+	return currentContent.fullyContained
+			|| MaskUtil::isInMaskRange(hcAddress, currentContent.lowerMask_, currentContent.upperMask_);
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -264,10 +240,6 @@ bool RangeQueryIterator<DIM, WIDTH>::isSuffixInRange() {
 
 	if (currentContent.fullyContained) { return true; }
 
-	// <prev. compared>
-	//                 <---- local comparison --->
-	// [    higher    |curr|       suffix        ]
-
 	// Verify if the final entry drops out of the range!
 	// assemble the entry from the buffer, the current HC address and the current suffix
 	const unsigned int suffixLength = WIDTH - currentIndex_ - 1;
@@ -276,38 +248,7 @@ bool RangeQueryIterator<DIM, WIDTH>::isSuffixInRange() {
 	if (suffixLength > 0)
 		MultiDimBitset<DIM>::pushBackBitset(currentAddressContent.getSuffixStartBlock(), suffixBits, currentValue, 0);
 
-	bool suffixContained = true;
-	// local comparison: compare the entire suffix and the current address
-	const unsigned int compareLowestNBits = suffixBits + DIM;
-	// validate: range lower left <= entry (suffix)
-	if (!currentContent.lowerContained) {
-		unsigned long lowerCompRangeEqualLocal;
-		unsigned long lowerCompRangeSmallerLocal;
-		compareLocalRangeLower(0, compareLowestNBits, &lowerCompRangeEqualLocal, &lowerCompRangeSmallerLocal);
-		unsigned long lowerCompEqualWithSuffix;
-		unsigned long lowerCompSmallerWithSuffix;
-		connectLocalToPrevLower(currentContent.lowerCompEqual, currentContent.lowerCompSmaller,
-				lowerCompRangeEqualLocal, lowerCompRangeSmallerLocal,
-				&lowerCompEqualWithSuffix, &lowerCompSmallerWithSuffix);
-
-		// lower <= current (with prefix)
-		suffixContained = (lowerCompEqualWithSuffix | lowerCompSmallerWithSuffix) == highestAddress;
-	}
-
-	// validate: entry (suffix) <= range upper right
-	if (suffixContained && !currentContent.upperContained) {
-		unsigned long upperCompRangeEqualLocal;
-		unsigned long upperCompRangeSmallerLocal;
-		compareLocalRangeUpper(0, compareLowestNBits, &upperCompRangeEqualLocal, &upperCompRangeSmallerLocal);
-		unsigned long upperCompEqualWithSuffix;
-		unsigned long upperCompSmallerWithSuffix;
-		connectLocalToPrevUpper(currentContent.upperCompEqual, currentContent.upperCompSmaller,
-				upperCompRangeEqualLocal, upperCompRangeSmallerLocal,
-				&upperCompEqualWithSuffix, &upperCompSmallerWithSuffix);
-
-		// upper >= current (with prefix) <=> (not(smaller) and not(equal)) or equal <=> not(smaller) or equal
-		suffixContained = (upperCompEqualWithSuffix | (highestAddress & (~upperCompSmallerWithSuffix))) == highestAddress;
-	}
+	const bool suffixContained = MaskUtil::isSuffixInRange(currentValue, lowerLeft_, upperRight_);
 
 	// clear the buffer (remove the HC address and possibly also the suffix)
 	if (suffixLength > 0) {
@@ -317,14 +258,7 @@ bool RangeQueryIterator<DIM, WIDTH>::isSuffixInRange() {
 	}
 
 	assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, DIM * (WIDTH - currentIndex_), 0));
-	if (suffixContained) {
-		// the suffix is in the upper range
-		// thus it will be in the next entry to be returned
-		// TODO --> no need to clear the value
-		return true;
-	} else {
-		return false;
-	}
+	return suffixContained;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -371,8 +305,6 @@ bool RangeQueryIterator<DIM, WIDTH>::stepDown(const Node<DIM>* nextNode, unsigne
 
 	// msb               [interleaved format]                      lsb
 	// <-filled-><DIM><DIM *|prefix|><DIM><-------- ignored --------->
-	// <prev. compared>             <------- later compared --------->
-	//          < local comparison >
 	// [ higher |last|current prefix|curr|     lower node bits       ]
 	// last: node currently descending from
 	// curr: node currently descending into
@@ -381,286 +313,60 @@ bool RangeQueryIterator<DIM, WIDTH>::stepDown(const Node<DIM>* nextNode, unsigne
 	currentIndex_ += 1;
 	MultiDimBitset<DIM>::pushBackValue(hcAddress, currentValue, (WIDTH - currentIndex_) * DIM);
 	const size_t prefixLength = nextNode->getPrefixLength();
-	unsigned long lowerCompEqualWithPrefix = currentContent.lowerCompEqual;
-	unsigned long lowerCompSmallerWithPrefix = currentContent.lowerCompSmaller;
-	unsigned long upperCompEqualWithPrefix = currentContent.upperCompEqual;
-	unsigned long upperCompSmallerWithPrefix = currentContent.upperCompSmaller;
-	unsigned long lastAddress = hcAddress;
 	if (prefixLength > 0) {
 		// add the prefix of the next node to the current prefix
 		currentIndex_ += prefixLength;
-		const unsigned int ignoreNLowestBits = DIM * (WIDTH - currentIndex_);
 		MultiDimBitset<DIM>::pushBackBitset(nextNode->getFixPrefixStartBlock(), prefixLength * DIM,
 				currentValue, (WIDTH - currentIndex_) * DIM);
 		assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, DIM * (WIDTH - currentIndex_), 0));
+	}
 
-		const unsigned int compareNBits = DIM * prefixLength + DIM;
-		// varify if the prefix is still within the range
-		bool prefixValid = true;
-		if (!currentContent.lowerContained) {
-			unsigned long lowerCompRangeEqualLocal;
-			unsigned long lowerCompRangeSmallerLocal;
-			compareLocalRangeLower(ignoreNLowestBits, compareNBits, &lowerCompRangeEqualLocal, &lowerCompRangeSmallerLocal);
-			connectLocalToPrevLower(currentContent.lowerCompEqual, currentContent.lowerCompSmaller,
-					lowerCompRangeEqualLocal, lowerCompRangeSmallerLocal,
-					&lowerCompEqualWithPrefix, &lowerCompSmallerWithPrefix);
-
-			// lower <= current (with prefix)
-			prefixValid = (lowerCompEqualWithPrefix | lowerCompSmallerWithPrefix) == highestAddress;
-		}
-
-		if (prefixValid && !currentContent.upperContained) {
-			unsigned long upperCompRangeEqualLocal;
-			unsigned long upperCompRangeSmallerLocal;
-			compareLocalRangeUpper(ignoreNLowestBits, compareNBits, &upperCompRangeEqualLocal, &upperCompRangeSmallerLocal);
-			connectLocalToPrevUpper(currentContent.upperCompEqual, currentContent.upperCompSmaller,
-					upperCompRangeEqualLocal, upperCompRangeSmallerLocal,
-					&upperCompEqualWithPrefix, &upperCompSmallerWithPrefix);
-
-			// upper >= current (with prefix) <=> (not(smaller) and not(equal)) or equal <=> not(smaller) or equal
-			prefixValid = (upperCompEqualWithPrefix | (highestAddress & (~upperCompSmallerWithPrefix))) == highestAddress;
-		}
-
-		if (!prefixValid) {
-			// the prefix was not in the range so remove it
-			currentIndex_ -= (prefixLength + 1);
-			const unsigned int freeLsbBits = DIM * (WIDTH - currentIndex_);
-			MultiDimBitset<DIM>::removeHighestBits(currentValue, freeLsbBits, (prefixLength + 1) * DIM);
-			assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, DIM * (WIDTH - currentIndex_), 0));
-			return false;
-		} else {
-			lastAddress = MultiDimBitset<DIM>::interleaveBits(currentValue, currentIndex_ - 1, DIM * WIDTH);
-		}
-
-	#ifndef NDEBUG
-		// validation: is the locally composed comparison for the prefix correct so far?
-		pair<unsigned long, unsigned long> fullLowerComp = MultiDimBitset<DIM>::
-				compareSmallerEqual(lowerLeftCorner_.values_, currentValue, DIM * WIDTH, ignoreNLowestBits, highestAddress);
-		assert (fullLowerComp.first == lowerCompSmallerWithPrefix && fullLowerComp.second == lowerCompEqualWithPrefix);
-		pair<unsigned long, unsigned long> fullUpperComp = MultiDimBitset<DIM>::
-				compareSmallerEqual(upperRightCorner_.values_, currentValue, DIM * WIDTH, ignoreNLowestBits, highestAddress);
-		assert (fullUpperComp.first == upperCompSmallerWithPrefix && fullUpperComp.second == upperCompEqualWithPrefix);
-	#endif
+	// verify if the prefix is still within the range
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = highestAddress;
+	bool fullyContained = currentContent.fullyContained;
+	if (!fullyContained && !MaskUtil::calculateMasks(currentValue, currentIndex_,
+			lowerLeft_, upperRight_, &lowerMask, &upperMask, &fullyContained)) {
+		// the prefix was not in the range so remove it
+		assert (prefixLength > 0 && "an address in the mask range always intersects the range");
+		currentIndex_ -= (prefixLength + 1);
+		const unsigned int freeLsbBits = DIM * (WIDTH - currentIndex_);
+		MultiDimBitset<DIM>::removeHighestBits(currentValue, freeLsbBits, (prefixLength + 1) * DIM);
+		assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, DIM * (WIDTH - currentIndex_), 0));
+		return false;
 	}
 
 	// puts a duplicate on the stack
 	stack_.push(currentContent);
-	currentContent.lowerCompEqual = lowerCompEqualWithPrefix;
-	currentContent.lowerCompSmaller = lowerCompSmallerWithPrefix;
-	currentContent.upperCompEqual = upperCompEqualWithPrefix;
-	currentContent.upperCompSmaller = upperCompSmallerWithPrefix;
-
-	createCurrentContent(nextNode, lastAddress, prefixLength);
+	createCurrentContent(nextNode, prefixLength, lowerMask, upperMask, fullyContained);
 	assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, DIM * (WIDTH - currentIndex_), 0));
 	return true;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::compareLocalLower(unsigned long prevLeft, unsigned long currLeft,
-			unsigned long prevAddress,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const {
-	// local lower equal if: (previous lower == previous address) and (current lower == 0)
-	(*outCompEqual) = (~(prevLeft ^ prevAddress)) & (~currLeft) & highestAddress;
-	// local lower smaller if: previous lower (0) <  previous address (1)
-	(*outCompSmaller) = (~prevLeft) & prevAddress;
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::compareLocalUpper(unsigned long prevRight, unsigned long currRight,
-			unsigned long prevAddress,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const {
-	// local upper | equal if: (previous upper == previous address) and (current upper == 1)
-	(*outCompEqual) = (~(prevRight ^ prevAddress)) & currRight;
-	// local upper | smaller in cases (u - upper range, x - current node):
-	// [u|_|x|x] or [_|u|x|x] or [_|_|xu|x] or [xu|x|_|_]
-	(*outCompSmaller) = highestAddress &
-			(((~prevRight) & prevAddress)
-			| (prevRight & prevAddress & (~currRight))
-			| ((~prevRight) & (~prevAddress) & (~currRight)));
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::connectLocalToPrevLower(unsigned long prevEqualComp, unsigned long prevSmallerComp,
-		unsigned long localEqualComp, unsigned long localSmallerComp,
-		unsigned long* outNewEqualComp, unsigned long* outNewSmallerComp) const {
-	// it is equal if it was equal and it is locally equal or if it was bigger and is locally equal
-	(*outNewEqualComp) = localEqualComp & (prevEqualComp | (~prevSmallerComp));
-	// it is smaller if it was smaller or if it is locally smaller
-	(*outNewSmallerComp) = localSmallerComp | prevSmallerComp;
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::connectLocalToPrevUpper(unsigned long prevEqualComp, unsigned long prevSmallerComp,
-		unsigned long localEqualComp, unsigned long localSmallerComp,
-		unsigned long* outNewEqualComp, unsigned long* outNewSmallerComp) const {
-	// it is equal if it was equal or smaller and is now equal
-	(*outNewEqualComp) = localEqualComp & (prevEqualComp | prevSmallerComp);
-	// it is smaller if it was equal or smaller and is now smaller
-	(*outNewSmallerComp) = localSmallerComp & (prevEqualComp | prevSmallerComp);
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::compareLocalRangeLower(unsigned int skipLowerNBits, unsigned int compareNBits,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const {
-	// all dimensions need to be compared where the lower left range is not already < current
-	unsigned long compareDimMask = currentContent.lowerCompEqual | (highestAddress & (~currentContent.lowerCompSmaller));
-	pair<unsigned long, unsigned long> lowerComp = MultiDimBitset<DIM>::compareSmallerEqual(
-			lowerLeftCorner_.values_, currentValue,
-			skipLowerNBits + compareNBits, skipLowerNBits,
-			compareDimMask);
-	(*outCompEqual) = lowerComp.second;
-	(*outCompSmaller) = lowerComp.first;
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::compareLocalRangeUpper(unsigned int skipLowerNBits, unsigned int compareNBits,
-			unsigned long* outCompEqual, unsigned long* outCompSmaller) const {
-	// all dimensions need to be compared where the upper right range is not already > current
-	unsigned long compareDimMask = currentContent.upperCompEqual | currentContent.upperCompSmaller;
-	pair<unsigned long, unsigned long> upperComp = MultiDimBitset<DIM>::compareSmallerEqual(
-			upperRightCorner_.values_, currentValue,
-			skipLowerNBits + compareNBits, skipLowerNBits,
-			compareDimMask);
-	(*outCompEqual) = upperComp.second;
-	(*outCompSmaller) = upperComp.first;
-}
-
-template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryIterator<DIM, WIDTH>::createCurrentContent(const Node<DIM>* nextNode,
-		unsigned long hcAddress, unsigned int prefixLength) {
+void RangeQueryIterator<DIM, WIDTH>::createCurrentContent(const Node<DIM>* nextNode, unsigned int prefixLength,
+		unsigned long lowerMask, unsigned long upperMask, bool fullyContained) {
+	assert (nextNode->getPrefixLength() == prefixLength);
+	assert ((lowerMask & upperMask) == lowerMask && upperMask <= highestAddress);
 
 	currentContent.node_ = nextNode;
 	currentContent.prefixLength_ = prefixLength;
-	assert (nextNode->getPrefixLength() == prefixLength);
-
-#ifndef NDEBUG
-	const unsigned int ignoreNLowestBits = DIM * (WIDTH - currentIndex_ - 1);
-	assert (ignoreNLowestBits >= 0 && ignoreNLowestBits <= WIDTH * DIM);
-	assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, ignoreNLowestBits + DIM, 0));
-	// validate that the node (with the prefix) is within the range
-	if (currentIndex_ > 0) {
-		pair<unsigned long, unsigned long> checkLowerComp = MultiDimBitset<DIM>::
-					compareSmallerEqual(lowerLeftCorner_.values_, currentValue, DIM * WIDTH, ignoreNLowestBits + DIM, highestAddress);
-		pair<unsigned long, unsigned long> checkUpperComp = MultiDimBitset<DIM>::
-					compareSmallerEqual(currentValue, upperRightCorner_.values_, DIM * WIDTH, ignoreNLowestBits + DIM, highestAddress);
-		assert (((checkLowerComp.first | checkLowerComp.second) == highestAddress) && "should be: lower left <= entry");
-		assert (((checkUpperComp.first | checkUpperComp.second) == highestAddress) && "should be: entry <= upper right");
-	}
-#endif
-
-	// msb       [interleaved format]          lsb
-	// <-filled-><DIM><DIM *|prefix|><DIM><-------- ignored --------->
-	// <----- already compared -----><loc>
-	// [ higher |last|current prefix|curr|     lower node bits       ]
-	// last: node currently descending from
-	// curr: node currently descending into
-	// loc:  do a local comparison of the current value and the previous
-	//       value (might be in prefix) with the proper range values
-
-	// calculate current local lower comparisons
-	unsigned long lowerCompEqualLocal = highestAddress;
-	unsigned long lowerCompSmallerLocal = 0;
-	if (!currentContent.fullyContained && !currentContent.lowerContained) {
-		// <-filled-><DIM><-------- ignored --------->
-		// [ higher |00000|     lower node bits      ]
-		const unsigned long prevLowerHC = (currentIndex_ == 0)? 0 : MultiDimBitset<DIM>::interleaveBits(lowerLeftCorner_.values_, currentIndex_ - 1, DIM * WIDTH);
-		const unsigned long lowerHC = MultiDimBitset<DIM>::interleaveBits(lowerLeftCorner_.values_, currentIndex_, DIM * WIDTH);
-		compareLocalLower(prevLowerHC, lowerHC, hcAddress, &lowerCompEqualLocal, &lowerCompSmallerLocal);
-	}
+	currentContent.lowerMask_ = lowerMask;
+	currentContent.upperMask_ = upperMask;
+	currentContent.fullyContained = fullyContained;
 
-	// combine lower local comparison with previous lower comparison
-	if (!currentContent.lowerContained) {
-		const unsigned long lastLowerCompEqual = currentContent.lowerCompEqual;
-		const unsigned long lastLowerCompSmaller = currentContent.lowerCompSmaller;
-		connectLocalToPrevLower(lastLowerCompEqual, lastLowerCompSmaller, lowerCompEqualLocal, lowerCompSmallerLocal,
-				&(currentContent.lowerCompEqual), &(currentContent.lowerCompSmaller));
-
-		// lower mask: for i=0 to DIM - 1 do
-		// 		lowerMask[i] = 0 <=> current value (in dimension i) is less or equal to the lower left corner (in dimension i)
-		currentContent.lowerMask_ =  highestAddress & (~(currentContent.lowerCompSmaller | currentContent.lowerCompEqual));
-		currentContent.lowerContained = (currentContent.lowerCompEqual == 0)
-				&& (currentContent.lowerCompSmaller == highestAddress);
-	}
-
-	// set the start iterator
-	if (currentContent.lowerContained) { // TODO or if the value is 0
+	// only addresses between the masks can be in the range
+	if (fullyContained) {
 		currentContent.startIt_ = nextNode->begin();
-	} else {
-		currentContent.startIt_ = nextNode->it(currentContent.lowerMask_);
-	}
-
-	// calculate current local upper comparisons
-	unsigned long upperCompEqualLocal = highestAddress;
-	unsigned long upperCompSmallerLocal = 0;
-	if (!currentContent.fullyContained && !currentContent.upperContained) {
-		// <-filled-><DIM><-------- ignored --------->
-		// [ higher |11111|     lower node bits      ]
-		const unsigned long prevUpperHC = (currentIndex_ == 0)? 0 : MultiDimBitset<DIM>::interleaveBits(upperRightCorner_.values_, currentIndex_ - 1, DIM * WIDTH);
-		const unsigned long upperHC = MultiDimBitset<DIM>::interleaveBits(upperRightCorner_.values_, currentIndex_, DIM * WIDTH);
-		compareLocalUpper(prevUpperHC, upperHC, hcAddress, &upperCompEqualLocal, &upperCompSmallerLocal);
-	}
-
-	// combine lower local comparison with previous lower comparison
-	if (!currentContent.upperContained) {
-		const unsigned long lastUpperCompEqual = currentContent.upperCompEqual;
-		const unsigned long lastUpperCompSmaller = currentContent.upperCompSmaller;
-		connectLocalToPrevUpper(lastUpperCompEqual, lastUpperCompSmaller, upperCompEqualLocal, upperCompSmallerLocal,
-				&(currentContent.upperCompEqual), &(currentContent.upperCompSmaller));
-
-		// upper mask: for i=0 to DIM - 1 do
-		// 		lowerMask[i] = 1 <=> current value (in dimension i) is higher or equal to upper right corner (in dimension i)
-		currentContent.upperMask_ = highestAddress & ((~currentContent.upperCompSmaller) | currentContent.upperCompEqual);
-		currentContent.upperContained = (currentContent.upperCompEqual == 0)
-				&& (currentContent.upperCompSmaller == 0);
-	}
-
-	// set the start iterator
-	if (currentContent.upperContained) { // TODO or if the value is highestAddress
 		currentContent.endIt_ = nextNode->end();
 	} else {
-		currentContent.endIt_ = nextNode->it(currentContent.upperMask_ + 1);
+		currentContent.startIt_ = nextNode->it(lowerMask);
+		currentContent.endIt_ = nextNode->it(upperMask + 1);
 	}
 
-	currentContent.fullyContained = currentContent.lowerMask_ == 0
-					&& currentContent.upperMask_ == highestAddress
-					&& currentContent.upperCompEqual == 0
-					&& currentContent.lowerCompEqual == 0;
-
-#ifndef NDEBUG
-	// validation:
-	// - are the local and connected values possible?
-	assert ((lowerCompEqualLocal & lowerCompSmallerLocal) == 0);
-	assert ((upperCompEqualLocal & upperCompSmallerLocal) == 0);
-	assert ((currentContent.lowerCompEqual & currentContent.lowerCompSmaller) == 0);
-	assert ((currentContent.upperCompEqual & currentContent.upperCompSmaller) == 0);
-
-	// - are the <= comparisons for the lower range correctly assembled?
-	pair<unsigned long, unsigned long> fullLowerComp = MultiDimBitset<DIM>::
-				compareSmallerEqual(lowerLeftCorner_.values_, currentValue, DIM * WIDTH, ignoreNLowestBits, highestAddress);
-	unsigned int fullLowerMask =  highestAddress & (~(fullLowerComp.first | fullLowerComp.second));
-	assert (fullLowerComp.first == currentContent.lowerCompSmaller && fullLowerComp.second == currentContent.lowerCompEqual);
-	assert (fullLowerMask == currentContent.lowerMask_);
-
-	// - are the <= comparisons for the upper range correctly assembled?
-	MultiDimBitset<DIM>::pushBackValue(highestAddress, currentValue, ignoreNLowestBits);
-	pair<unsigned long, unsigned long> fullUpperComp = MultiDimBitset<DIM>::
-			compareSmallerEqual(upperRightCorner_.values_, currentValue, DIM * WIDTH, ignoreNLowestBits, highestAddress);
-	MultiDimBitset<DIM>::clearValue(currentValue, ignoreNLowestBits);
-	assert (MultiDimBitset<DIM>::checkRangeUnset(currentValue, ignoreNLowestBits, 0));
-	unsigned int fullUpperMask = highestAddress & ((~fullUpperComp.first) | fullUpperComp.second);
-	assert (fullUpperComp.first == currentContent.upperCompSmaller && fullUpperComp.second == currentContent.upperCompEqual);
-	assert (fullUpperMask == currentContent.upperMask_);
-
-	// - do the mask values have the correct order and are the iterators correctly set?
-	assert (currentContent.lowerMask_ <= currentContent.upperMask_ && currentContent.upperMask_ < (1uL << DIM));
 	assert ((*currentContent.startIt_) <= (*currentContent.endIt_));
-	assert (currentContent.lowerMask_ <= currentContent.startIt_->getAddress());
-	assert (currentContent.upperMask_ < currentContent.endIt_->getAddress());
-
-	// - if the lower and upper range is contained than the node definitely fully contained
-	// notice that the inversion is not always tree
-	assert (!(currentContent.lowerContained && currentContent.upperContained) || currentContent.fullyContained);
-#endif
+	assert (fullyContained || currentContent.lowerMask_ <= currentContent.startIt_->getAddress());
+	assert (fullyContained || currentContent.upperMask_ < currentContent.endIt_->getAddress());
 }
 
 #endif /* SRC_ITERATORS_RANGEQUERYITERATOR_H_ */
@@ -18,20 +18,12 @@ template <unsigned int DIM>
 struct RangeQueryStackContent {
 public:
 	bool fullyContained;
-	bool lowerContained;
-	bool upperContained;
 
-	unsigned int lowerMask_;
-	unsigned int upperMask_;
+	unsigned long lowerMask_;
+	unsigned long upperMask_;
 
 	unsigned int prefixLength_;
 
-	unsigned long lowerCompEqual;
-	unsigned long lowerCompSmaller;
-
-	unsigned long upperCompEqual;
-	unsigned long upperCompSmaller;
-
 	const Node<DIM>* node_;
 	// TODO make iterators lokal
 	NodeIterator<DIM>* startIt_;
@@ -10,10 +10,12 @@
 
 #include "Entry.h"
 #include "PHTree.h"
+#include "DynamicPHTree.h"
 #include "util/PlotUtil.h"
 #include "util/rdtsc.h"
 #include "visitors/CountNodeTypesVisitor.h"
 #include "iterators/RangeQueryIterator.h"
+#include "iterators/KnnQueryIterator.h"
 
 using namespace std;
 
@@ -110,6 +112,28 @@ int mainSimpleExample() {
 	}
 	delete it;
 
+	cout << "The 3 nearest neighbours of (70,20) are:" << endl;
+	KnnQueryIterator<2, bitLength>* knnIt = phtree->knnQuery({70,20}, 3);
+	while (knnIt->hasNext()) {
+		Entry<2, bitLength> neighbour = knnIt->next();
+		cout << neighbour << " (distance: " << knnIt->getDistance() << ")" << endl;
+	}
+	delete knnIt;
+
+	sta = RDTSC();
+	assert (phtree->remove(e5).second == 5);
+	cout << "CPU cycles per remove: " << RDTSC() - sta << endl;
+	assert (!phtree->lookup(e5).first);
+	assert (phtree->remove(e3).second == 3);
+	assert (!phtree->remove(e3).first);
+	assert (phtree->lookup(e1).second == 1);
+	assert (phtree->lookup(e2).second == 2);
+	assert (phtree->lookup(e4).second == 4);
+	cout << *phtree;
+	visitor->reset();
+	phtree->accept(visitor);
+	cout << *visitor << endl;
+
 	delete visitor;
 	delete phtree;
 
@@ -277,6 +301,28 @@ int mainHyperCubeExample() {
 	return 0;
 }
 
+int mainDynamicExample() {
+	// every instantiated combination can be created, including the one with the longest prefixes
+	const vector<pair<unsigned int, unsigned int>> dimsAndWidths = {{2, 8}, {5, 20}, {16, 64}};
+	for (const auto& dimAndWidth : dimsAndWidths) {
+		DynamicPHTree* phtree = DynamicPHTree::create(dimAndWidth.first, dimAndWidth.second);
+		assert (phtree->dim() == dimAndWidth.first && phtree->width() == dimAndWidth.second);
+		const unsigned long maxValue = (dimAndWidth.second == 64)? -1uL : (1uL << dimAndWidth.second) - 1;
+		const vector<unsigned long> lower(dimAndWidth.first, 0);
+		const vector<unsigned long> upper(dimAndWidth.first, maxValue);
+		phtree->insert(lower, 1);
+		phtree->insert(upper, 2);
+		assert (phtree->lookup(lower).second == 1);
+		assert (phtree->lookup(upper).second == 2);
+		assert (phtree->rangeCount(lower, upper) == 2);
+		cout << "dynamic PH-Tree " << phtree->dim() << "D, " << phtree->width() << " bits stored in "
+				<< phtree->storedDim() << "D, " << phtree->storedWidth() << " bits" << endl;
+		delete phtree;
+	}
+
+	return 0;
+}
+
 int main(int argc, char* argv[]) {
 
 	string debug = "debug";
@@ -302,6 +348,8 @@ int main(int argc, char* argv[]) {
 		mainHyperCubeExample();
 		cout << endl;
 		mainBulkExample();
+		cout << endl;
+		mainDynamicExample();
 		return 0;
 	} else if (plot.compare(argv[1]) == 0) {
 		PlotUtil::plotAverageInsertTimePerDimension<3,64>("./random-extract.dat", false, false);
@@ -318,6 +366,9 @@ int main(int argc, char* argv[]) {
 
 //		PlotUtil::plotCompareToRTreeBulk<6,64>("./axons.dat", true);
 //		PlotUtil::plotCompareParallelTreeToScanQuery<6,64>("./axons.dat", "./ranges.dat", true);
+//		PlotUtil::plotParallelQueryScheduling<6,64>("./axons.dat", "./ranges.dat", true);
+//		PlotUtil::plotParallelBulkLoad<3,64>(1000000);
+//		PlotUtil::plotLookupBatch<6,64>(1000000);
 //		PlotUtil::plotParallelInsertPerformance<6,64>("/media/max/TOSHIBA/MA/data/ph-tree_workload/100K-axon-mbr-644000.txt", true);
 //		PlotUtil::plotParallelInsertPerformance<3,32>("./benchmark_Java-extract_1M_3D_32bit.dat", false);
 //		PlotUtil::plotInsertPerformanceDifferentOrder<6, 64>("./axons.dat", true);
@@ -327,6 +378,7 @@ int main(int argc, char* argv[]) {
 //		PlotUtil::plotAverageInsertTimePerNumberOfEntriesRandom();
 //		PlotUtil::plotRangeQueryTimePerPercentFilledRandom();
 //		PlotUtil::plotRangeQueryTimePerSelectivityRandom();
+//		PlotUtil::plotCompareRangeQueryIteratorsRandom();
 //		PlotUtil::plotAverageInsertTimePerNumberOfEntries<6, 64>("./axons.dat", true);
 		return 0;
 	} else if (rand.compare(argv[1]) == 0) {
@@ -38,10 +38,12 @@ public:
 	size_t getNumberOfContents() const override;
 	size_t getMaximumNumberOfContents() const override;
 	void lookup(unsigned long address, NodeAddressContent<DIM>& outContent, bool resolveSuffixIndex) const override;
+	void getContentArrays(NodeContentArrays<DIM>& outArrays) const override;
 	void insertAtAddress(unsigned long hcAddress, uintptr_t pointer) override;
 	void insertAtAddress(unsigned long hcAddress, unsigned long suffix, int id) override;
 	void insertAtAddress(unsigned long hcAddress, unsigned int suffixStartBlockIndex, int id) override;
 	void insertAtAddress(unsigned long hcAddress, const Node<DIM>* const subnode) override;
+	void removeAtAddress(unsigned long hcAddress) override;
 	Node<DIM>* adjustSize() override;
 
 protected:
@@ -70,6 +72,7 @@ private:
 #include "iterators/NodeIterator.h"
 #include "nodes/NodeAddressContent.h"
 #include "visitors/Visitor.h"
+#include "util/NodeTypeUtil.h"
 
 using namespace std;
 
@@ -196,6 +199,15 @@ void AHC<DIM, PREF_BLOCKS>::lookup(unsigned long address, NodeAddressContent<DIM
 	}
 }
 
+template <unsigned int DIM, unsigned int PREF_BLOCKS>
+void AHC<DIM, PREF_BLOCKS>::getContentArrays(NodeContentArrays<DIM>& outArrays) const {
+	outArrays.isAhc = true;
+	outArrays.addresses = NULL;
+	outArrays.references = references_;
+	outArrays.nReferences = 1uL << DIM;
+	this->fillPrefixAndSuffixArrays(outArrays);
+}
+
 template <unsigned int DIM, unsigned int PREF_BLOCKS>
 void AHC<DIM, PREF_BLOCKS>::insertAtAddress(unsigned long hcAddress, unsigned long  suffix, int id) {
 	assert (hcAddress < 1ul << DIM);
@@ -310,10 +322,23 @@ void AHC<DIM, PREF_BLOCKS>::insertAtAddress(unsigned long hcAddress, uintptr_t p
 	assert (((NodeAddressContent<DIM>)Node<DIM>::lookup(hcAddress, true)).specialPointer == pointer);
 }
 
+template <unsigned int DIM, unsigned int PREF_BLOCKS>
+void AHC<DIM, PREF_BLOCKS>::removeAtAddress(unsigned long hcAddress) {
+	assert (hcAddress < 1ul << DIM);
+	assert (references_[hcAddress] != 0 && "can only remove existing entries");
+	assert (nContents > 0);
+
+	// 00 & reference == 0 -> entry does not exist
+	references_[hcAddress] = 0;
+	--nContents;
+
+	assert (!((NodeAddressContent<DIM>)Node<DIM>::lookup(hcAddress, true)).exists);
+}
+
 template <unsigned int DIM, unsigned int PREF_BLOCKS>
 Node<DIM>* AHC<DIM, PREF_BLOCKS>::adjustSize() {
-	// TODO currently there is no need to switch from AHC to LHC because there is no delete function
-	return this;
+	// switch from AHC to LHC if removals reduced the load below the threshold
+	return NodeTypeUtil<DIM>::shrinkNodeIfPossible(this);
 }
 
 template <unsigned int DIM, unsigned int PREF_BLOCKS>
@@ -35,10 +35,12 @@ public:
 	size_t getNumberOfContents() const override;
 	size_t getMaximumNumberOfContents() const override;
 	void lookup(unsigned long address, NodeAddressContent<DIM>& outContent, bool resolveSuffixIndex) const override;
+	void getContentArrays(NodeContentArrays<DIM>& outArrays) const override;
 	void insertAtAddress(unsigned long hcAddress, uintptr_t pointer) override;
 	void insertAtAddress(unsigned long hcAddress, unsigned int suffixStartBlockIndex, int id) override;
 	void insertAtAddress(unsigned long hcAddress, unsigned long suffix, int id) override;
 	void insertAtAddress(unsigned long hcAddress, const Node<DIM>* const subnode) override;
+	void removeAtAddress(unsigned long hcAddress) override;
 	Node<DIM>* adjustSize() override;
 
 protected:
@@ -273,6 +275,15 @@ void LHC<DIM, PREF_BLOCKS, N>::lookup(unsigned long address, NodeAddressContent<
 	}
 }
 
+template <unsigned int DIM, unsigned int PREF_BLOCKS, unsigned int N>
+void LHC<DIM, PREF_BLOCKS, N>::getContentArrays(NodeContentArrays<DIM>& outArrays) const {
+	outArrays.isAhc = false;
+	outArrays.addresses = addresses_;
+	outArrays.references = references_;
+	outArrays.nReferences = m;
+	this->fillPrefixAndSuffixArrays(outArrays);
+}
+
 template <unsigned int DIM, unsigned int PREF_BLOCKS, unsigned int N>
 void LHC<DIM, PREF_BLOCKS, N>::addRow(unsigned int index, unsigned long newHcAddress,
 		uintptr_t newReference) {
@@ -423,12 +434,37 @@ void LHC<DIM, PREF_BLOCKS, N>::insertAtAddress(unsigned long hcAddress, const No
 #endif
 }
 
+template <unsigned int DIM, unsigned int PREF_BLOCKS, unsigned int N>
+void LHC<DIM, PREF_BLOCKS, N>::removeAtAddress(unsigned long hcAddress) {
+	assert (hcAddress < 1uL << DIM);
+
+	unsigned int index = m;
+	bool exists;
+	lookupAddress(hcAddress, &exists, &index);
+	assert (exists && "can only remove existing entries");
+	assert (index < m);
+
+	// move all contents after the given index one row up
+	unsigned long tmpAddress = 0;
+	for (unsigned i = index + 1; i < m; ++i) {
+		lookupIndex(i, &tmpAddress);
+		assert (tmpAddress > hcAddress);
+		references_[i - 1] = references_[i];
+		insertAddress(i - 1, tmpAddress);
+	}
+
+	--m;
+	references_[m] = 0;
+
+	assert (!((NodeAddressContent<DIM>)Node<DIM>::lookup(hcAddress, true)).exists);
+}
 
 template <unsigned int DIM, unsigned int PREF_BLOCKS, unsigned int N>
 Node<DIM>* LHC<DIM, PREF_BLOCKS, N>::adjustSize() {
 	// TODO put this method into insert method instead
 	if (m <= N) {
-		return this;
+		// the node might have become too large because of removals
+		return NodeTypeUtil<DIM>::shrinkNodeIfPossible(this);
 	} else {
 		return NodeTypeUtil<DIM>::copyIntoLargerNode(N + 1, this);
 	}
@@ -16,8 +16,12 @@
 #include "Entry.h"
 #include "iterators/NodeIterator.h"
 #include "nodes/NodeAddressContent.h"
+#include "nodes/NodeContentArrays.h"
 #include "util/MultiDimBitset.h"
+#include "util/NodeArena.h"
 #include <pthread.h>
+#include <atomic>
+#include <thread>
 
 template <unsigned int DIM>
 class Visitor;
@@ -38,11 +42,17 @@ class Node {
 public:
 
 	bool removed;
+	// parallel insertions (see DynamicNodeOperationsUtil::parallelBulkInsert) do not maintain the number of
+	// subtree entries of the nodes they pass but mark them so that only these are recounted afterwards
+	bool subtreeChanged;
 	unsigned int updateCounter;
 	pthread_rwlock_t rwLock = PTHREAD_RWLOCK_INITIALIZER;
 
 	Node();
 	virtual ~Node();
+	// nodes are placed in the arena of the tree (see NodeArena)
+	static void* operator new(size_t nBytes) { return NodeArena::allocate(nBytes); }
+	static void operator delete(void* block, size_t nBytes) { NodeArena::deallocate(block, nBytes); }
 	virtual std::ostream& output(std::ostream& os, size_t depth, size_t index, size_t totalBitLength) = 0;
 	virtual NodeIterator<DIM>* begin() const = 0;
 	virtual NodeIterator<DIM>* it(unsigned long hcAddress) const =0;
@@ -57,10 +67,12 @@ public:
 	virtual unsigned long* getPrefixStartBlock() =0;
 	virtual const unsigned long* getFixPrefixStartBlock() const =0;
 	virtual void lookup(unsigned long address, NodeAddressContent<DIM>& outContent, bool resolveSuffixIndex) const = 0;
+	virtual void getContentArrays(NodeContentArrays<DIM>& outArrays) const = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, uintptr_t pointer) =0;
 	virtual void insertAtAddress(unsigned long hcAddress, unsigned int suffixStartBlockIndex, int id) = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, unsigned long suffix, int id) = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, const Node<DIM>* const subnode) = 0;
+	virtual void removeAtAddress(unsigned long hcAddress) = 0;
 	virtual Node<DIM>* adjustSize() = 0;
 	virtual bool canStoreSuffixInternally(size_t nSuffixBits) const =0;
 	virtual unsigned int canStoreSuffix(size_t nSuffixBits) const =0;
@@ -76,12 +88,36 @@ public:
 	// attention: linear checks! should be used for validation only
 	bool containsId(int id) const;
 	size_t getNStoredSuffixes() const;
+	// number of entries stored in this node and all of its subnodes
+	size_t getNumberOfSubtreeEntries() const;
+	void setNumberOfSubtreeEntries(size_t nEntries);
+	void incrementSubtreeEntries();
+	void decrementSubtreeEntries();
+
+	// seqlock style version for optimistic readers (see SpatialSelectionOperationsUtil::optimisticLookup):
+	// returns the current version once no writer changes the node
+	unsigned long readVersion() const;
+	// true if the node did not change since the version was read
+	bool validateVersion(unsigned long version) const;
+	// only one writer at a time may change a node between these calls
+	void beginWrite();
+	void endWrite();
+	// the node was replaced and will be deleted: readers have to restart at the root
+	void markObsolete();
+	static bool isObsolete(unsigned long version);
+
+private:
+	// the lowest bit of the version is set while a writer changes the node and this one once it was replaced
+	static const unsigned long obsoleteVersionFlag = 1uL << 63;
+
+	size_t nSubtreeEntries_;
+	std::atomic<unsigned long> version_;
 };
 
 using namespace std;
 
 template <unsigned int DIM>
-Node<DIM>::Node() : removed(false), updateCounter(0) {
+Node<DIM>::Node() : removed(false), subtreeChanged(false), updateCounter(0), nSubtreeEntries_(0), version_(0) {
 //	pthread_rwlock_init(&rwLock, NULL);
 }
 
@@ -134,4 +170,67 @@ size_t Node<DIM>::getNStoredSuffixes() const {
 	}
 }
 
+template <unsigned int DIM>
+size_t Node<DIM>::getNumberOfSubtreeEntries() const {
+	return nSubtreeEntries_;
+}
+
+template <unsigned int DIM>
+void Node<DIM>::setNumberOfSubtreeEntries(size_t nEntries) {
+	nSubtreeEntries_ = nEntries;
+}
+
+template <unsigned int DIM>
+void Node<DIM>::incrementSubtreeEntries() {
+	++nSubtreeEntries_;
+}
+
+template <unsigned int DIM>
+void Node<DIM>::decrementSubtreeEntries() {
+	assert (nSubtreeEntries_ > 0);
+	--nSubtreeEntries_;
+}
+
+template <unsigned int DIM>
+unsigned long Node<DIM>::readVersion() const {
+	unsigned long version = version_.load(memory_order_acquire);
+	while (version & 1uL) {
+		this_thread::yield();
+		version = version_.load(memory_order_acquire);
+	}
+
+	return version;
+}
+
+template <unsigned int DIM>
+bool Node<DIM>::validateVersion(unsigned long version) const {
+	// all reads of the node happen before the version is compared
+	atomic_thread_fence(memory_order_acquire);
+	return version_.load(memory_order_relaxed) == version;
+}
+
+template <unsigned int DIM>
+void Node<DIM>::beginWrite() {
+	assert (!(version_.load(memory_order_relaxed) & 1uL) && "writes must not be nested");
+	version_.fetch_add(1uL, memory_order_relaxed);
+	// readers see the odd version before any of the changes
+	atomic_thread_fence(memory_order_release);
+}
+
+template <unsigned int DIM>
+void Node<DIM>::endWrite() {
+	assert (version_.load(memory_order_relaxed) & 1uL);
+	version_.fetch_add(1uL, memory_order_release);
+}
+
+template <unsigned int DIM>
+void Node<DIM>::markObsolete() {
+	version_.fetch_or(obsoleteVersionFlag, memory_order_release);
+}
+
+template <unsigned int DIM>
+bool Node<DIM>::isObsolete(unsigned long version) {
+	return version & obsoleteVersionFlag;
+}
+
 #endif /* SRC_NODE_H_ */
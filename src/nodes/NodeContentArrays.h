@@ -0,0 +1,32 @@
+/*
+ * NodeContentArrays.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_NODES_NODECONTENTARRAYS_H_
+#define SRC_NODES_NODECONTENTARRAYS_H_
+
+#include <cstdint>
+#include <stddef.h>
+
+// raw view on the arrays of a node so that iterators can walk the contents
+// without allocating node iterators and without a virtual call per address
+template <unsigned int DIM>
+struct NodeContentArrays {
+	// AHC: the references are indexed by the HC address
+	// LHC: the HC addresses of the filled rows are packed in ascending order (DIM bits each)
+	bool isAhc;
+	const unsigned long* addresses;
+	// flagged references as stored by LHC and AHC
+	const std::uintptr_t* references;
+	// AHC: 2^DIM, LHC: number of filled rows
+	unsigned long nReferences;
+	// start of the suffix storage which suffix indices refer to (NULL if there is none)
+	const unsigned long* suffixStartBlock;
+	const unsigned long* prefixStartBlock;
+	size_t prefixLength;
+};
+
+#endif /* SRC_NODES_NODECONTENTARRAYS_H_ */
@@ -44,10 +44,12 @@ public:
 	virtual size_t getNumberOfContents() const = 0;
 	virtual size_t getMaximumNumberOfContents() const = 0;
 	virtual void lookup(unsigned long address, NodeAddressContent<DIM>& outContent, bool resolveSuffixIndex) const = 0;
+	virtual void getContentArrays(NodeContentArrays<DIM>& outArrays) const = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, uintptr_t pointer) =0;
 	virtual void insertAtAddress(unsigned long hcAddress, unsigned int suffixStartBlockIndex, int id) = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, unsigned long startSuffixBlock, int id) = 0;
 	virtual void insertAtAddress(unsigned long hcAddress, const Node<DIM>* const subnode) = 0;
+	virtual void removeAtAddress(unsigned long hcAddress) = 0;
 	virtual Node<DIM>* adjustSize() = 0;
 
 	size_t getMaxPrefixLength() const override;
@@ -71,6 +73,8 @@ protected:
 
 	TSuffixStorage* getChangeableSuffixStorage() const override;
 	virtual string getName() const =0;
+	// sets the prefix and suffix storage part of the arrays
+	void fillPrefixAndSuffixArrays(NodeContentArrays<DIM>& outArrays) const;
 };
 
 #include <assert.h>
@@ -179,6 +183,15 @@ std::pair<unsigned long*, unsigned int> TNode<DIM, PREF_BLOCKS>::reserveSuffixSp
 	return suffixes_->reserveBits(nSuffixBits);
 }
 
+template <unsigned int DIM, unsigned int PREF_BLOCKS>
+void TNode<DIM, PREF_BLOCKS>::fillPrefixAndSuffixArrays(NodeContentArrays<DIM>& outArrays) const {
+	outArrays.prefixStartBlock = prefix_;
+	outArrays.prefixLength = prefixBits_ / DIM;
+	// read the storage once: optimistic readers call this while a writer might replace it
+	const TSuffixStorage* suffixes = __atomic_load_n(&suffixes_, __ATOMIC_RELAXED);
+	outArrays.suffixStartBlock = (suffixes)? suffixes->getPointerFromIndex(0) : NULL;
+}
+
 template <unsigned int DIM, unsigned int PREF_BLOCKS>
 unsigned long* TNode<DIM, PREF_BLOCKS>::getSuffixStartBlockPointerFromIndex(unsigned int index) const {
 	assert (suffixes_);
@@ -8,6 +8,8 @@
 #ifndef SRC_NODES_TSUFFIXSTORAGE_H_
 #define SRC_NODES_TSUFFIXSTORAGE_H_
 
+#include "util/NodeArena.h"
+
 template <unsigned int DIM>
 class SizeVisitor;
 
@@ -17,6 +19,9 @@ class TSuffixStorage {
 public:
 	TSuffixStorage() {};
 	virtual ~TSuffixStorage() {};
+	// suffix storages are placed in the arena of the tree (see NodeArena)
+	static void* operator new(size_t nBytes) { return NodeArena::allocate(nBytes); }
+	static void operator delete(void* block, size_t nBytes) { NodeArena::deallocate(block, nBytes); }
 	virtual bool canStoreBits(size_t nBitsToStore) const =0;
 	virtual unsigned int getTotalBlocksToStoreAdditionalSuffix(size_t nSuffixBits) const =0;
 	// override the given index blocks with the last index blocks
@@ -0,0 +1,528 @@
+/*
+ * BulkLoadUtil.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_BULKLOADUTIL_H_
+#define SRC_UTIL_BULKLOADUTIL_H_
+
+#include <vector>
+#include "Entry.h"
+#include "util/ThreadPool.h"
+
+template <unsigned int DIM>
+class Node;
+template <typename Task>
+class WorkStealingExecutor;
+
+// Builds a whole tree from a batch of entries instead of inserting them one by one. The entries
+// are sorted in Z-order (by their interleaved bits) so that every node is a contiguous range of
+// entries whose common prefix is the one of its first and last entry. Every node is therefore
+// created exactly once with its final number of contents and suffixes, i.e. without enlarging
+// nodes or suffix storages while the tree grows.
+// The parallel version partitions the entries with a radix sort on their highest bits below the
+// common prefix of all entries. Buckets with more than a thread's share of the entries (e.g. of
+// clustered data) are partitioned again by their next bits. The subtrees below the addresses of
+// the highest node are then independent and built by different threads without any locks. Large
+// subtrees are split at their own nodes first so that no single thread builds most of the tree.
+template <unsigned int DIM, unsigned int WIDTH>
+class BulkLoadUtil {
+public:
+	// sorts the entries in Z-order and removes all but the first of the entries with equal values
+	// (as inserting them one by one would)
+	static void sortAndRemoveDuplicates(std::vector<Entry<DIM, WIDTH>>& entries);
+	// builds the root node of a tree from entries that are sorted and unique
+	static Node<DIM>* build(const std::vector<Entry<DIM, WIDTH>>& sortedEntries);
+	// builds the root node of a tree from unsorted entries with all threads of the pool
+	// (the entries are sorted and all but the first of the entries with equal values are removed)
+	static Node<DIM>* parallelBuild(std::vector<Entry<DIM, WIDTH>>& entries, ThreadPool& threads);
+
+private:
+	static const unsigned int nBlocks = 1 + (DIM * WIDTH - 1) / (8 * sizeof (unsigned long));
+	// the radix sort uses at most 2^maxRadixBits buckets
+	static const unsigned int maxRadixBits = 12;
+	// the subtrees are built in about this many tasks per thread
+	static const size_t tasksPerThread = 4;
+
+	// the content of a node at one address: a subnode or the suffix of a single entry
+	struct Slot {
+		unsigned long hcAddress;
+		const Entry<DIM, WIDTH>* entry;
+		Node<DIM>* subnode;
+	};
+
+	// the indices [begin, end) of entries or of groups of entries
+	struct Range {
+		size_t begin;
+		size_t end;
+	};
+
+	// true if the first entry comes before the second one in Z-order
+	static inline bool zOrderLess(const Entry<DIM, WIDTH>& e1, const Entry<DIM, WIDTH>& e2);
+	// the first level (from the most significant bit) at which the values of the two entries differ
+	static inline size_t firstDifferentLevel(const Entry<DIM, WIDTH>& e1, const Entry<DIM, WIDTH>& e2);
+	// the nBits interleaved bits of the entry that start at the given level
+	static inline unsigned long radixKey(const Entry<DIM, WIDTH>& entry, size_t index, unsigned int nBits);
+	// builds the node for the entries [begin, end) that is stored below the given level of its parent
+	// (uses the end of the slots as a stack and leaves them unchanged)
+	static Node<DIM>* buildSubtree(const Entry<DIM, WIDTH>* begin, const Entry<DIM, WIDTH>* end,
+			size_t index, std::vector<Slot>& slots);
+	// appends a slot for every address of the entries [begin, end) at the level
+	static void appendSlots(const Entry<DIM, WIDTH>* begin, const Entry<DIM, WIDTH>* end,
+			size_t currentIndex, std::vector<Slot>& slots);
+	// creates a node with the prefix of the entry between the two levels and the sorted slots as its contents
+	static Node<DIM>* buildNode(const Slot* slots, size_t nSlots, size_t index, size_t currentIndex,
+			const Entry<DIM, WIDTH>& prefixEntry, size_t nEntries);
+	// builds the root node for the slots of the node at the given level (which is the root if it is 0)
+	static Node<DIM>* buildRoot(const std::vector<Slot>& slots, size_t currentIndex,
+			const Entry<DIM, WIDTH>& prefixEntry, size_t nEntries);
+	// stores all bits of the entry below the node's address level as a suffix
+	static inline void insertSuffix(size_t currentIndex, unsigned long hcAddress,
+			const Entry<DIM, WIDTH>& entry, Node<DIM>* node);
+	// sorts the entries of the range or, if it has more than maxEntries entries, partitions them by the
+	// next bits below the level that they all share and pushes the parts as new tasks
+	static void sortOrPartition(size_t threadIndex, const Range& range, size_t maxEntries,
+			std::vector<Entry<DIM, WIDTH>>& entries, WorkStealingExecutor<Range>& executor);
+	// same as appendSlots but the subtrees are built by the threads of the pool in tasks of about
+	// maxTaskEntries entries (larger subtrees are split at their own nodes on the calling thread)
+	static void parallelAppendSlots(const Entry<DIM, WIDTH>* begin, const Entry<DIM, WIDTH>* end,
+			size_t currentIndex, size_t maxTaskEntries, std::vector<Slot>& slots, ThreadPool& threads);
+	// runs process(size_t threadIndex, const Task& task) for all tasks with the threads of the pool
+	// (the tasks can push new tasks to the executor)
+	template <typename Task, typename Processor>
+	static void runTasks(const std::vector<Task>& tasks, ThreadPool& threads, Processor& process,
+			WorkStealingExecutor<Task>& executor);
+};
+
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include "nodes/Node.h"
+#include "util/MultiDimBitset.h"
+#include "util/NodeArena.h"
+#include "util/NodeTypeUtil.h"
+#include "util/WorkStealingExecutor.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool BulkLoadUtil<DIM, WIDTH>::zOrderLess(const Entry<DIM, WIDTH>& e1, const Entry<DIM, WIDTH>& e2) {
+	// the most significant bits are stored in the highest block
+	for (unsigned int b = nBlocks; b > 0; --b) {
+		if (e1.values_[b - 1] != e2.values_[b - 1]) {
+			return e1.values_[b - 1] < e2.values_[b - 1];
+		}
+	}
+
+	return false;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t BulkLoadUtil<DIM, WIDTH>::firstDifferentLevel(const Entry<DIM, WIDTH>& e1, const Entry<DIM, WIDTH>& e2) {
+	for (unsigned int b = nBlocks; b > 0; --b) {
+		const unsigned long diff = e1.values_[b - 1] ^ e2.values_[b - 1];
+		if (diff != 0) {
+			const size_t highestDifferentBit = (b - 1) * 8 * sizeof (unsigned long) + 63 - __builtin_clzl(diff);
+			assert (highestDifferentBit < DIM * WIDTH);
+			return (DIM * WIDTH - 1 - highestDifferentBit) / DIM;
+		}
+	}
+
+	return WIDTH;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned long BulkLoadUtil<DIM, WIDTH>::radixKey(const Entry<DIM, WIDTH>& entry, size_t index, unsigned int nBits) {
+	const size_t bitsPerBlock = 8 * sizeof (unsigned long);
+	assert (0 < nBits && nBits < bitsPerBlock && nBits <= DIM * (WIDTH - index));
+	const size_t lowestBit = DIM * (WIDTH - index) - nBits;
+	const size_t block = lowestBit / bitsPerBlock;
+	const size_t offset = lowestBit % bitsPerBlock;
+	unsigned long key = entry.values_[block] >> offset;
+	if (offset + nBits > bitsPerBlock) {
+		key |= entry.values_[block + 1] << (bitsPerBlock - offset);
+	}
+
+	return key & ((1uL << nBits) - 1);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void BulkLoadUtil<DIM, WIDTH>::sortAndRemoveDuplicates(vector<Entry<DIM, WIDTH>>& entries) {
+	// a stable sort keeps the entry that would have been inserted first
+	stable_sort(entries.begin(), entries.end(), zOrderLess);
+	auto newEnd = unique(entries.begin(), entries.end(),
+			[] (const Entry<DIM, WIDTH>& e1, const Entry<DIM, WIDTH>& e2) {
+		return firstDifferentLevel(e1, e2) == WIDTH;
+	});
+	entries.erase(newEnd, entries.end());
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* BulkLoadUtil<DIM, WIDTH>::build(const vector<Entry<DIM, WIDTH>>& sortedEntries) {
+	assert (!sortedEntries.empty());
+	const Entry<DIM, WIDTH>* begin = sortedEntries.data();
+	const Entry<DIM, WIDTH>* end = begin + sortedEntries.size();
+	const size_t currentIndex = (sortedEntries.size() == 1)? 0 : firstDifferentLevel(*begin, *(end - 1));
+	vector<Slot> slots;
+	appendSlots(begin, end, currentIndex, slots);
+	return buildRoot(slots, currentIndex, *begin, sortedEntries.size());
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* BulkLoadUtil<DIM, WIDTH>::buildRoot(const vector<Slot>& slots, size_t currentIndex,
+		const Entry<DIM, WIDTH>& prefixEntry, size_t nEntries) {
+	if (currentIndex == 0) {
+		return buildNode(slots.data(), slots.size(), 0, 0, prefixEntry, nEntries);
+	}
+
+	// the root never has a prefix so that all entries are below one of its addresses
+	Slot rootSlot;
+	rootSlot.hcAddress = MultiDimBitset<DIM>::interleaveBits(prefixEntry.values_, 0, DIM * WIDTH);
+	rootSlot.entry = NULL;
+	rootSlot.subnode = buildNode(slots.data(), slots.size(), 1, currentIndex, prefixEntry, nEntries);
+	return buildNode(&rootSlot, 1, 0, 0, prefixEntry, nEntries);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void BulkLoadUtil<DIM, WIDTH>::appendSlots(const Entry<DIM, WIDTH>* begin,
+		const Entry<DIM, WIDTH>* end, size_t currentIndex, vector<Slot>& slots) {
+	// the entries with the same address are consecutive and visited in ascending address order
+	for (const Entry<DIM, WIDTH>* groupStart = begin; groupStart != end;) {
+		const Entry<DIM, WIDTH>* groupEnd = groupStart + 1;
+		while (groupEnd != end && firstDifferentLevel(*groupStart, *groupEnd) > currentIndex) {
+			++groupEnd;
+		}
+
+		Slot slot;
+		slot.hcAddress = MultiDimBitset<DIM>::interleaveBits(groupStart->values_, currentIndex, DIM * WIDTH);
+		if (groupEnd - groupStart == 1) {
+			slot.entry = groupStart;
+			slot.subnode = NULL;
+		} else {
+			slot.entry = NULL;
+			slot.subnode = buildSubtree(groupStart, groupEnd, currentIndex + 1, slots);
+		}
+
+		slots.push_back(slot);
+		groupStart = groupEnd;
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* BulkLoadUtil<DIM, WIDTH>::buildSubtree(const Entry<DIM, WIDTH>* begin,
+		const Entry<DIM, WIDTH>* end, size_t index, vector<Slot>& slots) {
+	assert (end - begin > 1 && index < WIDTH);
+	// the entries are sorted so that the first and the last one share the shortest prefix
+	const size_t currentIndex = firstDifferentLevel(*begin, *(end - 1));
+	assert (currentIndex >= index && currentIndex < WIDTH);
+	const size_t firstSlot = slots.size();
+	appendSlots(begin, end, currentIndex, slots);
+	Node<DIM>* node = buildNode(slots.data() + firstSlot, slots.size() - firstSlot,
+			index, currentIndex, *begin, end - begin);
+	slots.resize(firstSlot);
+	return node;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* BulkLoadUtil<DIM, WIDTH>::buildNode(const Slot* slots, size_t nSlots,
+		size_t index, size_t currentIndex, const Entry<DIM, WIDTH>& prefixEntry, size_t nEntries) {
+	assert (nSlots > 0 && index <= currentIndex);
+	size_t nSuffixes = 0;
+	for (size_t i = 0; i < nSlots; ++i) {
+		if (slots[i].entry) {
+			++nSuffixes;
+		}
+	}
+
+	const size_t prefixLength = currentIndex - index;
+	const size_t suffixBits = DIM * (WIDTH - (currentIndex + 1));
+	Node<DIM>* node = NodeTypeUtil<DIM>::template buildNodeWithSuffixes<WIDTH>(
+			prefixLength * DIM, nSlots, nSuffixes, suffixBits);
+
+	if (prefixLength > 0) {
+		// cut off the bits above the prefix first so that only the prefix is copied
+		unsigned long prefixTmp[nBlocks] = {};
+		if (index > 0) {
+			MultiDimBitset<DIM>::removeHighestBits(prefixEntry.values_, DIM * WIDTH, index, prefixTmp);
+		} else {
+			copy(prefixEntry.values_, prefixEntry.values_ + nBlocks, prefixTmp);
+		}
+		MultiDimBitset<DIM>::duplicateHighestBits(prefixTmp, DIM * (WIDTH - index),
+				prefixLength, node->getPrefixStartBlock());
+	}
+
+	// the addresses are ascending which appends to linear nodes
+	for (size_t i = 0; i < nSlots; ++i) {
+		if (slots[i].entry) {
+			insertSuffix(currentIndex, slots[i].hcAddress, *slots[i].entry, node);
+		} else {
+			node->insertAtAddress(slots[i].hcAddress, slots[i].subnode);
+		}
+	}
+
+	node->setNumberOfSubtreeEntries(nEntries);
+	return node;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void BulkLoadUtil<DIM, WIDTH>::insertSuffix(size_t currentIndex, unsigned long hcAddress,
+		const Entry<DIM, WIDTH>& entry, Node<DIM>* node) {
+	// same as DynamicNodeOperationsUtil::insertSuffix but the node is large enough already
+	const size_t suffixBits = DIM * (WIDTH - (currentIndex + 1));
+	if (node->canStoreSuffixInternally(suffixBits)) {
+		unsigned long suffix = 0uL;
+		MultiDimBitset<DIM>::removeHighestBits(entry.values_, DIM * WIDTH, currentIndex + 1, &suffix);
+		node->insertAtAddress(hcAddress, suffix, entry.id_);
+	} else {
+		assert (node->canStoreSuffix(suffixBits) == 0);
+		const pair<unsigned long*, unsigned int> suffixStartBlock = node->reserveSuffixSpace(suffixBits);
+		node->insertAtAddress(hcAddress, suffixStartBlock.second, entry.id_);
+		MultiDimBitset<DIM>::removeHighestBits(entry.values_, DIM * WIDTH, currentIndex + 1, suffixStartBlock.first);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Task, typename Processor>
+void BulkLoadUtil<DIM, WIDTH>::runTasks(const vector<Task>& tasks, ThreadPool& threads, Processor& process,
+		WorkStealingExecutor<Task>& executor) {
+	// every thread starts with a contiguous range of tasks and idle threads steal the others
+	const size_t nThreads = threads.nThreads();
+	const size_t nTasks = tasks.size();
+	const size_t tasksPerQueue = 1 + nTasks / nThreads;
+	for (size_t threadIndex = 0; threadIndex < nThreads; ++threadIndex) {
+		const size_t start = min(tasksPerQueue * threadIndex, nTasks);
+		const size_t end = min(tasksPerQueue * (threadIndex + 1), nTasks);
+		for (size_t task = end; task > start; --task) {
+			executor.push(threadIndex, tasks[task - 1]);
+		}
+	}
+
+	executor.run(process, threads);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void BulkLoadUtil<DIM, WIDTH>::sortOrPartition(size_t threadIndex, const Range& range, size_t maxEntries,
+		vector<Entry<DIM, WIDTH>>& entries, WorkStealingExecutor<Range>& executor) {
+	Entry<DIM, WIDTH>* begin = entries.data() + range.begin;
+	Entry<DIM, WIDTH>* end = entries.data() + range.end;
+	if (range.end - range.begin <= maxEntries) {
+		stable_sort(begin, end, zOrderLess);
+		return;
+	}
+
+	size_t currentIndex = WIDTH;
+	for (const Entry<DIM, WIDTH>* entry = begin + 1; entry != end; ++entry) {
+		currentIndex = min(currentIndex, firstDifferentLevel(*begin, *entry));
+	}
+	if (currentIndex == WIDTH) {
+		// all entries are equal and stay in the order they were given in
+		return;
+	}
+
+	const unsigned int radixBits = min(size_t(maxRadixBits), DIM * (WIDTH - currentIndex));
+	const size_t nBuckets = 1uL << radixBits;
+	vector<size_t> bucketStarts(nBuckets + 1, 0);
+	for (const Entry<DIM, WIDTH>* entry = begin; entry != end; ++entry) {
+		++bucketStarts[radixKey(*entry, currentIndex, radixBits) + 1];
+	}
+	partial_sum(bucketStarts.begin(), bucketStarts.end(), bucketStarts.begin());
+	for (size_t bucket = 0; bucket < nBuckets; ++bucket) {
+		if (bucketStarts[bucket + 1] - bucketStarts[bucket] == range.end - range.begin) {
+			// with many dimensions the entries can differ in bits of the level below the key
+			stable_sort(begin, end, zOrderLess);
+			return;
+		}
+	}
+
+	// the order of equal keys is kept
+	vector<Entry<DIM, WIDTH>> partitioned(range.end - range.begin);
+	vector<size_t> positions(bucketStarts.begin(), bucketStarts.end() - 1);
+	for (const Entry<DIM, WIDTH>* entry = begin; entry != end; ++entry) {
+		partitioned[positions[radixKey(*entry, currentIndex, radixBits)]++] = *entry;
+	}
+	copy(partitioned.begin(), partitioned.end(), begin);
+
+	for (size_t bucket = nBuckets; bucket > 0; --bucket) {
+		if (bucketStarts[bucket] - bucketStarts[bucket - 1] > 1) {
+			executor.push(threadIndex, Range{range.begin + bucketStarts[bucket - 1], range.begin + bucketStarts[bucket]});
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void BulkLoadUtil<DIM, WIDTH>::parallelAppendSlots(const Entry<DIM, WIDTH>* begin,
+		const Entry<DIM, WIDTH>* end, size_t currentIndex, size_t maxTaskEntries, vector<Slot>& slots,
+		ThreadPool& threads) {
+	// the entries with the same address are consecutive so that the end of each group can be searched
+	vector<Range> groups;
+	for (const Entry<DIM, WIDTH>* groupStart = begin; groupStart != end;) {
+		const Entry<DIM, WIDTH>* groupEnd = partition_point(groupStart + 1, end,
+				[groupStart, currentIndex] (const Entry<DIM, WIDTH>& entry) {
+			return firstDifferentLevel(*groupStart, entry) > currentIndex;
+		});
+		groups.push_back(Range{size_t(groupStart - begin), size_t(groupEnd - begin)});
+		groupStart = groupEnd;
+	}
+
+	// consecutive small groups are built by one task and large ones are split
+	const size_t firstSlot = slots.size();
+	slots.resize(firstSlot + groups.size());
+	vector<Range> tasks;
+	size_t nTaskEntries = 0;
+	for (size_t group = 0; group < groups.size(); ++group) {
+		const Entry<DIM, WIDTH>* groupStart = begin + groups[group].begin;
+		const Entry<DIM, WIDTH>* groupEnd = begin + groups[group].end;
+		const size_t nGroupEntries = groupEnd - groupStart;
+		Slot& slot = slots[firstSlot + group];
+		slot.hcAddress = MultiDimBitset<DIM>::interleaveBits(groupStart->values_, currentIndex, DIM * WIDTH);
+		slot.entry = (nGroupEntries == 1)? groupStart : NULL;
+		slot.subnode = NULL;
+		if (nGroupEntries <= maxTaskEntries) {
+			if (tasks.empty() || nTaskEntries + nGroupEntries > maxTaskEntries) {
+				tasks.push_back(Range{group, group});
+				nTaskEntries = 0;
+			}
+
+			++tasks.back().end;
+			nTaskEntries += nGroupEntries;
+		} else {
+			const size_t subnodeIndex = firstDifferentLevel(*groupStart, *(groupEnd - 1));
+			vector<Slot> subnodeSlots;
+			parallelAppendSlots(groupStart, groupEnd, subnodeIndex, maxTaskEntries, subnodeSlots, threads);
+			slot.subnode = buildNode(subnodeSlots.data(), subnodeSlots.size(),
+					currentIndex + 1, subnodeIndex, *groupStart, nGroupEntries);
+		}
+	}
+
+	NodeArena* arena = NodeArena::current();
+	auto buildGroups = [begin, &groups, &slots, firstSlot, arena, currentIndex] (size_t, const Range& task) {
+		NodeArenaScope arenaScope(arena);
+		NodeArenaThreadCache arenaCache(arena);
+		vector<Slot> stack;
+		for (size_t group = task.begin; group < task.end; ++group) {
+			if (!slots[firstSlot + group].entry) {
+				slots[firstSlot + group].subnode = buildSubtree(begin + groups[group].begin,
+						begin + groups[group].end, currentIndex + 1, stack);
+			}
+		}
+	};
+	WorkStealingExecutor<Range> executor(threads.nThreads());
+	runTasks(tasks, threads, buildGroups, executor);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* BulkLoadUtil<DIM, WIDTH>::parallelBuild(vector<Entry<DIM, WIDTH>>& entries, ThreadPool& threads) {
+	assert (!entries.empty());
+	const size_t nThreads = threads.nThreads();
+	const size_t nEntries = entries.size();
+	auto threadStart = [nEntries, nThreads] (size_t threadIndex) {
+		return threadIndex * nEntries / nThreads;
+	};
+
+	// 1. the levels that all entries share are the prefix of the highest node
+	vector<size_t> threadCurrentIndex(nThreads, WIDTH);
+	auto findCommonPrefix = [&entries, &threadCurrentIndex, &threadStart] (size_t threadIndex) {
+		size_t currentIndex = WIDTH;
+		for (size_t i = threadStart(threadIndex); i < threadStart(threadIndex + 1); ++i) {
+			currentIndex = min(currentIndex, firstDifferentLevel(entries[0], entries[i]));
+		}
+		threadCurrentIndex[threadIndex] = currentIndex;
+	};
+	threads.run(findCommonPrefix);
+	const size_t currentIndex = *min_element(threadCurrentIndex.begin(), threadCurrentIndex.end());
+	if (currentIndex == WIDTH) {
+		// all entries are equal
+		entries.resize(1);
+		return build(entries);
+	}
+
+	// 2. count the entries per bucket of the highest bits below the prefix for every thread
+	const unsigned int radixBits = min(size_t(maxRadixBits), DIM * (WIDTH - currentIndex));
+	const size_t nBuckets = 1uL << radixBits;
+	vector<vector<size_t>> bucketCounts(nThreads, vector<size_t>(nBuckets, 0));
+	auto countBuckets = [&entries, &bucketCounts, &threadStart, currentIndex, radixBits] (size_t threadIndex) {
+		vector<size_t>& counts = bucketCounts[threadIndex];
+		for (size_t i = threadStart(threadIndex); i < threadStart(threadIndex + 1); ++i) {
+			++counts[radixKey(entries[i], currentIndex, radixBits)];
+		}
+	};
+	threads.run(countBuckets);
+
+	// 3. scatter the entries into their buckets (the order of equal keys is kept)
+	vector<size_t> bucketStarts(nBuckets + 1, 0);
+	size_t position = 0;
+	for (size_t bucket = 0; bucket < nBuckets; ++bucket) {
+		bucketStarts[bucket] = position;
+		for (size_t threadIndex = 0; threadIndex < nThreads; ++threadIndex) {
+			const size_t count = bucketCounts[threadIndex][bucket];
+			// the count becomes the position of the thread's next entry in the bucket
+			bucketCounts[threadIndex][bucket] = position;
+			position += count;
+		}
+	}
+	bucketStarts[nBuckets] = position;
+
+	vector<Entry<DIM, WIDTH>> sortedEntries(nEntries);
+	auto scatter = [&entries, &sortedEntries, &bucketCounts, &threadStart, currentIndex, radixBits] (size_t threadIndex) {
+		vector<size_t>& positions = bucketCounts[threadIndex];
+		for (size_t i = threadStart(threadIndex); i < threadStart(threadIndex + 1); ++i) {
+			sortedEntries[positions[radixKey(entries[i], currentIndex, radixBits)]++] = entries[i];
+		}
+	};
+	threads.run(scatter);
+	entries.swap(sortedEntries);
+	vector<Entry<DIM, WIDTH>>().swap(sortedEntries);
+
+	// 4. sort the buckets (a thread's share of the entries is sorted by one task at most)
+	vector<Range> buckets;
+	for (size_t bucket = 0; bucket < nBuckets; ++bucket) {
+		if (bucketStarts[bucket + 1] - bucketStarts[bucket] > 1) {
+			buckets.push_back(Range{bucketStarts[bucket], bucketStarts[bucket + 1]});
+		}
+	}
+
+	const size_t maxSortEntries = max(nEntries / nThreads, size_t(1) << maxRadixBits);
+	WorkStealingExecutor<Range> sortExecutor(nThreads);
+	auto sortBucket = [&entries, &sortExecutor, maxSortEntries] (size_t threadIndex, const Range& bucket) {
+		sortOrPartition(threadIndex, bucket, maxSortEntries, entries, sortExecutor);
+	};
+	runTasks(buckets, threads, sortBucket, sortExecutor);
+
+	// 5. remove all but the first of the entries with equal values (which are consecutive now)
+	vector<size_t> threadUniqueStarts(nThreads + 1, 0);
+	auto countUnique = [&entries, &threadUniqueStarts, &threadStart] (size_t threadIndex) {
+		size_t nUnique = 0;
+		for (size_t i = threadStart(threadIndex); i < threadStart(threadIndex + 1); ++i) {
+			if (i == 0 || firstDifferentLevel(entries[i - 1], entries[i]) < WIDTH) {
+				++nUnique;
+			}
+		}
+		threadUniqueStarts[threadIndex + 1] = nUnique;
+	};
+	threads.run(countUnique);
+	partial_sum(threadUniqueStarts.begin(), threadUniqueStarts.end(), threadUniqueStarts.begin());
+	const size_t nUniqueEntries = threadUniqueStarts[nThreads];
+	if (nUniqueEntries < nEntries) {
+		vector<Entry<DIM, WIDTH>> uniqueEntries(nUniqueEntries);
+		auto removeDuplicates = [&entries, &uniqueEntries, &threadUniqueStarts, &threadStart] (size_t threadIndex) {
+			size_t position = threadUniqueStarts[threadIndex];
+			for (size_t i = threadStart(threadIndex); i < threadStart(threadIndex + 1); ++i) {
+				if (i == 0 || firstDifferentLevel(entries[i - 1], entries[i]) < WIDTH) {
+					uniqueEntries[position++] = entries[i];
+				}
+			}
+		};
+		threads.run(removeDuplicates);
+		entries.swap(uniqueEntries);
+	}
+
+	// 6. the highest node (and the root above it) contains the subtrees in address order
+	const size_t maxTaskEntries = 1 + nUniqueEntries / (tasksPerThread * nThreads);
+	vector<Slot> slots;
+	parallelAppendSlots(entries.data(), entries.data() + nUniqueEntries, currentIndex, maxTaskEntries, slots, threads);
+	return buildRoot(slots, currentIndex, entries[0], nUniqueEntries);
+}
+
+#endif /* SRC_UTIL_BULKLOADUTIL_H_ */
@@ -0,0 +1,181 @@
+/*
+ * CopyOnWriteUtil.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_COPYONWRITEUTIL_H_
+#define SRC_UTIL_COPYONWRITEUTIL_H_
+
+#include "nodes/NodeAddressContent.h"
+
+template <unsigned int DIM, unsigned int WIDTH>
+class Entry;
+template <unsigned int DIM>
+class Node;
+template <unsigned int DIM, unsigned int WIDTH>
+class PHTree;
+
+// Path copying for trees in copy-on-write mode: before a single entry is changed, all nodes on
+// its path from the root are replaced by copies with their own suffix storages. The change then
+// runs in place on the copies (see DynamicNodeOperationsUtil) while snapshots keep reading the
+// original nodes that are retired to the versions of the tree (see VersionManager).
+template <unsigned int DIM, unsigned int WIDTH>
+class CopyOnWriteUtil {
+public:
+	static void copyPathForInsert(const Entry<DIM, WIDTH>& entry, PHTree<DIM, WIDTH>& tree);
+	// also copies the subnodes that a merge of the lowest node into its parent moves
+	static void copyPathForRemove(const Entry<DIM, WIDTH>& entry, PHTree<DIM, WIDTH>& tree);
+	// copies the paths of both entries (the nodes both pass are only copied once)
+	static void copyPathsForUpdate(const Entry<DIM, WIDTH>& oldEntry, const Entry<DIM, WIDTH>& newEntry,
+			PHTree<DIM, WIDTH>& tree);
+
+private:
+	// a path has at most one node per bit and the lowest node at most two subnodes to merge
+	static const size_t maxCopiesPerPath = WIDTH + 2;
+
+	// copies the nodes on the path that are not contained in the copies yet, appends the new copies
+	// and returns the new number of copies
+	static size_t copyPath(const Entry<DIM, WIDTH>& entry, bool removal, PHTree<DIM, WIDTH>& tree,
+			Node<DIM>** copies, size_t nCopies);
+	// replaces the subnode at the address of the (copied) parent by a copy
+	static Node<DIM>* copySubnode(Node<DIM>* parent, unsigned long hcAddress,
+			const Node<DIM>* subnode, PHTree<DIM, WIDTH>& tree);
+	static Node<DIM>* copyNode(const Node<DIM>* node, PHTree<DIM, WIDTH>& tree);
+	static inline bool contains(Node<DIM>* const* copies, size_t nCopies, const Node<DIM>* node);
+};
+
+#include <assert.h>
+#include "nodes/Node.h"
+#include "util/MultiDimBitset.h"
+#include "util/NodeTypeUtil.h"
+#include "util/VersionManager.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+void CopyOnWriteUtil<DIM, WIDTH>::copyPathForInsert(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree) {
+	Node<DIM>* copies[maxCopiesPerPath];
+	copyPath(entry, false, tree, copies, 0);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void CopyOnWriteUtil<DIM, WIDTH>::copyPathForRemove(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree) {
+	Node<DIM>* copies[maxCopiesPerPath];
+	copyPath(entry, true, tree, copies, 0);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void CopyOnWriteUtil<DIM, WIDTH>::copyPathsForUpdate(const Entry<DIM, WIDTH>& oldEntry,
+		const Entry<DIM, WIDTH>& newEntry, PHTree<DIM, WIDTH>& tree) {
+	Node<DIM>* copies[2 * maxCopiesPerPath];
+	const size_t nCopies = copyPath(oldEntry, true, tree, copies, 0);
+	copyPath(newEntry, false, tree, copies, nCopies);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t CopyOnWriteUtil<DIM, WIDTH>::copyPath(const Entry<DIM, WIDTH>& entry, bool removal,
+		PHTree<DIM, WIDTH>& tree, Node<DIM>** copies, size_t nCopies) {
+	assert (tree.versions_);
+
+	// the first path replaces the root once all of its copies are linked so that optimistic readers
+	// never see a copy that is still changed
+	Node<DIM>* currentNode = tree.root_;
+	Node<DIM>* rootCopy = NULL;
+	if (!contains(copies, nCopies, currentNode)) {
+		rootCopy = copyNode(currentNode, tree);
+		copies[nCopies++] = rootCopy;
+		currentNode = rootCopy;
+	}
+
+	size_t index = 0;
+	NodeAddressContent<DIM> content;
+	while (true) {
+		const size_t currentIndex = index + currentNode->getPrefixLength();
+		const unsigned long hcAddress =
+				MultiDimBitset<DIM>::interleaveBits(entry.values_, currentIndex, WIDTH * DIM);
+		currentNode->lookup(hcAddress, content, false);
+		assert (!content.exists || !content.hasSpecialPointer);
+		if (!content.exists || !content.hasSubnode) {
+			break;
+		}
+
+		// the prefix of the subnode is not compared: a split replaces the subnode as well
+		Node<DIM>* subnode = content.subnode;
+		if (!contains(copies, nCopies, subnode)) {
+			subnode = copySubnode(currentNode, hcAddress, subnode, tree);
+			copies[nCopies++] = subnode;
+		}
+
+		currentNode = subnode;
+		index = currentIndex + 1;
+	}
+
+	if (removal && index > 0 && currentNode->getNumberOfContents() == 2) {
+		// removing one of the two contents merges the node into its parent and moves a remaining subnode
+		unsigned long subnodeAddresses[2];
+		const Node<DIM>* subnodes[2];
+		size_t nSubnodes = 0;
+		NodeIterator<DIM>* it = currentNode->begin();
+		NodeIterator<DIM>* endIt = currentNode->end();
+		for (; (*it) != *endIt; ++(*it)) {
+			const NodeAddressContent<DIM> subnodeContent = *(*it);
+			if (subnodeContent.hasSubnode && !contains(copies, nCopies, subnodeContent.subnode)) {
+				subnodeAddresses[nSubnodes] = subnodeContent.address;
+				subnodes[nSubnodes++] = subnodeContent.subnode;
+			}
+		}
+
+		delete it;
+		delete endIt;
+		for (size_t i = 0; i < nSubnodes; ++i) {
+			copies[nCopies++] = copySubnode(currentNode, subnodeAddresses[i], subnodes[i], tree);
+		}
+	}
+
+	if (rootCopy) {
+		// readers that load the new root see all of its contents
+		__atomic_store_n(&tree.root_, rootCopy, __ATOMIC_RELEASE);
+	}
+
+	return nCopies;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* CopyOnWriteUtil<DIM, WIDTH>::copySubnode(Node<DIM>* parent, unsigned long hcAddress,
+		const Node<DIM>* subnode, PHTree<DIM, WIDTH>& tree) {
+	Node<DIM>* copy = copyNode(subnode, tree);
+	// the parent is already reachable for optimistic readers if it was copied for an earlier path
+	parent->beginWrite();
+	parent->insertAtAddress(hcAddress, copy);
+	parent->endWrite();
+	return copy;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+Node<DIM>* CopyOnWriteUtil<DIM, WIDTH>::copyNode(const Node<DIM>* node, PHTree<DIM, WIDTH>& tree) {
+	Node<DIM>* copy = NodeTypeUtil<DIM>::template duplicateNode<WIDTH>(node);
+	// the original node and its suffix storage remain unchanged until no snapshot contains them
+	tree.versions_->retire(node);
+	if (node->getSuffixStorage()) {
+		tree.versions_->retire(node->getSuffixStorage());
+	}
+
+	return copy;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool CopyOnWriteUtil<DIM, WIDTH>::contains(Node<DIM>* const* copies, size_t nCopies, const Node<DIM>* node) {
+	for (size_t i = 0; i < nCopies; ++i) {
+		if (copies[i] == node) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+#endif /* SRC_UTIL_COPYONWRITEUTIL_H_ */
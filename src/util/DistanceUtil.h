@@ -0,0 +1,94 @@
+/*
+ * DistanceUtil.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_DISTANCEUTIL_H_
+#define SRC_UTIL_DISTANCEUTIL_H_
+
+#include <stddef.h>
+
+enum DistanceMetric {euclidean_distance, manhattan_distance};
+
+template <unsigned int DIM, unsigned int WIDTH>
+class DistanceUtil {
+public:
+	// minimum distance between the point and the region of all values that share
+	// the highest prefixLength bits (per dimension) with the given values
+	static double minDistance(const unsigned long* values, size_t prefixLength,
+			const unsigned long* point, DistanceMetric metric, bool isFloat);
+	// exact distance between two points
+	static double distance(const unsigned long* values, const unsigned long* point,
+			DistanceMetric metric, bool isFloat);
+
+private:
+	static inline double minDistanceInDimension(unsigned long lower, unsigned long upper,
+			unsigned long point, bool isFloat);
+};
+
+#include <assert.h>
+#include <math.h>
+#include "util/FileInputUtil.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+double DistanceUtil<DIM, WIDTH>::minDistance(const unsigned long* values, size_t prefixLength,
+		const unsigned long* point, DistanceMetric metric, bool isFloat) {
+	assert (prefixLength <= WIDTH);
+	assert (!isFloat || WIDTH == 8 * sizeof (unsigned long));
+
+	// the lower bits are free within the region
+	const size_t freeBits = WIDTH - prefixLength;
+	const unsigned long freeMask = (freeBits == 8 * sizeof (unsigned long))? -1 : (1uL << freeBits) - 1;
+	double sum = 0.0;
+	for (unsigned d = 0; d < DIM; ++d) {
+		const unsigned long lower = values[d] & ~freeMask;
+		const unsigned long upper = lower | freeMask;
+		const double dist = minDistanceInDimension(lower, upper, point[d], isFloat);
+		switch (metric) {
+		case euclidean_distance: sum += dist * dist; break;
+		case manhattan_distance: sum += dist; break;
+		default: assert (false);
+		}
+	}
+
+	return (metric == euclidean_distance)? sqrt(sum) : sum;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+double DistanceUtil<DIM, WIDTH>::distance(const unsigned long* values, const unsigned long* point,
+		DistanceMetric metric, bool isFloat) {
+	return minDistance(values, WIDTH, point, metric, isFloat);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+double DistanceUtil<DIM, WIDTH>::minDistanceInDimension(unsigned long lower, unsigned long upper,
+		unsigned long point, bool isFloat) {
+	assert (lower <= upper);
+	if (!isFloat) {
+		if (point < lower) {
+			return double(lower - point);
+		} else if (point > upper) {
+			return double(point - upper);
+		} else {
+			return 0.0;
+		}
+	}
+
+	const double lowerValue = FileInputUtil::decodeFloat(lower);
+	const double upperValue = FileInputUtil::decodeFloat(upper);
+	// comparisons with NaN fail so the distance falls back to a lower bound
+	const double pointValue = FileInputUtil::decodeFloat(point);
+	if (pointValue < lowerValue) {
+		return lowerValue - pointValue;
+	} else if (pointValue > upperValue) {
+		return pointValue - upperValue;
+	} else {
+		return 0.0;
+	}
+}
+
+#endif /* SRC_UTIL_DISTANCEUTIL_H_ */
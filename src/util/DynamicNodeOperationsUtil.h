@@ -15,8 +15,8 @@
 
 #include <atomic>
 #include "nodes/NodeAddressContent.h"
-#include "util/DeletedNodes.h"
 #include "util/EntryTreeMap.h"
+#include "util/EpochManager.h"
 
 template <unsigned int DIM, unsigned int WIDTH>
 class Entry;
@@ -41,6 +41,11 @@ public:
 	static unsigned int nInsertSplitPrefix;
 	static unsigned int nFlushCountWithin;
 	static unsigned int nFlushCountAfter;
+	static unsigned int nRemoveSuffix;
+	static unsigned int nRemoveShrink;
+	static unsigned int nRemoveMerge;
+	static unsigned int nUpdateInPlace;
+	static unsigned int nUpdateRelocate;
 
 	static unsigned int nThreads;
 
@@ -54,12 +59,20 @@ public:
 
 	static void resetCounters();
 	static void insert(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree);
+	// inserts below the given start node whose prefix starts at the given index and is shared with the entry
+	static void insert(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree, Node<DIM>* startNode,
+			size_t startIndex, Node<DIM>* startParentNode, unsigned long startParentHcAddress);
+	// same traversal as insert but if the values are already stored their ID is replaced by merge(int storedId):
+	// returns true if the entry was inserted
+	template <typename Merge>
+	static bool insertOrMerge(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree, Merge& merge);
 	static void parallelInsert(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree);
 	static void bulkInsert(const std::vector<Entry<DIM, WIDTH>>& entries, PHTree<DIM, WIDTH>& tree);
 	static bool parallelBulkInsert(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree,
-			EntryBufferPool<DIM, WIDTH>& pool, DeletedNodes<DIM>& deletedNodes, EntryTreeMap<DIM,WIDTH>& entryTreeMap);
+			EntryBufferPool<DIM, WIDTH>& pool, EntryTreeMap<DIM,WIDTH>& entryTreeMap);
 
-	static void createSubnodeWithExistingSuffix(size_t currentIndex, Node<DIM>* currentNode,
+	// returns false if the entry is already stored
+	static bool createSubnodeWithExistingSuffix(size_t currentIndex, Node<DIM>* currentNode,
 			const NodeAddressContent<DIM>& content, const Entry<DIM, WIDTH>& entry,
 			PHTree<DIM, WIDTH>& tree);
 	static bool swapSuffixWithBuffer(size_t currentIndex, Node<DIM>* currentNode,
@@ -67,13 +80,40 @@ public:
 			EntryBuffer<DIM, WIDTH>* buffer, PHTree<DIM, WIDTH>& tree);
 	static Node<DIM>* insertSuffix(size_t currentIndex, size_t hcAddress, Node<DIM>* currentNode,
 			const Entry<DIM, WIDTH>& entry, PHTree<DIM, WIDTH>& tree);
+	// replaces the subnode by a node with the shorter prefix and retires the old subnode
 	static void splitSubnodePrefix(size_t currentIndex, size_t newPrefixLength, size_t oldPrefixLength,
 			Node<DIM>* currentNode, const NodeAddressContent<DIM>& content, const Entry<DIM, WIDTH>& entry,
 			PHTree<DIM, WIDTH>& tree);
 
 	static void flushSubtree(EntryBuffer<DIM, WIDTH>* buffer, bool deallocate);
+	// recalculates the number of entries of the nodes that parallel insertions marked as changed
+	// (only their subtrees are visited) and returns the one of the given node
+	static size_t recountChangedSubtreeEntries(Node<DIM>* node);
+	// replaces the ID of every entry in the subtree by mapping(id) in ascending order of the entries
+	template <typename Mapping>
+	static void mapIds(Node<DIM>* node, Mapping& mapping);
+
+	static std::pair<bool, int> remove(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree);
+	static void removeSuffix(size_t currentIndex, Node<DIM>* currentNode,
+			const NodeAddressContent<DIM>& content, size_t lastIndex, unsigned long lastHcAddress,
+			Node<DIM>* lastNode, PHTree<DIM, WIDTH>& tree);
+	static bool update(const Entry<DIM, WIDTH>& oldEntry, const Entry<DIM, WIDTH>& newEntry, PHTree<DIM, WIDTH>& tree);
+	static void mergeSubnodeIntoParent(size_t parentIndex, unsigned long parentHcAddress,
+			Node<DIM>* parent, Node<DIM>* subnode);
+
+	// publishes the new root for optimistic readers and retires the old one
+	static void replaceRoot(PHTree<DIM, WIDTH>& tree, Node<DIM>* newRoot);
+	// marks the replaced node as removed and obsolete and deletes it once no other thread can access it
+	// (the writer must not change the node any more)
+	static void retireNode(Node<DIM>* node);
 private:
 
+	// calls handleExisting(Node<DIM>* node, unsigned long hcAddress, const NodeAddressContent<DIM>& content)
+	// while the node is written if the values are already stored and returns false then
+	template <typename ExistingEntryHandler>
+	static bool insert(const Entry<DIM, WIDTH>& e, PHTree<DIM, WIDTH>& tree, Node<DIM>* startNode,
+			size_t startIndex, Node<DIM>* startParentNode, unsigned long startParentHcAddress,
+			ExistingEntryHandler& handleExisting);
 	static inline bool needToCopyNodeForSuffixInsertion(Node<DIM>* currentNode);
 
 	static inline bool writeLockBlocking(Node<DIM>* node);
@@ -88,6 +128,8 @@ private:
 	static inline void readUnlock(Node<DIM>* node);
 	static inline void readUnlock(Node<DIM>* child, Node<DIM>* parent);
 	static inline bool tryWriteLockWithoutRead(Node<DIM>* node);
+	// the number of subtree entries of a node that a parallel insertion passed is recounted afterwards
+	static inline void markSubtreeChanged(Node<DIM>* node);
 };
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -107,6 +149,16 @@ unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nInsertSuffixBuffer = 0;
 template <unsigned int DIM, unsigned int WIDTH>
 unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nInsertSuffixIntoBuffer = 0;
 template <unsigned int DIM, unsigned int WIDTH>
+unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nRemoveSuffix = 0;
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nRemoveShrink = 0;
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nRemoveMerge = 0;
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nUpdateInPlace = 0;
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nUpdateRelocate = 0;
+template <unsigned int DIM, unsigned int WIDTH>
 unsigned int DynamicNodeOperationsUtil<DIM, WIDTH>::nThreads = 0;
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -156,6 +208,11 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::resetCounters() {
 	nFlushCountWithin = 0;
 	nInsertSuffixBuffer = 0;
 	nInsertSuffixIntoBuffer = 0;
+	nRemoveSuffix = 0;
+	nRemoveShrink = 0;
+	nRemoveMerge = 0;
+	nUpdateInPlace = 0;
+	nUpdateRelocate = 0;
 
 	nRestartReadRecurse = 0;
 	nRestartWriteSplitPrefix = 0;
@@ -167,7 +224,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::resetCounters() {
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void DynamicNodeOperationsUtil<DIM, WIDTH>::createSubnodeWithExistingSuffix(
+bool DynamicNodeOperationsUtil<DIM, WIDTH>::createSubnodeWithExistingSuffix(
 		size_t currentIndex, Node<DIM>* currentNode, const NodeAddressContent<DIM>& content,
 		const Entry<DIM, WIDTH>& entry, PHTree<DIM, WIDTH>& tree) {
 
@@ -186,7 +243,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::createSubnodeWithExistingSuffix(
 			entry.values_, DIM * WIDTH, currentIndex + 1, suffixStartBlock, currentSuffixBits,
 			prefixTmp);
 	if (prefixLength + currentIndex + 1 == WIDTH) {
-		return;
+		return false;
 	}
 
 	const size_t newSuffixLength = WIDTH - (currentIndex + 1 + prefixLength + 1);
@@ -243,6 +300,9 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::createSubnodeWithExistingSuffix(
 		subnode->insertAtAddress(existingEntryHCAddress, existingEntrySuffixStartBlock.second, content.id);
 	}
 
+	subnode->setNumberOfSubtreeEntries(2);
+	currentNode->incrementSubtreeEntries();
+
 	// remove the old suffix if necessary
 	assert (!content.hasSubnode);
 	if (!content.directlyStoredSuffix) {
@@ -264,6 +324,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::createSubnodeWithExistingSuffix(
 			&& (!subnode->getSuffixStorage()
 					|| subnode->getSuffixStorage()->getNStoredSuffixes(newSuffixBits) == 2));
 //TODO not possible for parallel insert:	assert (tree.lookup(entry).first);
+	return true;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -365,6 +426,7 @@ Node<DIM>* DynamicNodeOperationsUtil<DIM, WIDTH>::insertSuffix(size_t currentInd
 		assert(adjustedNode->lookup(hcAddress, true).suffixStartBlock == suffixStartBlock.first);
 	}
 
+	adjustedNode->incrementSubtreeEntries();
 	assert(adjustedNode);
 	assert(adjustedNode->lookup(hcAddress, true).exists);
 	assert(adjustedNode->lookup(hcAddress, true).id == entry.id_);
@@ -424,8 +486,13 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::splitSubnodePrefix(
 				oldPrefixLength * DIM, newPrefixLength + 1, oldSubnodeCopy->getPrefixStartBlock());
 	}
 
-	// replace the old subnode with the copy
+	// replace the old subnode with the copy: optimistic readers of the old subnode restart
+	// because it shares the suffix storage with the copy
+	const_cast<Node<DIM>*>(oldSubnode)->markObsolete();
 	newSubnode->insertAtAddress(newSubnodePrefixDiffHCAddress, oldSubnodeCopy);
+	newSubnode->setNumberOfSubtreeEntries(oldSubnodeCopy->getNumberOfSubtreeEntries() + 1);
+	newSubnode->subtreeChanged = oldSubnodeCopy->subtreeChanged;
+	currentNode->incrementSubtreeEntries();
 
 	assert (currentNode->lookup(content.address, true).hasSubnode);
 	assert (currentNode->lookup(content.address, true).subnode == newSubnode);
@@ -440,8 +507,8 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::splitSubnodePrefix(
 			remainingOldPrefixBits));
 // TODO not possible for parallel insert:	assert (tree.lookup(entry).first);
 
-
-// TODO do not delete because of parallel workers: delete oldSubnode;
+	// parallel workers might still hold the old subnode so it is only freed after their epochs
+	retireNode(const_cast<Node<DIM>*>(oldSubnode));
 
 	// no need to adjust size because the old node remains and the new
 	// one already has the correct size
@@ -465,6 +532,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::writeLockBlocking(Node<DIM>* node) {
 		return false;
 	} else {
 		// got write permission and the node is still valid
+		node->beginWrite();
 		return true;
 	}
 }
@@ -486,6 +554,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::tryWriteLock(Node<DIM>* node) {
 		return false;
 	} else if (result == 0) {
 		// got write permission and the node is still valid
+		node->beginWrite();
 		return true;
 	} else {
 		// did not get write permission -> fail
@@ -496,6 +565,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::tryWriteLock(Node<DIM>* node) {
 template<unsigned int DIM, unsigned int WIDTH>
 bool DynamicNodeOperationsUtil<DIM, WIDTH>::downgradeWriterToReader(Node<DIM>* node) {
 	unsigned int updatesBefore = node->updateCounter;
+	node->endWrite();
 	int result = pthread_rwlock_unlock(&(node->rwLock));
 	assert (result == 0);
 	result = pthread_rwlock_rdlock(&(node->rwLock));
@@ -519,6 +589,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::writeLockBlocking(
 	if (writeLockBlocking(parent)) {
 		int result = pthread_rwlock_wrlock(&(child->rwLock));
 		assert (result == 0);
+		child->beginWrite();
 		unsigned int updatesAfter = child->updateCounter;
 		if (child->removed || updatesBefore != updatesAfter) {
 			writeUnlock(child, false);
@@ -561,6 +632,7 @@ template <unsigned int DIM, unsigned int WIDTH>
 void DynamicNodeOperationsUtil<DIM, WIDTH>::writeUnlock(Node<DIM>* node, bool changedSomething) {
 	assert (node);
 	if (changedSomething) { ++node->updateCounter; }
+	node->endWrite();
 	const int result = pthread_rwlock_unlock(&(node->rwLock));
 	assert (result == 0);
 }
@@ -568,6 +640,9 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::writeUnlock(Node<DIM>* node, bool ch
 template <unsigned int DIM, unsigned int WIDTH>
 bool DynamicNodeOperationsUtil<DIM, WIDTH>::tryWriteLockWithoutRead(Node<DIM>* node) {
 	const int result = pthread_rwlock_trywrlock(&(node->rwLock));
+	if (result == 0) {
+		node->beginWrite();
+	}
 	return result == 0;
 }
 
@@ -673,8 +748,6 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::parallelInsert(const Entry<DIM, WIDT
 					if (optimisticWriteLock(currentNode, lastNode)) {
 						splitSubnodePrefix(currentIndex, differentBitAtPrefixIndex, subnodePrefixLength, lastNode, content, entry, tree);
 						optimisticWriteUnlock(currentNode, lastNode);
-						currentNode->removed = true;
-						delete currentNode;
 						break;
 					} else {
 						restart = true;
@@ -702,9 +775,8 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::parallelInsert(const Entry<DIM, WIDT
 				Node<DIM>* adjustedNode = insertSuffix(currentIndex, hcAddress, currentNode, entry, tree);
 				assert (adjustedNode && (adjustedNode != currentNode));
 				lastNode->insertAtAddress(lastHcAddress, adjustedNode);
+				retireNode(currentNode);
 				optimisticWriteUnlock(currentNode, lastNode);
-				currentNode->removed = true;
-				delete currentNode;
 				break;
 			} else {
 				restart = true;
@@ -729,12 +801,55 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::parallelInsert(const Entry<DIM, WIDT
 template <unsigned int DIM, unsigned int WIDTH>
 void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry,
 		PHTree<DIM, WIDTH>& tree) {
+	insert(entry, tree, tree.root_, 0, NULL, 0);
+}
 
-	size_t lastHcAddress = 0;
-	size_t index = 0;
-	Node<DIM>* lastNode = NULL;
-	Node<DIM>* currentNode = tree.root_;
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree, Node<DIM>* startNode, size_t startIndex,
+		Node<DIM>* startParentNode, unsigned long startParentHcAddress) {
+	// an entry with the same values stays unchanged
+	auto ignoreExisting = [] (Node<DIM>*, unsigned long, const NodeAddressContent<DIM>&) {};
+	insert(entry, tree, startNode, startIndex, startParentNode, startParentHcAddress, ignoreExisting);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Merge>
+bool DynamicNodeOperationsUtil<DIM, WIDTH>::insertOrMerge(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree, Merge& merge) {
+	auto replaceId = [&merge] (Node<DIM>* node, unsigned long hcAddress, const NodeAddressContent<DIM>& content) {
+		// the suffix stays in place and only the ID changes (same as in mapIds)
+		NodeAddressContent<DIM> stored;
+		node->lookup(hcAddress, stored, false);
+		assert (stored.exists && !stored.hasSubnode && stored.id == content.id);
+		const int id = merge(content.id);
+		if (stored.directlyStoredSuffix) {
+			node->insertAtAddress(hcAddress, stored.suffix, id);
+		} else {
+			node->insertAtAddress(hcAddress, stored.suffixStartBlockIndex, id);
+		}
+	};
+
+	return insert(entry, tree, tree.root_, 0, NULL, 0, replaceId);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename ExistingEntryHandler>
+bool DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree, Node<DIM>* startNode, size_t startIndex,
+		Node<DIM>* startParentNode, unsigned long startParentHcAddress,
+		ExistingEntryHandler& handleExisting) {
+	assert (startNode && (startParentNode || startNode == tree.root_));
+
+	size_t lastHcAddress = startParentHcAddress;
+	size_t index = startIndex;
+	Node<DIM>* lastNode = startParentNode;
+	Node<DIM>* currentNode = startNode;
 	NodeAddressContent<DIM> content;
+	// nodes that the entry passed on the way down (the last node is adjusted by the insertion itself)
+	Node<DIM>* visitedNodes[WIDTH];
+	size_t nVisitedNodes = 0;
+	bool inserted = true;
 
 	while (index < WIDTH) {
 
@@ -767,6 +882,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entr
 				#ifdef PRINT
 					cout << "recurse -> ";
 				#endif
+				visitedNodes[nVisitedNodes++] = currentNode;
 				lastHcAddress = hcAddress;
 				lastNode = currentNode;
 				currentNode = content.subnode;
@@ -774,30 +890,41 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entr
 			} else {
 				// split prefix of subnode [A | d | B] where d is the index of the first different bit
 				// create new node with prefix A and only leave prefix B in old subnode
+				currentNode->beginWrite();
 				splitSubnodePrefix(currentIndex, differentBitAtPrefixIndex, subnodePrefixLength, currentNode, content, entry, tree);
+				currentNode->endWrite();
 				break;
 			}
 		} else if (content.exists && !content.hasSubnode) {
 			// node entry and suffix exist:
 			// convert suffix to new node with prefix (longest common) + insert
-			createSubnodeWithExistingSuffix(currentIndex, currentNode, content, entry, tree);
+			currentNode->beginWrite();
+			inserted = createSubnodeWithExistingSuffix(currentIndex, currentNode, content, entry, tree);
+			if (!inserted) {
+				// the values are already stored
+				handleExisting(currentNode, hcAddress, content);
+			}
+			currentNode->endWrite();
 			break;
 		} else {
 			// node entry does not exist:
 			// insert entry + suffix
+			currentNode->beginWrite();
 			Node<DIM>* adjustedNode = insertSuffix(currentIndex,
 					hcAddress, currentNode, entry, tree);
+			currentNode->endWrite();
 			assert(adjustedNode);
 			if (adjustedNode != currentNode && lastNode) {
 				// the subnode changed: store the new one and delete the old
+				lastNode->beginWrite();
 				lastNode->insertAtAddress(lastHcAddress, adjustedNode);
-				delete currentNode;
+				lastNode->endWrite();
+				retireNode(currentNode);
 				currentNode = adjustedNode;
 			} else if (adjustedNode != currentNode) {
 				// the root node changed
 				currentNode = adjustedNode;
-				delete tree.root_;
-				tree.root_ = adjustedNode;
+				replaceRoot(tree, adjustedNode);
 				assert (tree.lookup(entry).first);
 			}
 
@@ -805,6 +932,12 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entr
 		}
 	}
 
+	if (inserted) {
+		for (size_t i = 0; i < nVisitedNodes; ++i) {
+			visitedNodes[i]->incrementSubtreeEntries();
+		}
+	}
+
 	#ifndef NDEBUG
 		// validation only: lookup again after insertion
 		const size_t hcAddress =
@@ -820,6 +953,348 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entr
 		//const size_t blocksPerSuffix = 1 + (remainingSuffixBits - 1) / (8 * sizeof (unsigned long));
 		//size_t suffixesInNode =
 	#endif
+
+	return inserted;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool, int> DynamicNodeOperationsUtil<DIM, WIDTH>::remove(const Entry<DIM, WIDTH>& entry,
+		PHTree<DIM, WIDTH>& tree) {
+
+	size_t lastHcAddress = 0;
+	size_t lastIndex = 0;
+	size_t index = 0;
+	Node<DIM>* lastNode = NULL;
+	Node<DIM>* currentNode = tree.root_;
+	NodeAddressContent<DIM> content;
+	// nodes above the one that stores the suffix
+	Node<DIM>* visitedNodes[WIDTH];
+	size_t nVisitedNodes = 0;
+
+	while (true) {
+
+		const size_t prefixLength = currentNode->getPrefixLength();
+		if (prefixLength > 0) {
+			const pair<bool, size_t> prefixComp = MultiDimBitset<DIM>::compare(entry.values_, DIM * WIDTH,
+					index, index + prefixLength,
+					currentNode->getFixPrefixStartBlock(), prefixLength * DIM);
+			if (!prefixComp.first) {
+				return pair<bool, int>(false, 0);
+			}
+		}
+
+		const size_t currentIndex = index + prefixLength;
+		const unsigned long hcAddress =
+				MultiDimBitset<DIM>::interleaveBits(entry.values_, currentIndex, WIDTH * DIM);
+		currentNode->lookup(hcAddress, content, true);
+		assert(!content.exists || content.address == hcAddress);
+		assert(!content.exists || !content.hasSpecialPointer);
+
+		if (!content.exists) {
+			return pair<bool, int>(false, 0);
+		}
+
+		if (content.hasSubnode) {
+			// recurse on subnode
+			visitedNodes[nVisitedNodes++] = currentNode;
+			lastHcAddress = hcAddress;
+			lastIndex = currentIndex;
+			lastNode = currentNode;
+			currentNode = content.subnode;
+			index = currentIndex + 1;
+		} else {
+			const size_t suffixBits = DIM * (WIDTH - currentIndex - 1);
+			if (suffixBits > 0) {
+				const pair<bool, size_t> suffixComp = MultiDimBitset<DIM>::compare(entry.values_, DIM * WIDTH,
+						currentIndex + 1, WIDTH, content.getSuffixStartBlock(), suffixBits);
+				if (!suffixComp.first) {
+					return pair<bool, int>(false, 0);
+				}
+			}
+
+			const int removedId = content.id;
+			removeSuffix(currentIndex, currentNode, content, lastIndex, lastHcAddress, lastNode, tree);
+			// the removal does not replace any of the higher nodes
+			for (size_t i = 0; i < nVisitedNodes; ++i) {
+				visitedNodes[i]->decrementSubtreeEntries();
+			}
+			assert (!tree.lookup(entry).first);
+			return pair<bool, int>(true, removedId);
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::removeSuffix(size_t currentIndex, Node<DIM>* currentNode,
+		const NodeAddressContent<DIM>& content, size_t lastIndex, unsigned long lastHcAddress,
+		Node<DIM>* lastNode, PHTree<DIM, WIDTH>& tree) {
+	assert (content.exists && !content.hasSubnode && !content.hasSpecialPointer);
+
+#ifdef PRINT
+	cout << "removing suffix" << endl;
+#endif
+
+	++nRemoveSuffix;
+
+	// 1. remove the reference and release the suffix space afterwards
+	// (otherwise the stored suffixes do not match the references in the node)
+	currentNode->beginWrite();
+	currentNode->removeAtAddress(content.address);
+	currentNode->decrementSubtreeEntries();
+	if (!content.directlyStoredSuffix) {
+		const size_t suffixBits = DIM * (WIDTH - currentIndex - 1);
+		unsigned long* oldSuffixLocation = const_cast<unsigned long*>(content.suffixStartBlock);
+		currentNode->freeSuffixSpace(suffixBits, oldSuffixLocation);
+		NodeTypeUtil<DIM>::template shrinkSuffixStorageIfPossible<WIDTH>(currentNode);
+	}
+	currentNode->endWrite();
+
+	if (lastNode && currentNode->getNumberOfContents() == 1) {
+		// 2a. a subnode always holds at least two contents so the remaining one is moved to the parent
+		mergeSubnodeIntoParent(lastIndex, lastHcAddress, lastNode, currentNode);
+		return;
+	}
+
+	// 2b. switch to a smaller node type if possible (AHC -> LHC, LHC -> smaller LHC)
+	assert (!lastNode || currentNode->getNumberOfContents() > 1);
+	Node<DIM>* adjustedNode = currentNode->adjustSize();
+	assert(adjustedNode);
+	if (adjustedNode != currentNode) {
+		++nRemoveShrink;
+		// the suffix storage was moved to the adjusted node
+		if (lastNode) {
+			lastNode->beginWrite();
+			lastNode->insertAtAddress(lastHcAddress, adjustedNode);
+			lastNode->endWrite();
+			retireNode(currentNode);
+		} else {
+			replaceRoot(tree, adjustedNode);
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool DynamicNodeOperationsUtil<DIM, WIDTH>::update(const Entry<DIM, WIDTH>& oldEntry,
+		const Entry<DIM, WIDTH>& newEntry, PHTree<DIM, WIDTH>& tree) {
+
+	// number of leading bits both entries have in common in each dimension
+	const size_t commonPrefixLength = MultiDimBitset<DIM>::compareFullAligned(
+			oldEntry.values_, DIM * WIDTH, newEntry.values_);
+	assert (commonPrefixLength <= WIDTH);
+
+	// path of the old entry: node, index of the first prefix bit and HC address
+	Node<DIM>* pathNodes[WIDTH];
+	size_t pathIndices[WIDTH];
+	unsigned long pathHcAddresses[WIDTH];
+	size_t depth = 0;
+	// the lowest node on the path that both entries pass through
+	size_t sharedDepth = 0;
+
+	size_t index = 0;
+	Node<DIM>* currentNode = tree.root_;
+	NodeAddressContent<DIM> content;
+
+	while (true) {
+
+		const size_t prefixLength = currentNode->getPrefixLength();
+		if (prefixLength > 0) {
+			const pair<bool, size_t> prefixComp = MultiDimBitset<DIM>::compare(oldEntry.values_, DIM * WIDTH,
+					index, index + prefixLength,
+					currentNode->getFixPrefixStartBlock(), prefixLength * DIM);
+			if (!prefixComp.first) {
+				return false;
+			}
+		}
+
+		const size_t currentIndex = index + prefixLength;
+		const unsigned long hcAddress =
+				MultiDimBitset<DIM>::interleaveBits(oldEntry.values_, currentIndex, WIDTH * DIM);
+		assert (depth < WIDTH);
+		pathNodes[depth] = currentNode;
+		pathIndices[depth] = index;
+		pathHcAddresses[depth] = hcAddress;
+		if (currentIndex <= commonPrefixLength) {
+			sharedDepth = depth;
+		}
+
+		currentNode->lookup(hcAddress, content, true);
+		assert(!content.exists || !content.hasSpecialPointer);
+		if (!content.exists) {
+			return false;
+		}
+
+		if (content.hasSubnode) {
+			currentNode = content.subnode;
+			index = currentIndex + 1;
+			++depth;
+			continue;
+		}
+
+		const size_t suffixBits = DIM * (WIDTH - currentIndex - 1);
+		if (suffixBits > 0) {
+			const pair<bool, size_t> suffixComp = MultiDimBitset<DIM>::compare(oldEntry.values_, DIM * WIDTH,
+					currentIndex + 1, WIDTH, content.getSuffixStartBlock(), suffixBits);
+			if (!suffixComp.first) {
+				return false;
+			}
+		}
+
+		if (content.id != oldEntry.id_) {
+			return false;
+		}
+
+		if (commonPrefixLength > currentIndex) {
+			// both entries end up in the same suffix slot which is only used by the old entry:
+			// overwrite the suffix in place
+			++nUpdateInPlace;
+			currentNode->beginWrite();
+			if (content.directlyStoredSuffix) {
+				unsigned long suffix = 0uL;
+				if (suffixBits > 0) {
+					MultiDimBitset<DIM>::removeHighestBits(newEntry.values_, DIM * WIDTH, currentIndex + 1, &suffix);
+				}
+				currentNode->insertAtAddress(hcAddress, suffix, newEntry.id_);
+			} else {
+				unsigned long* suffixStartBlock = const_cast<unsigned long*>(content.suffixStartBlock);
+				MultiDimBitset<DIM>::removeHighestBits(newEntry.values_, DIM * WIDTH, currentIndex + 1, suffixStartBlock);
+				if (oldEntry.id_ != newEntry.id_) {
+					currentNode->lookup(hcAddress, content, false);
+					currentNode->insertAtAddress(hcAddress, content.suffixStartBlockIndex, newEntry.id_);
+				}
+			}
+			currentNode->endWrite();
+
+			assert (tree.lookup(newEntry).second == newEntry.id_);
+			return true;
+		}
+
+		break;
+	}
+
+	// the new entry must not be stored yet and can only be below the shared node
+	if (SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(newEntry,
+			pathNodes[sharedDepth], pathIndices[sharedDepth], NULL).first) {
+		return false;
+	}
+
+	++nUpdateRelocate;
+	const size_t suffixIndex = pathIndices[depth] + currentNode->getPrefixLength();
+	if (depth > 0) {
+		removeSuffix(suffixIndex, currentNode, content, pathIndices[depth] - 1,
+				pathHcAddresses[depth - 1], pathNodes[depth - 1], tree);
+	} else {
+		removeSuffix(suffixIndex, currentNode, content, 0, 0, NULL, tree);
+	}
+
+	// the removal can only replace the node that stored the old suffix so restart from its parent in that case
+	size_t startDepth = sharedDepth;
+	if (sharedDepth == depth && depth > 0) {
+		startDepth = depth - 1;
+	}
+
+	// the nodes above the start node keep their number of entries, the insertion counts the new
+	// entry again for the start node and the nodes below
+	for (size_t d = startDepth; d < depth; ++d) {
+		pathNodes[d]->decrementSubtreeEntries();
+	}
+
+	Node<DIM>* startNode = (startDepth == 0)? tree.root_ : pathNodes[startDepth];
+	if (startDepth > 0) {
+		insert(newEntry, tree, startNode, pathIndices[startDepth],
+				pathNodes[startDepth - 1], pathHcAddresses[startDepth - 1]);
+	} else {
+		insert(newEntry, tree, startNode, 0, NULL, 0);
+	}
+
+	assert (!tree.lookup(oldEntry).first);
+	assert (tree.lookup(newEntry).second == newEntry.id_);
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::mergeSubnodeIntoParent(size_t parentIndex,
+		unsigned long parentHcAddress, Node<DIM>* parent, Node<DIM>* subnode) {
+	assert (subnode->getNumberOfContents() == 1);
+	assert (parent->lookup(parentHcAddress, true).subnode == subnode);
+
+#ifdef PRINT
+	cout << "merge subnode into parent" << endl;
+#endif
+
+	++nRemoveMerge;
+
+	const size_t prefixLength = subnode->getPrefixLength();
+	const unsigned long* prefixStartBlock = subnode->getFixPrefixStartBlock();
+	NodeIterator<DIM>* it = subnode->begin();
+	const NodeAddressContent<DIM> content = *(*it);
+	delete it;
+	assert (content.exists && !content.hasSpecialPointer);
+	parent->beginWrite();
+
+	if (content.hasSubnode) {
+		// the remaining subnode gets the prefix [subnode prefix | address | prefix]
+		Node<DIM>* child = content.subnode;
+		const size_t childPrefixLength = child->getPrefixLength();
+		const size_t mergedPrefixLength = prefixLength + 1 + childPrefixLength;
+		Node<DIM>* childCopy = NodeTypeUtil<DIM>::copyWithoutPrefix(DIM * mergedPrefixLength, child);
+		unsigned long* mergedPrefix = childCopy->getPrefixStartBlock();
+		assert (MultiDimBitset<DIM>::checkRangeUnset(mergedPrefix, childCopy->getMaxPrefixLength(), 0));
+		for (size_t i = 0; i < prefixLength; ++i) {
+			const unsigned long value = MultiDimBitset<DIM>::interleaveBits(prefixStartBlock, i, DIM * prefixLength);
+			MultiDimBitset<DIM>::pushBackValue(value, mergedPrefix, DIM * (mergedPrefixLength - i - 1));
+		}
+
+		MultiDimBitset<DIM>::pushBackValue(content.address, mergedPrefix, DIM * childPrefixLength);
+		for (size_t i = 0; i < childPrefixLength; ++i) {
+			const unsigned long value = MultiDimBitset<DIM>::interleaveBits(child->getFixPrefixStartBlock(), i, DIM * childPrefixLength);
+			MultiDimBitset<DIM>::pushBackValue(value, mergedPrefix, DIM * (childPrefixLength - i - 1));
+		}
+
+		parent->insertAtAddress(parentHcAddress, childCopy);
+		parent->endWrite();
+		// the suffix storage was moved to the copy
+		retireNode(child);
+	} else {
+		// the remaining suffix is extended to [subnode prefix | address | suffix] and stored in the parent
+		const size_t suffixBits = DIM * (WIDTH - (parentIndex + 1 + prefixLength) - 1);
+		const size_t mergedSuffixBits = DIM * (WIDTH - parentIndex - 1);
+		assert (mergedSuffixBits == suffixBits + DIM * (prefixLength + 1));
+		unsigned long mergedSuffix[1 + (DIM * WIDTH - 1) / (sizeof(unsigned long) * 8)] = {};
+		if (suffixBits > 0) {
+			MultiDimBitset<DIM>::duplicateLowestBitsAligned(content.getSuffixStartBlock(), suffixBits, mergedSuffix);
+		}
+
+		MultiDimBitset<DIM>::pushBackValue(content.address, mergedSuffix, suffixBits);
+		for (size_t i = 0; i < prefixLength; ++i) {
+			const unsigned long value = MultiDimBitset<DIM>::interleaveBits(prefixStartBlock, i, DIM * prefixLength);
+			MultiDimBitset<DIM>::pushBackValue(value, mergedSuffix, DIM * (mergedSuffixBits / DIM - i - 1));
+		}
+
+		if (parent->canStoreSuffixInternally(mergedSuffixBits)) {
+			parent->insertAtAddress(parentHcAddress, mergedSuffix[0], content.id);
+		} else {
+			const unsigned int newTotalSuffixBlocks = parent->canStoreSuffix(mergedSuffixBits);
+			if (newTotalSuffixBlocks != 0) {
+				NodeTypeUtil<DIM>::template enlargeSuffixStorage<WIDTH>(newTotalSuffixBlocks, parent);
+				assert (parent->canStoreSuffix(mergedSuffixBits) == 0);
+			}
+
+			// the parent still references the subnode so the new suffix can be reserved
+			const pair<unsigned long*, unsigned int> suffixStartBlock = parent->reserveSuffixSpace(mergedSuffixBits);
+			MultiDimBitset<DIM>::duplicateLowestBitsAligned(mergedSuffix, mergedSuffixBits, suffixStartBlock.first);
+			parent->insertAtAddress(parentHcAddress, suffixStartBlock.second, content.id);
+		}
+
+		parent->endWrite();
+		assert (!parent->lookup(parentHcAddress, true).hasSubnode);
+		assert (parent->lookup(parentHcAddress, true).id == content.id);
+	}
+
+	if (subnode->getSuffixStorage()) {
+		EpochManager::retireOrDelete(subnode->getSuffixStorage());
+	}
+
+	retireNode(subnode);
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -836,6 +1311,10 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 		size_t index = 0;
 		Node<DIM>* lastNode = NULL;
 		Node<DIM>* currentNode = currentRoot;
+		// nodes that the entry passed on the way down (the last node is adjusted by the insertion itself)
+		Node<DIM>* visitedNodes[WIDTH];
+		size_t nVisitedNodes = 0;
+		bool inserted = true;
 
 		while (index < WIDTH) {
 			const size_t currentIndex = index + currentNode->getPrefixLength();
@@ -867,6 +1346,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 
 				if (prefixIncluded) {
 					// recurse on subnode
+					visitedNodes[nVisitedNodes++] = currentNode;
 					lastHcAddress = hcAddress;
 					lastNode = currentNode;
 					currentNode = content.subnode;
@@ -874,9 +1354,11 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 				} else {
 					// split prefix of subnode [A | d | B] where d is the index of the first different bit
 					// create new node with prefix A and only leave prefix B in old subnode
+					currentNode->beginWrite();
 					splitSubnodePrefix(currentIndex, differentBitAtPrefixIndex,
 							subnodePrefixLength, currentNode, content, entry,
 							tree);
+					currentNode->endWrite();
 
 					break;
 				}
@@ -884,10 +1366,17 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 				// a buffer was found that can be filled
 				EntryBuffer<DIM, WIDTH>* buffer = reinterpret_cast<EntryBuffer<DIM, WIDTH>*>(content.specialPointer);
 				assert (buffer && !buffer->full());
-				bool needFlush = buffer->insert(entry);
+				bool duplicate = false;
+				bool needFlush = buffer->insert(entry, &duplicate);
 #ifdef PRINT
 				cout << "insert into buffer (flush: " << needFlush << ")" << endl;
 #endif
+				// the entries of a buffer are counted by the node that holds it
+				inserted = !duplicate;
+				if (inserted) {
+					currentNode->incrementSubtreeEntries();
+				}
+
 				if (needFlush) {
 					flushSubtree(buffer, true);
 					++nFlushCountWithin;
@@ -903,33 +1392,51 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 					assert (buffer);
 				}
 
-				swapSuffixWithBuffer(currentIndex, currentNode, content, entry, buffer, tree);
+				currentNode->beginWrite();
+				inserted = swapSuffixWithBuffer(currentIndex, currentNode, content, entry, buffer, tree);
+				currentNode->endWrite();
+				if (inserted) {
+					// the buffer holds the existing and the new entry
+					currentNode->incrementSubtreeEntries();
+				} else {
+					pool->deallocate(buffer);
+				}
+
 				break;
 			} else {
 				// node entry does not exist:
 				// insert entry + suffix
+				currentNode->beginWrite();
 				Node<DIM>* adjustedNode = insertSuffix(currentIndex, hcAddress,
 						currentNode, entry, tree);
+				currentNode->endWrite();
 				assert(adjustedNode);
 				if (adjustedNode != currentNode && lastNode) {
 					// the subnode changed: store the new one and delete the old
+					lastNode->beginWrite();
 					lastNode->insertAtAddress(lastHcAddress, adjustedNode);
-					delete currentNode;
+					lastNode->endWrite();
+					retireNode(currentNode);
 					currentNode = adjustedNode;
 				} else if (adjustedNode != currentNode) {
 					// the root node changed
 					currentRoot = adjustedNode;
 					// update the root node
-					delete tree.root_;
-					tree.root_ = currentRoot;
+					replaceRoot(tree, currentRoot);
 				}
 
 				break;
 			}
 		}
+
+		if (inserted) {
+			for (size_t i = 0; i < nVisitedNodes; ++i) {
+				visitedNodes[i]->incrementSubtreeEntries();
+			}
+		}
 	}
 
-	// remove all buffers
+	// remove all buffers (the flushed subtrees count their entries)
 	pool->fullDeallocate();
 	delete pool;
 }
@@ -937,8 +1444,7 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::bulkInsert(
 template<unsigned int DIM, unsigned int WIDTH>
 bool DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
 		const Entry<DIM, WIDTH>& entry, PHTree<DIM, WIDTH>& tree,
-		EntryBufferPool<DIM, WIDTH>& pool, DeletedNodes<DIM>& deletedNodes,
-		EntryTreeMap<DIM,WIDTH>& entryTreeMap) {
+		EntryBufferPool<DIM, WIDTH>& pool, EntryTreeMap<DIM,WIDTH>& entryTreeMap) {
 
 #ifdef PRINT
 		cout << entry.id_ << ": " << flush;
@@ -964,6 +1470,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
 			entryTreeMap.getNextUndeletedNode(&highestNode, &index);
 			currentNode = (highestNode)? highestNode : tree.root_;
 			restart = !readLockBlocking(currentNode);
+			if (!restart) { markSubtreeChanged(currentNode); }
 		}
 
 		assert (!lastNode || !lastNode->removed);
@@ -986,6 +1493,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
 			// need to get read access to the subnode
 			Node<DIM>* subnode = content.subnode;
 			if (readLockBlocking(subnode)) {
+				markSubtreeChanged(subnode);
 				const size_t subnodePrefixLength = subnode->getPrefixLength();
 				bool prefixIncluded = true;
 				size_t differentBitAtPrefixIndex = -1;
@@ -1013,7 +1521,6 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
 					// create new node with prefix A and only leave prefix B in old subnode
 					if (writeLockBlocking(currentNode, lastNode)) {
 						splitSubnodePrefix(currentIndex, differentBitAtPrefixIndex, subnodePrefixLength, lastNode, content, entry, tree);
-						deletedNodes.add(currentNode);
 						writeUnlock(currentNode, lastNode);
 						break;
 					} else {
@@ -1091,7 +1598,7 @@ bool DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
 				Node<DIM>* adjustedNode = insertSuffix(currentIndex, hcAddress, currentNode, entry, tree);
 				assert(adjustedNode && (adjustedNode != currentNode));
 				lastNode->insertAtAddress(lastHcAddress, adjustedNode);
-				deletedNodes.add(currentNode);
+				retireNode(currentNode);
 				writeUnlock(currentNode, lastNode);
 				break;
 			} else {
@@ -1132,4 +1639,96 @@ void DynamicNodeOperationsUtil<DIM, WIDTH>::flushSubtree(
 
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::markSubtreeChanged(Node<DIM>* node) {
+	// most nodes were already marked: only reading the flag keeps the cache lines of shared nodes clean
+	if (!node->subtreeChanged) {
+		node->subtreeChanged = true;
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t DynamicNodeOperationsUtil<DIM, WIDTH>::recountChangedSubtreeEntries(Node<DIM>* node) {
+	if (!node->subtreeChanged) {
+		return node->getNumberOfSubtreeEntries();
+	}
+
+	NodeContentArrays<DIM> arrays;
+	node->getContentArrays(arrays);
+	size_t nEntries = 0;
+	for (unsigned long i = 0; i < arrays.nReferences; ++i) {
+		const uintptr_t reference = arrays.references[i];
+		if (reference == 0) {
+			// empty AHC slot
+			continue;
+		}
+
+		// flags in the 2 lowest bits: isPointer | isSuffix
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		assert ((isPointer || isSuffix) && "buffers need to be flushed before recounting");
+		if (isPointer && !isSuffix) {
+			nEntries += recountChangedSubtreeEntries(reinterpret_cast<Node<DIM>*>(reference & (~3uL)));
+		} else {
+			++nEntries;
+		}
+	}
+
+	node->setNumberOfSubtreeEntries(nEntries);
+	node->subtreeChanged = false;
+	return nEntries;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Mapping>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::mapIds(Node<DIM>* node, Mapping& mapping) {
+	NodeContentArrays<DIM> arrays;
+	node->getContentArrays(arrays);
+	for (unsigned long i = 0; i < arrays.nReferences; ++i) {
+		const uintptr_t reference = arrays.references[i];
+		if (reference == 0) {
+			// empty AHC slot
+			continue;
+		}
+
+		// flags in the 2 lowest bits: isPointer | isSuffix
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		assert ((isPointer || isSuffix) && "buffers need to be flushed before mapping IDs");
+		if (isPointer && !isSuffix) {
+			mapIds(reinterpret_cast<Node<DIM>*>(reference & (~3uL)), mapping);
+			continue;
+		}
+
+		// the entry stays at its address and only the ID changes
+		const unsigned long hcAddress = (arrays.isAhc)? i
+				: RangeQueryMaskUtil<DIM, WIDTH>::lookupLhcAddress(arrays.addresses, i);
+		const int id = reference >> 32;
+		const unsigned long suffixPart = (reference & ((-1uL) >> 32)) >> 2;
+		if (isPointer) {
+			node->insertAtAddress(hcAddress, (unsigned int) suffixPart, mapping(id));
+		} else {
+			node->insertAtAddress(hcAddress, suffixPart, mapping(id));
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::replaceRoot(PHTree<DIM, WIDTH>& tree, Node<DIM>* newRoot) {
+	assert (newRoot && newRoot != tree.root_);
+	Node<DIM>* oldRoot = tree.root_;
+	// readers that load the new root see all of its contents
+	__atomic_store_n(&tree.root_, newRoot, __ATOMIC_RELEASE);
+	retireNode(oldRoot);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void DynamicNodeOperationsUtil<DIM, WIDTH>::retireNode(Node<DIM>* node) {
+	// parallel writers that wait for the lock of the node restart
+	assert (!node->removed);
+	node->removed = true;
+	node->markObsolete();
+	EpochManager::retireOrDelete(node);
+}
+
 #endif /* SRC_UTIL_DYNAMICNODEOPERATIONSUTIL_H_ */
@@ -27,7 +27,8 @@ public:
 	EntryBuffer();
 	~EntryBuffer() {};
 
-	bool insert(const Entry<DIM, WIDTH>& entry);
+	// the duplicate flag is set if the buffer already contains the values of the entry (it is dropped by the flush)
+	bool insert(const Entry<DIM, WIDTH>& entry, bool* outDuplicate = NULL);
 	bool full() const;
 	bool empty() const;
 	size_t capacity() const;
@@ -54,7 +55,8 @@ private:
 	// - stores the lower matrix because LCP values of one row are stored together
 	unsigned int lcps_[capacity_ * (capacity_ + 1) / 2];
 	Entry<DIM, WIDTH> buffer_[capacity_];
-	bool insertCompleted_[capacity_];
+	// set after an entry is copied into its row: other inserting threads spin on it before comparing with the row
+	atomic<bool> insertCompleted_[capacity_];
 
 	// TODO validation only:
 	const Entry<DIM, WIDTH>* originals_[capacity_];
@@ -180,7 +182,7 @@ bool EntryBuffer<DIM, WIDTH>::empty() const {
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-bool EntryBuffer<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry) {
+bool EntryBuffer<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry, bool* outDuplicate) {
 	assert (suffixBits_ > 0 && suffixBits_ % DIM == 0);
 	assert (!flushing_);
 	const size_t i = nextIndex_++;
@@ -191,9 +193,9 @@ bool EntryBuffer<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry) {
 	assert (!insertCompleted_[i]);
 	// copy ID and necessary bits into the local buffer
 	MultiDimBitset<DIM>::duplicateLowestBitsAligned(entry.values_, suffixBits_, buffer_[i].values_);
-	insertCompleted_[i] = true; // TODO place after duplication?
 	buffer_[i].id_ = entry.id_;
 	originals_[i] = &entry;
+	insertCompleted_[i] = true;
 
 	// compare the new entry to all previously inserted entries
 	const unsigned int startIndexDim = WIDTH - (suffixBits_ / DIM);
@@ -210,6 +212,7 @@ bool EntryBuffer<DIM, WIDTH>::insert(const Entry<DIM, WIDTH>& entry) {
 		if (comp.first) { setLcp(i, i, -1u); }
 	}
 
+	if (outDuplicate) { (*outDuplicate) = (getLcp(i, i) == -1u); }
 	return true;
 }
 
@@ -342,6 +345,8 @@ Node<DIM>* EntryBuffer<DIM, WIDTH>::flushToSubtree() {
 			assert (nEntries <= (1uL << DIM));
 			Node<DIM>* currentNode = NodeTypeUtil<DIM>::
 					template buildNodeWithSuffixes<WIDTH>(prefixBits, nEntries, rowNSuffixes[row], suffixBits);
+			// the entries were already counted by the node that holds the buffer and its parents
+			size_t nSubtreeEntries = 0;
 			if (prefixBits > 0) {
 				const unsigned int currentBits = suffixBits + DIM + prefixBits;
 				assert (currentBits <= suffixBits_);
@@ -360,6 +365,7 @@ Node<DIM>* EntryBuffer<DIM, WIDTH>::flushToSubtree() {
 				if (rowNode[column]) {
 					// insert the subnode
 					currentNode->insertAtAddress(hcAddress, rowNode[column]);
+					nSubtreeEntries += rowNode[column]->getNumberOfSubtreeEntries();
 					 // TODO double???					setLcp(row, column, rowNextMax[row]);
 				} else {
 					// insert the suffix
@@ -376,12 +382,15 @@ Node<DIM>* EntryBuffer<DIM, WIDTH>::flushToSubtree() {
 						MultiDimBitset<DIM>::duplicateLowestBitsAligned(buffer_[column].values_, suffixBits, suffixStartBlock.first);
 						assert(currentNode->lookup(hcAddress, true).suffixStartBlock == suffixStartBlock.first);
 					}
+
+					++nSubtreeEntries;
 				}
 
 				rowEmpty[column] |= (row != column);
 				rowNode[column] = currentNode;
 			}
 
+			currentNode->setNumberOfSubtreeEntries(nSubtreeEntries);
 			setLcp(row, row, rowNextMax[row]); // TODO not needed?!
 		}
 
@@ -395,6 +404,8 @@ Node<DIM>* EntryBuffer<DIM, WIDTH>::flushToSubtree() {
 
 	assert ((this->node_->lookup(this->nodeHcAddress, true).exists)
 			&& (this->node_->lookup(this->nodeHcAddress, true).hasSpecialPointer));
+	// replacing the buffer reference is a single store that optimistic readers see after the whole subtree
+	atomic_thread_fence(memory_order_release);
 	this->node_->insertAtAddress(this->nodeHcAddress, rowNode[0]);
 
 #ifndef NDEBUG
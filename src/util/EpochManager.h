@@ -0,0 +1,299 @@
+/*
+ * EpochManager.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_EPOCHMANAGER_H_
+#define SRC_UTIL_EPOCHMANAGER_H_
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Epoch based reclamation of the nodes and suffix storages that writers replace while optimistic
+// readers might still access them. A thread announces the global epoch while it accesses the tree
+// (see EpochGuard) and a retired object is only freed after the global epoch advanced twice, i.e.
+// after every thread that was in an epoch at the time of the retirement left it. A thread that
+// leaves its outermost epoch hands its remaining retired objects over to the manager so that they
+// are freed by later exits instead of waiting for the thread's next epoch.
+class EpochManager {
+	friend class EpochGuard;
+public:
+	EpochManager();
+	EpochManager(const EpochManager& other) = delete;
+	// frees all retired objects (no thread may be in an epoch of the manager any more)
+	~EpochManager();
+
+	// the calling thread accesses shared objects until the matching exit() (calls can be nested):
+	// the outermost exit() frees the retired objects of all threads that no thread can access any more
+	inline void enter();
+	inline void exit();
+	// the calling thread does not access any object it read before (a quiescent point): announces the
+	// current epoch, tries to advance it and frees its retired objects that no thread can access any more
+	// (only if not nested)
+	inline void refresh();
+	// deletes the object as soon as no thread can access it any more
+	template <typename T>
+	void retire(const T* object);
+	// retires the object at the manager of the current thread's EpochGuard or deletes it at once if there is none
+	template <typename T>
+	static void retireOrDelete(const T* object);
+
+private:
+	struct RetiredObject {
+		const void* object;
+		void (*deleter)(const void*);
+		unsigned long epoch;
+	};
+
+	// state of one thread that is kept until the manager is destroyed
+	struct ThreadRecord {
+		// the announced global epoch or 0 if the thread is not in an epoch
+		std::atomic<unsigned long> epoch;
+		std::thread::id owner;
+		unsigned int depth;
+		unsigned int nRetirements;
+		// in ascending order of their epochs
+		std::deque<RetiredObject> retired;
+		ThreadRecord* next;
+		// keeps the announced epochs of different threads in different cache lines
+		char padding[64];
+	};
+
+	// a thread only tries to advance the global epoch every this many retirements
+	static const unsigned int retirementsPerAdvance = 64;
+
+	// distinguishes the managers in the per thread cache even if one is allocated at the address of a deleted one
+	const unsigned long id_;
+	std::atomic<unsigned long> globalEpoch_;
+	std::atomic<ThreadRecord*> records_;
+	// retired objects of threads that left their epochs (protected by the mutex)
+	std::mutex handedOverMutex_;
+	std::vector<RetiredObject> handedOver_;
+	std::atomic<size_t> nHandedOver_;
+
+	inline ThreadRecord* threadRecord();
+	// advances the global epoch if every thread that is in an epoch announced the current one
+	inline void tryAdvance();
+	// frees the retired objects of the thread that no thread can access any more
+	inline void freeRetired(ThreadRecord* record);
+	// moves the retired objects of the thread to the handed over ones and frees the ones that no thread
+	// can access any more
+	inline void handOver(ThreadRecord* record);
+	static inline unsigned long nextId();
+	static inline EpochManager*& currentManager();
+};
+
+// enters an epoch of the manager and makes it the one that EpochManager::retireOrDelete uses
+// until the scope is left (a NULL manager only disables the retirement)
+class EpochGuard {
+public:
+	explicit EpochGuard(EpochManager* manager) : manager_(manager), previous_(EpochManager::currentManager()) {
+		if (manager_) {
+			manager_->enter();
+		}
+		EpochManager::currentManager() = manager_;
+	}
+
+	~EpochGuard() {
+		EpochManager::currentManager() = previous_;
+		if (manager_) {
+			manager_->exit();
+		}
+	}
+
+	// see EpochManager::refresh()
+	void refresh() {
+		if (manager_) {
+			manager_->refresh();
+		}
+	}
+
+private:
+	EpochManager* manager_;
+	EpochManager* previous_;
+};
+
+#include <assert.h>
+
+using namespace std;
+
+inline EpochManager::EpochManager() : id_(nextId()), globalEpoch_(1), records_(NULL),
+		handedOverMutex_(), handedOver_(), nHandedOver_(0) {
+}
+
+inline EpochManager::~EpochManager() {
+	ThreadRecord* record = records_.load();
+	while (record) {
+		assert (record->depth == 0);
+		for (const RetiredObject& retired : record->retired) {
+			retired.deleter(retired.object);
+		}
+
+		ThreadRecord* next = record->next;
+		delete record;
+		record = next;
+	}
+
+	for (const RetiredObject& retired : handedOver_) {
+		retired.deleter(retired.object);
+	}
+}
+
+inline unsigned long EpochManager::nextId() {
+	static atomic<unsigned long> lastId(0);
+	return ++lastId;
+}
+
+inline EpochManager*& EpochManager::currentManager() {
+	static thread_local EpochManager* manager = NULL;
+	return manager;
+}
+
+EpochManager::ThreadRecord* EpochManager::threadRecord() {
+	// most threads work on a single tree at a time: remember the record of the last manager
+	static thread_local unsigned long cachedId = 0;
+	static thread_local ThreadRecord* cachedRecord = NULL;
+	if (cachedId == id_) {
+		return cachedRecord;
+	}
+
+	const thread::id self = this_thread::get_id();
+	ThreadRecord* record = records_.load(memory_order_acquire);
+	while (record && record->owner != self) {
+		record = record->next;
+	}
+
+	if (!record) {
+		// records are never removed so they can be pushed without a lock
+		record = new ThreadRecord();
+		record->epoch.store(0, memory_order_relaxed);
+		record->owner = self;
+		record->depth = 0;
+		record->nRetirements = 0;
+		record->next = records_.load(memory_order_relaxed);
+		while (!records_.compare_exchange_weak(record->next, record, memory_order_release, memory_order_relaxed)) {}
+	}
+
+	cachedId = id_;
+	cachedRecord = record;
+	return record;
+}
+
+void EpochManager::enter() {
+	ThreadRecord* record = threadRecord();
+	if (record->depth++ == 0) {
+		record->epoch.store(globalEpoch_.load(), memory_order_seq_cst);
+		// the announcement is visible before any shared object is read
+		atomic_thread_fence(memory_order_seq_cst);
+	}
+}
+
+void EpochManager::exit() {
+	ThreadRecord* record = threadRecord();
+	assert (record->depth > 0);
+	if (--record->depth == 0) {
+		record->epoch.store(0, memory_order_release);
+		if (!record->retired.empty() || nHandedOver_.load(memory_order_relaxed) > 0) {
+			// the thread might not enter an epoch of this manager again
+			handOver(record);
+		}
+	}
+}
+
+void EpochManager::refresh() {
+	ThreadRecord* record = threadRecord();
+	assert (record->depth > 0);
+	if (record->depth == 1) {
+		record->epoch.store(globalEpoch_.load(), memory_order_seq_cst);
+		atomic_thread_fence(memory_order_seq_cst);
+		tryAdvance();
+		freeRetired(record);
+	}
+}
+
+void EpochManager::tryAdvance() {
+	atomic_thread_fence(memory_order_seq_cst);
+	unsigned long epoch = globalEpoch_.load();
+	for (ThreadRecord* record = records_.load(memory_order_acquire); record; record = record->next) {
+		const unsigned long announced = record->epoch.load();
+		if (announced != 0 && announced != epoch) {
+			// a thread is still in the previous epoch
+			return;
+		}
+	}
+
+	// fails if another thread advanced the epoch in the meantime
+	globalEpoch_.compare_exchange_strong(epoch, epoch + 1);
+}
+
+void EpochManager::freeRetired(ThreadRecord* record) {
+	const unsigned long epoch = globalEpoch_.load();
+	while (!record->retired.empty() && record->retired.front().epoch + 2 <= epoch) {
+		const RetiredObject retired = record->retired.front();
+		record->retired.pop_front();
+		retired.deleter(retired.object);
+	}
+}
+
+void EpochManager::handOver(ThreadRecord* record) {
+	// objects retired in the current epoch are freed at once if no other thread is in an epoch
+	tryAdvance();
+	tryAdvance();
+	const unsigned long epoch = globalEpoch_.load();
+	vector<RetiredObject> expired;
+	{
+		lock_guard<mutex> lock(handedOverMutex_);
+		handedOver_.insert(handedOver_.end(), record->retired.begin(), record->retired.end());
+		record->retired.clear();
+		// the objects of different threads are not ordered by their epochs
+		size_t nKept = 0;
+		for (const RetiredObject& retired : handedOver_) {
+			if (retired.epoch + 2 <= epoch) {
+				expired.push_back(retired);
+			} else {
+				handedOver_[nKept++] = retired;
+			}
+		}
+
+		handedOver_.resize(nKept);
+		nHandedOver_.store(nKept, memory_order_relaxed);
+	}
+
+	// deleters might retire objects as well
+	for (const RetiredObject& retired : expired) {
+		retired.deleter(retired.object);
+	}
+}
+
+template <typename T>
+void EpochManager::retire(const T* object) {
+	assert (object);
+	ThreadRecord* record = threadRecord();
+	// the object was unlinked before the epoch is read
+	atomic_thread_fence(memory_order_seq_cst);
+	const unsigned long epoch = globalEpoch_.load();
+	auto deleter = [] (const void* retired) { delete static_cast<const T*>(retired); };
+	record->retired.push_back(RetiredObject{object, deleter, epoch});
+
+	if (++record->nRetirements % retirementsPerAdvance == 0) {
+		tryAdvance();
+		freeRetired(record);
+	}
+}
+
+template <typename T>
+void EpochManager::retireOrDelete(const T* object) {
+	EpochManager* manager = currentManager();
+	if (manager) {
+		manager->retire(object);
+	} else {
+		delete object;
+	}
+}
+
+#endif /* SRC_UTIL_EPOCHMANAGER_H_ */
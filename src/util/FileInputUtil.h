@@ -20,6 +20,10 @@ public:
 	// parses the file at the given location in the format 'float, float, float, ...\n...'
 	template <unsigned int DIM>
 	static std::vector<vector<unsigned long>>* readFloatEntries(string fileLocation, size_t decimals);
+
+	// converts a floating point value into the order preserving unsigned representation used by readFloatEntries and back
+	static unsigned long encodeFloat(double value);
+	static double decodeFloat(unsigned long encodedValue);
 };
 
 #include <iostream>
@@ -66,39 +70,52 @@ inline vector<unsigned long> getNextLineTokens(ifstream& stream) {
 	return tokens;
 }
 
-inline vector<unsigned long> getNextLineTokens(ifstream& stream, unsigned long decimals) {
+// the values are stored with the order preserving encoding so the number of decimals is not needed
+inline vector<unsigned long> getNextLineTokens(ifstream& stream, unsigned long) {
 	string line;
 	getline(stream, line);
 	stringstream lineStream(line);
 	string cell;
 	vector<unsigned long> tokens;
-	const long double decimalShift = pow10(decimals);
 
 	while (getline(lineStream, cell, ' ')) {
-		// TODO added a shift
-/*		const long double parsedToken = stold(cell) + 2000.0L;
-		const long double longToken = parsedToken * decimalShift;
-		if (parsedToken < 0.0)
-			throw runtime_error("Can only handle positive values: the offset is too small");
-		if (parsedToken > nextafter(ULONG_MAX, 0))
-			throw runtime_error("Overflow: The floating point value cannot be represented as a 64-bit integer.");
-		const unsigned long convertedToken = (unsigned long) longToken;*/
-		double value = stod(cell);
-		if (value == -0.0) {
-			value = 0.0;
-		}
-		unsigned long convertedToken;
-		memcpy(&convertedToken, &value, sizeof(value));
-		if (value < 0.0) {
-			convertedToken = (~convertedToken) | (1L << 63);
-		}
-
+		const double value = stod(cell);
+		const unsigned long convertedToken = FileInputUtil::encodeFloat(value);
 		tokens.push_back(convertedToken);
 	}
 
 	return tokens;
 }
 
+inline unsigned long FileInputUtil::encodeFloat(double value) {
+	if (value == -0.0) {
+		// -0.0 and +0.0 are equal and need the same representation
+		value = 0.0;
+	}
+	unsigned long convertedValue;
+	memcpy(&convertedValue, &value, sizeof(value));
+	// positive values get the sign bit and negative values are flipped completely
+	// so that the unsigned order is the same as the order of the doubles
+	if (convertedValue & (1uL << 63)) {
+		convertedValue = ~convertedValue;
+	} else {
+		convertedValue |= 1uL << 63;
+	}
+
+	return convertedValue;
+}
+
+inline double FileInputUtil::decodeFloat(unsigned long encodedValue) {
+	if (encodedValue & (1uL << 63)) {
+		encodedValue &= ~(1uL << 63);
+	} else {
+		encodedValue = ~encodedValue;
+	}
+	double value;
+	memcpy(&value, &encodedValue, sizeof(value));
+	return value;
+}
+
 template <unsigned int DIM>
 vector<vector<unsigned long>>* FileInputUtil::readEntries(string fileLocation) {
 
@@ -17,8 +17,10 @@
 #include <atomic>
 #include <boost/thread/barrier.hpp>
 #include <boost/thread/shared_mutex.hpp>
-#include "util/DeletedNodes.h"
 #include "util/EntryTreeMap.h"
+#include "util/NodeArena.h"
+#include "util/EpochManager.h"
+#include "util/ThreadPool.h"
 
 template <unsigned int DIM, unsigned int WIDTH>
 class PHTree;
@@ -36,18 +38,24 @@ enum InsertionOrder {
 
 enum InsertionApproach {
 	optimistic_locking,
-	buffered_bulk // DEFAULT
+	buffered_bulk,
+	// builds the whole tree at once if it is empty (see BulkLoadUtil) and uses buffered_bulk otherwise
+	bulk_load // DEFAULT
 };
 
+// Inserts batches of entries into a tree with all threads of a ThreadPool. The buffers and
+// per-thread state are kept between the batches so that a tree that is bound to a pool does
+// not allocate them for every parallel bulk insert. The workers never replace the root: it is only
+// expanded to the largest node type if a batch adds more root addresses than it has free slots and
+// then stays expanded for the following batches.
 template <unsigned int DIM, unsigned int WIDTH>
 class InsertionThreadPool {
 public:
 
-	InsertionThreadPool(size_t furtherThreads,
-			const std::vector<std::vector<unsigned long>>& values,
-			const std::vector<int>* ids, PHTree<DIM, WIDTH>* tree);
+	InsertionThreadPool(ThreadPool& threads, PHTree<DIM, WIDTH>* tree);
 	~InsertionThreadPool();
-	void joinPool();
+	// inserts all values (with the given IDs or their indices) and returns after all threads finished
+	void insert(const std::vector<std::vector<unsigned long>>& values, const std::vector<int>* ids);
 
 	const size_t fixRangeSize = 100;
 	static InsertionOrder order_;
@@ -58,24 +66,32 @@ public:
 private:
 
 	static const size_t INITIAL_JITTER_NANOS_FACTOR = 500;
+	// a thread passes a quiescent point of the tree's epochs after this many entries so that
+	// the nodes replaced in the meantime can be freed
+	static const size_t entriesPerEpoch = 256;
 
 	bool syncPhaseRequired_;
 	std::atomic<unsigned int> i_;
+	ThreadPool& threads_;
 	size_t nThreads_;
 	std::atomic<size_t> nRemainingThreads_;
 	boost::shared_mutex createBarriersMutex_;
 	boost::barrier* poolFlushBarrier_;
-	std::vector<std::thread> threads_;
-	std::vector<DeletedNodes<DIM>> deletedNodes_;
 	std::vector<EntryTreeMap<DIM,WIDTH>> entryMaps_;
 	std::vector<std::vector<double>> nanosPerEntryPerThread_;
-	const std::vector<std::vector<unsigned long>>& values_;
+	// the batch that is currently inserted
+	const std::vector<std::vector<unsigned long>>* values_;
 	const std::vector<int>* ids_;
 	PHTree<DIM, WIDTH>* tree_;
 	EntryBufferPool<DIM, WIDTH>* pool_;
 
 	void processNext(size_t threadIndex);
+	// true if the values need more new addresses in the root than it has free slots
+	bool rootNeedsExpansion(const std::vector<std::vector<unsigned long>>& values) const;
 	inline double insertBySelectedStrategy(size_t entryIndex, size_t threadIndex);
+	// inserts the entry and passes a quiescent point after every entriesPerEpoch entries of the thread
+	inline void insertAndRefreshEpoch(size_t entryIndex, size_t threadIndex,
+			EpochGuard& epochGuard, size_t* nEntriesInEpoch);
 
 	inline void handlePoolFlushSync(size_t threadIndex, bool lastFlush);
 	inline void handleDoneBySelectedStrategy(size_t threadIndex);
@@ -85,6 +101,7 @@ private:
 #include <iostream>
 #include <string>
 #include <fstream>
+#include <algorithm>
 
 #include "Entry.h"
 #include "util/DynamicNodeOperationsUtil.h"
@@ -96,46 +113,55 @@ using namespace std;
 template <unsigned int DIM, unsigned int WIDTH>
 InsertionOrder InsertionThreadPool<DIM, WIDTH>::order_ = range_per_thread;
 template <unsigned int DIM, unsigned int WIDTH>
-InsertionApproach InsertionThreadPool<DIM, WIDTH>::approach_ = buffered_bulk;
+InsertionApproach InsertionThreadPool<DIM, WIDTH>::approach_ = bulk_load;
 template <unsigned int DIM, unsigned int WIDTH>
 unsigned long InsertionThreadPool<DIM, WIDTH>::nFlushPhases = 0;
 
 template <unsigned int DIM, unsigned int WIDTH>
-InsertionThreadPool<DIM, WIDTH>::InsertionThreadPool(size_t furtherThreads,
-		const vector<vector<unsigned long>>& values,
-		const vector<int>* ids, PHTree<DIM, WIDTH>* tree)
-		: syncPhaseRequired_(false), i_(0), nThreads_(furtherThreads + 1), createBarriersMutex_(),
-		  poolFlushBarrier_(NULL), nanosPerEntryPerThread_(furtherThreads + 1), deletedNodes_(furtherThreads + 1),
-		  entryMaps_(furtherThreads + 1), values_(values),
-		  ids_(ids), tree_(tree), pool_(NULL) {
-	assert (values.size() > 0);
-	// create the biggest possible root node so there is no need to synchronize access on the root
-	Node<DIM>* oldRoot = tree->root_;
-	assert (oldRoot->getNumberOfContents() == 0);
-	Node<DIM>* newRoot = NodeTypeUtil<DIM>::copyIntoLargerNode(1uL << DIM, oldRoot);
-	tree->root_ = newRoot;
-	delete oldRoot;
-
+InsertionThreadPool<DIM, WIDTH>::InsertionThreadPool(ThreadPool& threads, PHTree<DIM, WIDTH>* tree)
+		: syncPhaseRequired_(false), i_(0), threads_(threads), nThreads_(threads.nThreads()), createBarriersMutex_(),
+		  poolFlushBarrier_(NULL), nanosPerEntryPerThread_(threads.nThreads()),
+		  entryMaps_(threads.nThreads()), values_(NULL),
+		  ids_(NULL), tree_(tree), pool_(NULL) {
 	poolFlushBarrier_ = new boost::barrier(nThreads_);
 	pool_ = new EntryBufferPool<DIM,WIDTH>(); // TODO only create if needed
-
-	DynamicNodeOperationsUtil<DIM,WIDTH>::nThreads = nThreads_;
-	nRemainingThreads_ = nThreads_;
-	threads_.reserve(furtherThreads);
-	for (unsigned tCount = 0; tCount < furtherThreads; ++tCount) {
-		threads_.emplace_back(&InsertionThreadPool<DIM,WIDTH>::processNext, this, tCount);
-	}
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
 InsertionThreadPool<DIM, WIDTH>::~InsertionThreadPool() {
-	for (auto &t : threads_) {
-		t.join();
+	delete poolFlushBarrier_;
+	delete pool_;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void InsertionThreadPool<DIM, WIDTH>::insert(const vector<vector<unsigned long>>& values, const vector<int>* ids) {
+	assert (!ids || ids->size() == values.size());
+	if (values.empty()) {
+		return;
 	}
 
+	values_ = &values;
+	ids_ = ids;
+	i_ = 0;
+	syncPhaseRequired_ = false;
+
+	// the calling thread is only in an epoch while it changes the root: it also runs a part of the
+	// job below and would otherwise keep the workers from freeing the nodes they retire
+	{
+		EpochGuard epochGuard(tree_->epochs_);
+		// create the biggest possible root node if needed so there is no need to synchronize access on the root
+		Node<DIM>* oldRoot = tree_->root_;
+		if (rootNeedsExpansion(values)) {
+			Node<DIM>* largeRoot = NodeTypeUtil<DIM>::copyIntoLargerNode(1uL << DIM, oldRoot);
+			DynamicNodeOperationsUtil<DIM,WIDTH>::replaceRoot(*tree_, largeRoot);
+		}
+	}
+
+	DynamicNodeOperationsUtil<DIM,WIDTH>::nThreads = nThreads_;
+	nRemainingThreads_ = nThreads_;
+	auto job = [this] (size_t threadIndex) { processNext(threadIndex); };
+	threads_.run(job);
 	assert (nRemainingThreads_ == 0);
-	delete poolFlushBarrier_;
-	delete pool_;
 
 	// TODO remove:
 	/*string path = "./plot/data/timeseries-" + to_string(nThreads_) + ".dat";
@@ -150,18 +176,38 @@ InsertionThreadPool<DIM, WIDTH>::~InsertionThreadPool() {
 		(*dataFile) << endl;
 	}
 	delete dataFile;*/
-	// shrink the root node again
-	size_t rootContents = tree_->root_->getNumberOfContents();
-	assert (rootContents > 0);
-	Node<DIM>* oldRoot = tree_->root_;
-	Node<DIM>* newRoot = NodeTypeUtil<DIM>::copyIntoLargerNode(rootContents, oldRoot);
-	tree_->root_ = newRoot;
-	delete oldRoot;
+	// leaving the epoch frees the nodes that the workers retired
+	EpochGuard epochGuard(tree_->epochs_);
+	assert (tree_->root_->getNumberOfContents() > 0);
+	// the workers only maintain the number of entries of the nodes they change and mark the ones they pass
+	DynamicNodeOperationsUtil<DIM, WIDTH>::recountChangedSubtreeEntries(tree_->root_);
+	values_ = NULL;
+	ids_ = NULL;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void InsertionThreadPool<DIM, WIDTH>::joinPool() {
-	processNext(threads_.size());
+bool InsertionThreadPool<DIM, WIDTH>::rootNeedsExpansion(const vector<vector<unsigned long>>& values) const {
+	const Node<DIM>* root = tree_->root_;
+	assert (root->getPrefixLength() == 0);
+	const size_t nFreeSlots = root->getMaximumNumberOfContents() - root->getNumberOfContents();
+	if (root->getMaximumNumberOfContents() == (1uL << DIM) || nFreeSlots >= values.size()) {
+		return false;
+	}
+
+	vector<unsigned long> newHcAddresses;
+	NodeAddressContent<DIM> content;
+	for (const vector<unsigned long>& value : values) {
+		const Entry<DIM, WIDTH> entry(value, 0);
+		const unsigned long hcAddress = MultiDimBitset<DIM>::interleaveBits(entry.values_, 0, DIM * WIDTH);
+		root->lookup(hcAddress, content, false);
+		if (!content.exists) {
+			newHcAddresses.push_back(hcAddress);
+		}
+	}
+
+	sort(newHcAddresses.begin(), newHcAddresses.end());
+	const size_t nNewHcAddresses = unique(newHcAddresses.begin(), newHcAddresses.end()) - newHcAddresses.begin();
+	return nNewHcAddresses > nFreeSlots;
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
@@ -177,7 +223,6 @@ void InsertionThreadPool<DIM, WIDTH>::handlePoolFlushSync(size_t threadIndex, bo
 	poolFlushBarrier_->wait();
 
 	pool_->doFullDeallocatePart(threadIndex, nThreads_);
-	deletedNodes_[threadIndex].deleteAll();
 	entryMaps_[threadIndex].clearMap();
 
 	if (responsibleForState) {
@@ -200,6 +245,7 @@ void InsertionThreadPool<DIM, WIDTH>::handlePoolFlushSync(size_t threadIndex, bo
 template <unsigned int DIM, unsigned int WIDTH>
 void InsertionThreadPool<DIM, WIDTH>::handleDoneBySelectedStrategy(size_t threadIndex) {
 	switch (approach_) {
+	case bulk_load:
 	case buffered_bulk:
 		handlePoolFlushSync(threadIndex, true);
 		while (nRemainingThreads_ > 0) {
@@ -221,20 +267,18 @@ double InsertionThreadPool<DIM, WIDTH>::insertBySelectedStrategy(size_t entryInd
 	clock_gettime(CLOCK_MONOTONIC, &start);
 
 	const int id = (ids_)? (*ids_)[entryIndex] : entryIndex;
-	const Entry<DIM, WIDTH>* entry = entryMaps_[threadIndex].createEntry(values_[entryIndex], id);
+	const Entry<DIM, WIDTH>* entry = entryMaps_[threadIndex].createEntry((*values_)[entryIndex], id);
 	switch (approach_) {
 	case optimistic_locking:
 		DynamicNodeOperationsUtil<DIM, WIDTH>::parallelInsert(*entry, *tree_);
 		break;
+	case bulk_load:
 	case buffered_bulk:
 		bool success = false;
 		while (!success) {
-			if (deletedNodes_[threadIndex].full()) {syncPhaseRequired_ = true; }
 			if (syncPhaseRequired_) { handlePoolFlushSync(threadIndex, false); }
 			success = DynamicNodeOperationsUtil<DIM, WIDTH>::parallelBulkInsert(
-					*entry, *tree_, *pool_,
-					deletedNodes_[threadIndex],
-					entryMaps_[threadIndex]);
+					*entry, *tree_, *pool_, entryMaps_[threadIndex]);
 			if (!success) { syncPhaseRequired_ = true; }
 		}
 		break;
@@ -246,10 +290,27 @@ double InsertionThreadPool<DIM, WIDTH>::insertBySelectedStrategy(size_t entryInd
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void InsertionThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
-
+void InsertionThreadPool<DIM, WIDTH>::insertAndRefreshEpoch(size_t entryIndex, size_t threadIndex,
+		EpochGuard& epochGuard, size_t* nEntriesInEpoch) {
+	insertBySelectedStrategy(entryIndex, threadIndex);
+	if (++(*nEntriesInEpoch) == entriesPerEpoch) {
+		// the nodes remembered for the next entry might be freed after the quiescent point
+		entryMaps_[threadIndex].clearMap();
+		epochGuard.refresh();
+		(*nEntriesInEpoch) = 0;
+	}
+}
 
-	const size_t size = values_.size();
+template <unsigned int DIM, unsigned int WIDTH>
+void InsertionThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
+	// nodes of all threads are placed in the arena of the tree but each thread caches free blocks
+	NodeArenaScope arenaScope(tree_->arena_);
+	NodeArenaThreadCache arenaCache(tree_->arena_);
+	// replaced nodes are retired to the thread's list instead of being deleted while other threads might access them
+	EpochGuard epochGuard(tree_->epochs_);
+	size_t nEntriesInEpoch = 0;
+
+	const size_t size = values_->size();
 	switch (order_) {
 	case sequential_entries:
 		{
@@ -257,7 +318,7 @@ void InsertionThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
 			while (i < size) {
 				i = i_++;
 				if (i < size) {
-					insertBySelectedStrategy(i, threadIndex);
+					insertAndRefreshEpoch(i, threadIndex, epochGuard, &nEntriesInEpoch);
 				}
 			}
 		}
@@ -269,8 +330,8 @@ void InsertionThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
 			const size_t end = min(size * (threadIndex + 1) / nThreads_, size);
 //			nanosPerEntryPerThread_[threadIndex].resize(end - start);
 			for (size_t i = start; i < end; ++i) {
-				double nanos = insertBySelectedStrategy(i, threadIndex);
-//				nanosPerEntryPerThread_[threadIndex][i - start] = nanos;
+				insertAndRefreshEpoch(i, threadIndex, epochGuard, &nEntriesInEpoch);
+//				nanosPerEntryPerThread_[threadIndex][i - start] = insertBySelectedStrategy(i, threadIndex);
 			}
 		}
 		break;
@@ -283,7 +344,7 @@ void InsertionThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
 				start = blockIndex * fixRangeSize;
 				end = min(start + fixRangeSize, size);
 				for (size_t i = start; i < end; ++i) {
-					insertBySelectedStrategy(i, threadIndex);
+					insertAndRefreshEpoch(i, threadIndex, epochGuard, &nEntriesInEpoch);
 				}
 			}
 		}
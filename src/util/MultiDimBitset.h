@@ -18,6 +18,8 @@ public:
 
 	template <unsigned int WIDTH>
 	static void toBitset(const std::vector<unsigned long> &values, unsigned long* const outStartBlock);
+	template <unsigned int WIDTH>
+	static void toBitset(const unsigned long* const values, unsigned long* const outStartBlock);
 
 	static std::pair<bool, size_t> compare(const unsigned long* const startBlock, unsigned int nBits,
 			size_t fromIndex, size_t toIndex, const unsigned long* const otherStartBlock, unsigned int otherNBits);
@@ -26,6 +28,7 @@ public:
 			unsigned int nBits, const unsigned long* const otherStartBlock);
 
 	static std::vector<unsigned long> toLongs(const unsigned long* const fromStartBlock, size_t nBits);
+	static void toLongs(const unsigned long* const fromStartBlock, size_t nBits, unsigned long* const outValues);
 
 	static unsigned long interleaveBits(const unsigned long* const fromStartBlock, size_t index, size_t nBits);
 
@@ -102,6 +105,13 @@ unsigned long MultiDimBitset<DIM>::initDimBlock() {
 template <unsigned int DIM>
 template <unsigned int WIDTH>
 void MultiDimBitset<DIM>::toBitset(const std::vector<unsigned long> &values, unsigned long* outStartBlock) {
+	assert (values.size() == DIM);
+	toBitset<WIDTH>(values.data(), outStartBlock);
+}
+
+template <unsigned int DIM>
+template <unsigned int WIDTH>
+void MultiDimBitset<DIM>::toBitset(const unsigned long* values, unsigned long* outStartBlock) {
 	//     example 2 Dim, 8 Bit: (    10   ,     5    )
 	//    binary representation: (0000 1010, 0000 0101)
 	//  				  index:    12    8    4    0
@@ -110,7 +120,6 @@ void MultiDimBitset<DIM>::toBitset(const std::vector<unsigned long> &values, uns
 	// second dimension (mask) : (1010 1010 1010 1010)
 
 	assert (sizeof (unsigned long) * 8 >= WIDTH);
-	assert (values.size() == DIM);
 	assert (outStartBlock[0] == 0);
 
 	if (DIM == 2) {
@@ -132,7 +141,7 @@ void MultiDimBitset<DIM>::toBitset(const std::vector<unsigned long> &values, uns
 		const unsigned long v3 = values[2];
 		const unsigned long inter1 = morton3D_64_encode(v1, v2, v3);
 		const unsigned long inter2 = morton3D_64_encode(v2 >> 21, v3 >> 21, v1 >> 22);
-		const unsigned long inter3 = morton3D_64_encode(v3 >> 42, v2 >> 43, v1 >> 43);
+		const unsigned long inter3 = morton3D_64_encode(v3 >> 42, v1 >> 43, v2 >> 43);
 		*outStartBlock = inter1;
 		if (WIDTH > 21) {
 			*(outStartBlock + 1) = inter2;
@@ -218,26 +227,38 @@ void MultiDimBitset<DIM>::toBitset(const std::vector<unsigned long> &values, uns
 		}
 	}
 
-	assert(toLongs(outStartBlock, DIM * WIDTH) == values);
+	assert(toLongs(outStartBlock, DIM * WIDTH) == std::vector<unsigned long>(values, values + DIM));
 }
 
 template <unsigned int DIM>
 vector<unsigned long> MultiDimBitset<DIM>::toLongs(const unsigned long* fromStartBlock, size_t nBits) {
 
 		vector<unsigned long> numericalValues(DIM, 0);
-		const size_t bitLength = nBits / DIM;
-		// TODO change loop order?
-		for (size_t i = 0; i < bitLength; ++i) {
-			for (size_t d = 0; d < DIM; ++d) {
-				const size_t blockIndex = (DIM * i + d) / bitsPerBlock;
-				const size_t bitIndex = (DIM * i + d) % bitsPerBlock;
-				const size_t block = fromStartBlock[blockIndex];
-				const size_t bit = (block >> bitIndex) & 1;
-				numericalValues[d] += bit << i;
-			}
+		toLongs(fromStartBlock, nBits, numericalValues.data());
+		return numericalValues;
+}
+
+template <unsigned int DIM>
+void MultiDimBitset<DIM>::toLongs(const unsigned long* fromStartBlock, size_t nBits, unsigned long* outValues) {
+
+		for (size_t d = 0; d < DIM; ++d) {
+			outValues[d] = 0;
 		}
 
-		return numericalValues;
+		// walk the bits block by block: bit (DIM * i + d) is bit i of dimension d
+		size_t d = 0;
+		size_t i = 0;
+		for (size_t blockStart = 0; blockStart < nBits; blockStart += bitsPerBlock) {
+			const unsigned long block = fromStartBlock[blockStart / bitsPerBlock];
+			const size_t bitsInBlock = (nBits - blockStart < bitsPerBlock)? nBits - blockStart : bitsPerBlock;
+			for (size_t bitIndex = 0; bitIndex < bitsInBlock; ++bitIndex) {
+				outValues[d] |= ((block >> bitIndex) & 1uL) << i;
+				if (++d == DIM) {
+					d = 0;
+					++i;
+				}
+			}
+		}
 }
 
 template <unsigned int DIM>
@@ -0,0 +1,409 @@
+/*
+ * NodeArena.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_NODEARENA_H_
+#define SRC_UTIL_NODEARENA_H_
+
+#include <cstdint>
+#include <cstdlib>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <assert.h>
+
+class NodeArenaThreadCache;
+
+// Size class allocator for nodes and suffix storages. Blocks are taken from large aligned
+// chunks and freed blocks are kept in one free list per size class. Each PH-Tree owns an
+// arena and all of its chunks are freed at once when the arena is destroyed.
+// Allocations use the arena of the current thread (see NodeArenaScope) while deallocations
+// return the block to the arena it was taken from.
+class NodeArena {
+	friend class NodeArenaScope;
+	friend class NodeArenaThreadCache;
+public:
+	NodeArena() : chunks_(NULL), chunkPosition_(NULL), chunkEnd_(NULL),
+			largeBlocks_(NULL), freeLists_() { }
+	// frees all memory of the arena without calling the destructors of the contained objects
+	~NodeArena();
+
+	static inline void* allocate(size_t nBytes);
+	static inline void deallocate(void* block, size_t nBytes);
+	// the arena that is used for allocations of the current thread
+	static inline NodeArena* current();
+
+private:
+	static const size_t CHUNK_SIZE = 1uL << 20;
+	static const size_t CHUNK_HEADER_SIZE = 64;
+	static const size_t LARGE_HEADER_SIZE = 32;
+	static const size_t MIN_BLOCK_SIZE = 16;
+	// 16 byte steps up to 1KB and 4 steps per power of 2 up to the maximum block size
+	static const size_t MAX_BLOCK_SIZE = 1uL << 16;
+	static const unsigned int N_SIZE_CLASSES = 64 + 4 * 6;
+
+	struct FreeBlock {
+		FreeBlock* next;
+	};
+
+	struct ChunkHeader {
+		NodeArena* arena;
+		ChunkHeader* next;
+	};
+
+	// larger blocks are directly allocated and chained to be freed with the arena
+	struct LargeBlockHeader {
+		NodeArena* arena;
+		LargeBlockHeader* previous;
+		LargeBlockHeader* next;
+	};
+
+	// short critical sections only: spin instead of sleeping
+	std::atomic_flag lock_ = ATOMIC_FLAG_INIT;
+	ChunkHeader* chunks_;
+	char* chunkPosition_;
+	char* chunkEnd_;
+	LargeBlockHeader* largeBlocks_;
+	FreeBlock* freeLists_[N_SIZE_CLASSES];
+
+	static inline unsigned int sizeClassOf(size_t nBytes);
+	static inline size_t blockSizeOf(unsigned int sizeClass);
+	static inline NodeArena* ownerOf(void* block);
+	static inline NodeArena*& currentArena();
+	static inline NodeArenaThreadCache*& currentThreadCache();
+	static inline NodeArena* defaultArena();
+
+	inline void* allocateBlock(unsigned int sizeClass);
+	inline void deallocateBlock(void* block, unsigned int sizeClass);
+	// moves up to n free blocks of the size class to the given list (locks once)
+	inline unsigned int allocateBlocks(unsigned int sizeClass, unsigned int n, FreeBlock** outList);
+	// takes back a list of blocks of the size class (locks once)
+	inline void deallocateBlocks(unsigned int sizeClass, FreeBlock* first, FreeBlock* last);
+	inline void* allocateBlockUnlocked(unsigned int sizeClass);
+	inline void* allocateLarge(size_t nBytes);
+	inline void deallocateLarge(void* block);
+	inline void lock();
+	inline void unlock();
+};
+
+// sets the arena that is used for node allocations of the current thread until the scope is left
+class NodeArenaScope {
+public:
+	explicit NodeArenaScope(NodeArena* arena) : previous_(NodeArena::currentArena()) {
+		NodeArena::currentArena() = arena;
+	}
+
+	~NodeArenaScope() {
+		NodeArena::currentArena() = previous_;
+	}
+
+private:
+	NodeArena* previous_;
+};
+
+// Keeps free blocks of one arena for the current thread so parallel inserts only lock the
+// arena once per batch of blocks. All blocks are returned to the arena on destruction.
+class NodeArenaThreadCache {
+	friend class NodeArena;
+public:
+	explicit NodeArenaThreadCache(NodeArena* arena);
+	~NodeArenaThreadCache();
+
+private:
+	static const unsigned int MAX_BATCH_SIZE = 32;
+	static const size_t BATCH_BYTES = 1uL << 13;
+
+	NodeArena* arena_;
+	NodeArenaThreadCache* previous_;
+	NodeArena::FreeBlock* freeLists_[NodeArena::N_SIZE_CLASSES];
+	unsigned int nFree_[NodeArena::N_SIZE_CLASSES];
+
+	static inline unsigned int batchSizeOf(unsigned int sizeClass);
+	inline void* allocate(unsigned int sizeClass);
+	inline void deallocate(void* block, unsigned int sizeClass);
+	inline void returnBlocks(unsigned int sizeClass, unsigned int n);
+};
+
+inline NodeArena::~NodeArena() {
+	while (chunks_) {
+		ChunkHeader* next = chunks_->next;
+		free(chunks_);
+		chunks_ = next;
+	}
+
+	while (largeBlocks_) {
+		LargeBlockHeader* next = largeBlocks_->next;
+		::operator delete(largeBlocks_);
+		largeBlocks_ = next;
+	}
+}
+
+void* NodeArena::allocate(size_t nBytes) {
+	NodeArena* arena = current();
+	if (nBytes > MAX_BLOCK_SIZE) {
+		return arena->allocateLarge(nBytes);
+	}
+
+	const unsigned int sizeClass = sizeClassOf(nBytes);
+	NodeArenaThreadCache* cache = currentThreadCache();
+	if (cache && cache->arena_ == arena) {
+		return cache->allocate(sizeClass);
+	}
+
+	return arena->allocateBlock(sizeClass);
+}
+
+void NodeArena::deallocate(void* block, size_t nBytes) {
+	if (!block) {
+		return;
+	}
+
+	if (nBytes > MAX_BLOCK_SIZE) {
+		LargeBlockHeader* header = reinterpret_cast<LargeBlockHeader*>(
+				static_cast<char*>(block) - LARGE_HEADER_SIZE);
+		header->arena->deallocateLarge(block);
+		return;
+	}
+
+	const unsigned int sizeClass = sizeClassOf(nBytes);
+	NodeArena* arena = ownerOf(block);
+	NodeArenaThreadCache* cache = currentThreadCache();
+	if (cache && cache->arena_ == arena) {
+		cache->deallocate(block, sizeClass);
+	} else {
+		arena->deallocateBlock(block, sizeClass);
+	}
+}
+
+NodeArena* NodeArena::current() {
+	NodeArena* arena = currentArena();
+	return (arena)? arena : defaultArena();
+}
+
+unsigned int NodeArena::sizeClassOf(size_t nBytes) {
+	assert (nBytes <= MAX_BLOCK_SIZE);
+	if (nBytes <= 1024) {
+		return (nBytes == 0)? 0 : (nBytes - 1) / MIN_BLOCK_SIZE;
+	}
+
+	// nBytes in (2^p, 2^(p+1)] is mapped to one of 4 steps of size 2^(p-2)
+	const unsigned int p = 8 * sizeof (unsigned long) - 1 - __builtin_clzl(nBytes - 1);
+	const unsigned int step = ((nBytes - 1) >> (p - 2)) - 4;
+	return 64 + 4 * (p - 10) + step;
+}
+
+size_t NodeArena::blockSizeOf(unsigned int sizeClass) {
+	assert (sizeClass < N_SIZE_CLASSES);
+	if (sizeClass < 64) {
+		return (sizeClass + 1) * MIN_BLOCK_SIZE;
+	}
+
+	const unsigned int p = 10 + (sizeClass - 64) / 4;
+	const unsigned int step = (sizeClass - 64) % 4;
+	return (size_t(step) + 5) << (p - 2);
+}
+
+NodeArena* NodeArena::ownerOf(void* block) {
+	const uintptr_t chunkStart = reinterpret_cast<uintptr_t>(block) & ~(uintptr_t(CHUNK_SIZE) - 1);
+	return reinterpret_cast<ChunkHeader*>(chunkStart)->arena;
+}
+
+NodeArena*& NodeArena::currentArena() {
+	static thread_local NodeArena* arena = NULL;
+	return arena;
+}
+
+NodeArenaThreadCache*& NodeArena::currentThreadCache() {
+	static thread_local NodeArenaThreadCache* cache = NULL;
+	return cache;
+}
+
+NodeArena* NodeArena::defaultArena() {
+	// used outside of tree operations and never freed
+	static NodeArena* arena = new NodeArena();
+	return arena;
+}
+
+void* NodeArena::allocateBlock(unsigned int sizeClass) {
+	lock();
+	void* block = allocateBlockUnlocked(sizeClass);
+	unlock();
+	return block;
+}
+
+void NodeArena::deallocateBlock(void* block, unsigned int sizeClass) {
+	assert (ownerOf(block) == this);
+	FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+	lock();
+	freeBlock->next = freeLists_[sizeClass];
+	freeLists_[sizeClass] = freeBlock;
+	unlock();
+}
+
+unsigned int NodeArena::allocateBlocks(unsigned int sizeClass, unsigned int n, FreeBlock** outList) {
+	FreeBlock* list = (*outList);
+	lock();
+	for (unsigned i = 0; i < n; ++i) {
+		FreeBlock* block = static_cast<FreeBlock*>(allocateBlockUnlocked(sizeClass));
+		block->next = list;
+		list = block;
+	}
+	unlock();
+
+	(*outList) = list;
+	return n;
+}
+
+void NodeArena::deallocateBlocks(unsigned int sizeClass, FreeBlock* first, FreeBlock* last) {
+	assert (first && last && !last->next);
+	lock();
+	last->next = freeLists_[sizeClass];
+	freeLists_[sizeClass] = first;
+	unlock();
+}
+
+void* NodeArena::allocateBlockUnlocked(unsigned int sizeClass) {
+	FreeBlock* freeBlock = freeLists_[sizeClass];
+	if (freeBlock) {
+		freeLists_[sizeClass] = freeBlock->next;
+		return freeBlock;
+	}
+
+	const size_t blockSize = blockSizeOf(sizeClass);
+	if (chunkPosition_ + blockSize > chunkEnd_) {
+		// the rest of the current chunk is not used
+		void* chunk = NULL;
+		if (posix_memalign(&chunk, CHUNK_SIZE, CHUNK_SIZE) != 0) {
+			unlock();
+			throw std::bad_alloc();
+		}
+
+		ChunkHeader* header = static_cast<ChunkHeader*>(chunk);
+		header->arena = this;
+		header->next = chunks_;
+		chunks_ = header;
+		chunkPosition_ = static_cast<char*>(chunk) + CHUNK_HEADER_SIZE;
+		chunkEnd_ = static_cast<char*>(chunk) + CHUNK_SIZE;
+	}
+
+	void* block = chunkPosition_;
+	chunkPosition_ += blockSize;
+	return block;
+}
+
+void* NodeArena::allocateLarge(size_t nBytes) {
+	char* memory = static_cast<char*>(::operator new(nBytes + LARGE_HEADER_SIZE));
+	LargeBlockHeader* header = reinterpret_cast<LargeBlockHeader*>(memory);
+	header->arena = this;
+	header->previous = NULL;
+	lock();
+	header->next = largeBlocks_;
+	if (largeBlocks_) {
+		largeBlocks_->previous = header;
+	}
+	largeBlocks_ = header;
+	unlock();
+	return memory + LARGE_HEADER_SIZE;
+}
+
+void NodeArena::deallocateLarge(void* block) {
+	LargeBlockHeader* header = reinterpret_cast<LargeBlockHeader*>(
+			static_cast<char*>(block) - LARGE_HEADER_SIZE);
+	assert (header->arena == this);
+	lock();
+	if (header->previous) {
+		header->previous->next = header->next;
+	} else {
+		assert (largeBlocks_ == header);
+		largeBlocks_ = header->next;
+	}
+	if (header->next) {
+		header->next->previous = header->previous;
+	}
+	unlock();
+
+	::operator delete(header);
+}
+
+void NodeArena::lock() {
+	while (lock_.test_and_set(std::memory_order_acquire)) {
+		// the owner might have been preempted
+		std::this_thread::yield();
+	}
+}
+
+void NodeArena::unlock() {
+	lock_.clear(std::memory_order_release);
+}
+
+inline NodeArenaThreadCache::NodeArenaThreadCache(NodeArena* arena)
+		: arena_(arena), previous_(NodeArena::currentThreadCache()), freeLists_(), nFree_() {
+	assert (arena);
+	NodeArena::currentThreadCache() = this;
+}
+
+inline NodeArenaThreadCache::~NodeArenaThreadCache() {
+	assert (NodeArena::currentThreadCache() == this);
+	for (unsigned sizeClass = 0; sizeClass < NodeArena::N_SIZE_CLASSES; ++sizeClass) {
+		if (nFree_[sizeClass] > 0) {
+			returnBlocks(sizeClass, nFree_[sizeClass]);
+		}
+	}
+
+	NodeArena::currentThreadCache() = previous_;
+}
+
+unsigned int NodeArenaThreadCache::batchSizeOf(unsigned int sizeClass) {
+	const size_t blocks = BATCH_BYTES / NodeArena::blockSizeOf(sizeClass);
+	if (blocks == 0) {
+		return 1;
+	} else if (blocks > MAX_BATCH_SIZE) {
+		return MAX_BATCH_SIZE;
+	}
+
+	return blocks;
+}
+
+void* NodeArenaThreadCache::allocate(unsigned int sizeClass) {
+	if (nFree_[sizeClass] == 0) {
+		nFree_[sizeClass] = arena_->allocateBlocks(sizeClass, batchSizeOf(sizeClass), &freeLists_[sizeClass]);
+	}
+
+	assert (nFree_[sizeClass] > 0 && freeLists_[sizeClass]);
+	NodeArena::FreeBlock* block = freeLists_[sizeClass];
+	freeLists_[sizeClass] = block->next;
+	--nFree_[sizeClass];
+	return block;
+}
+
+void NodeArenaThreadCache::deallocate(void* block, unsigned int sizeClass) {
+	NodeArena::FreeBlock* freeBlock = static_cast<NodeArena::FreeBlock*>(block);
+	freeBlock->next = freeLists_[sizeClass];
+	freeLists_[sizeClass] = freeBlock;
+	++nFree_[sizeClass];
+
+	const unsigned int batchSize = batchSizeOf(sizeClass);
+	if (nFree_[sizeClass] > 2 * batchSize) {
+		// keep one batch for the following allocations
+		returnBlocks(sizeClass, nFree_[sizeClass] - batchSize);
+	}
+}
+
+void NodeArenaThreadCache::returnBlocks(unsigned int sizeClass, unsigned int n) {
+	assert (0 < n && n <= nFree_[sizeClass]);
+	NodeArena::FreeBlock* first = freeLists_[sizeClass];
+	NodeArena::FreeBlock* last = first;
+	for (unsigned i = 1; i < n; ++i) {
+		last = last->next;
+	}
+
+	freeLists_[sizeClass] = last->next;
+	last->next = NULL;
+	nFree_[sizeClass] -= n;
+	arena_->deallocateBlocks(sizeClass, first, last);
+}
+
+#endif /* SRC_UTIL_NODEARENA_H_ */
@@ -13,6 +13,7 @@
 #include "nodes/AHC.h"
 #include "nodes/SuffixStorage.h"
 #include "util/TEntryBuffer.h"
+#include "util/EpochManager.h"
 
 template <unsigned int DIM>
 class Node;
@@ -20,6 +21,11 @@ class Node;
 template <unsigned int DIM>
 class NodeTypeUtil {
 public:
+	// the longest prefix (in blocks of unsigned long) that a node can store
+	static const unsigned int maxPrefixBlocks = 64;
+	// a node is only shrunk if the smaller node type can hold this many times its contents
+	static const size_t shrinkSlackFactor = 2;
+
 	template <unsigned int WIDTH>
 	static Node<DIM>* buildNodeWithSuffixes(size_t prefixBits, size_t nDirectInserts, size_t nSuffixes, unsigned int suffixBits) {
 		assert (suffixBits < DIM * WIDTH && (suffixBits % DIM == 0));
@@ -45,10 +51,13 @@ public:
 		assert (!oldStorage || suffixes->getNMaxStorageBlocks() > oldStorage->getNMaxStorageBlocks());
 		if (oldStorage) {
 			suffixes->copyFrom(*oldStorage);
-			delete oldStorage;
 		}
 
 		node->setSuffixStorage(suffixes);
+		if (oldStorage) {
+			// optimistic readers of the node might still read the old storage
+			EpochManager::retireOrDelete(oldStorage);
+		}
 	}
 
 	template <unsigned int WIDTH>
@@ -69,7 +78,7 @@ public:
 				}
 
 				node->setSuffixStorage(shrinkedStorage);
-				delete oldStorage;
+				EpochManager::retireOrDelete(oldStorage);
 			}
 		}
 	}
@@ -83,6 +92,48 @@ public:
 	}
 
 	static Node<DIM>* copyIntoLargerNode(size_t newNContents, const Node<DIM>* nodeToCopy) {
+		assert (newNContents > nodeToCopy->getNumberOfContents());
+		return copyWithPrefix(newNContents, nodeToCopy);
+	}
+
+	// copy of the same size that has its own suffix storage: the given node remains unchanged
+	// and can still be read while the copy is changed (see CopyOnWriteUtil)
+	template <unsigned int WIDTH>
+	static Node<DIM>* duplicateNode(const Node<DIM>* nodeToCopy) {
+		Node<DIM>* copy = copyWithPrefix(nodeToCopy->getMaximumNumberOfContents(), nodeToCopy);
+		const TSuffixStorage* storage = nodeToCopy->getSuffixStorage();
+		if (storage) {
+			// the references store suffix indices that remain valid in the duplicated storage
+			// (the storage types are rounded up so the size can be larger than needed for all suffixes)
+			const unsigned int maxSuffixBits = (WIDTH - 1) * DIM;
+			const unsigned int maxSuffixBlocks = (1 + (maxSuffixBits - 1) / (8 * sizeof (unsigned long))) * (1u << DIM);
+			const unsigned int suffixBlocks = min(storage->getNMaxStorageBlocks(), maxSuffixBlocks);
+			TSuffixStorage* duplicate = createSuffixStorage<WIDTH>(suffixBlocks);
+			duplicate->copyFrom(*storage);
+			copy->setSuffixStorage(duplicate);
+		}
+
+		return copy;
+	}
+
+	// returns the given node if there is no smaller node type for its contents
+	// or a smaller copy otherwise (the caller needs to replace and delete the old node)
+	static Node<DIM>* shrinkNodeIfPossible(Node<DIM>* node) {
+		assert (node);
+		const size_t nContents = node->getNumberOfContents();
+		// the smaller node type must have room for as many contents again so that alternating
+		// inserts and removals at a threshold do not copy the node back and forth
+		const size_t nContentsWithSlack = shrinkSlackFactor * nContents;
+		if (nContents == 0 || determineMaximumNumberOfContents(nContentsWithSlack) >= node->getMaximumNumberOfContents()) {
+			return node;
+		}
+
+		return copyWithPrefix(nContentsWithSlack, node);
+	}
+
+private:
+
+	static Node<DIM>* copyWithPrefix(size_t newNContents, const Node<DIM>* nodeToCopy) {
 		// TODO make more efficient by not using iterators and a bulk insert
 		const size_t prefixLength = nodeToCopy->getPrefixLength();
 		Node<DIM>* copy = buildNode(prefixLength * DIM, newNContents);
@@ -95,8 +146,6 @@ public:
 		return copy;
 	}
 
-private:
-
 	template <unsigned int WIDTH>
 	inline static bool canShrinkSuffixStorage(unsigned int newRequiredSuffixBlocks, unsigned int oldSuffixBlocks, bool* empty) {
 		assert (newRequiredSuffixBlocks < oldSuffixBlocks);
@@ -195,6 +244,8 @@ private:
 		// copy suffixes
 		assert (!to.getSuffixStorage());
 		to.copySuffixStorageFrom(from);
+		to.setNumberOfSubtreeEntries(from.getNumberOfSubtreeEntries());
+		to.subtreeChanged = from.subtreeChanged;
 
 		// TODO make more efficient by not using iterators and a bulk insert
 		// copy node contents
@@ -220,19 +271,58 @@ private:
 		delete endIt;
 	}
 
-	template <unsigned int PREF_BLOCKS>
-	inline static Node<DIM>* determineNodeType(size_t prefixBits, size_t nDirectInserts) {
+	// node types by their capacities: LHCs for a share of the addresses (or two contents) and the AHC
+	enum NodeSize { lhc_two, lhc_10_percent, lhc_20_percent, lhc_35_percent, lhc_50_percent, lhc_75_percent, ahc };
+
+	// the smallest node type for the number of contents (used for new and shrunk nodes alike)
+	inline static NodeSize determineNodeSize(size_t nDirectInserts) {
 		assert (nDirectInserts > 0);
-		const size_t prefixLength = prefixBits / DIM;
 		// TODO use threshold depending on which node is smaller
 		const double switchTypeAtLoadRatio = 0.75;
-		if (float(nDirectInserts) / (1uL << DIM) < switchTypeAtLoadRatio) {
-			return determineLhcSize<PREF_BLOCKS>(prefixLength, nDirectInserts);
+		const float insertToRatio = float(nDirectInserts) / (1uL << DIM);
+		if (insertToRatio >= switchTypeAtLoadRatio) {
+			return ahc;
+		} else if (nDirectInserts < 3) {
+			return lhc_two;
+		} else if (insertToRatio < 0.1) {
+			return lhc_10_percent;
+		} else if (insertToRatio < 0.2) {
+			return lhc_20_percent;
+		} else if (insertToRatio < 0.35) {
+			return lhc_35_percent;
+		} else if (insertToRatio < 0.5) {
+			return lhc_50_percent;
 		} else {
-			return new AHC<DIM, PREF_BLOCKS>(prefixLength);
+			return lhc_75_percent;
 		}
 	}
 
+	static constexpr unsigned int capacity(NodeSize size) {
+		return (size == lhc_two)? 2
+				: (size == lhc_10_percent)? 1 + 10 * (1 << DIM) / 100
+				: (size == lhc_20_percent)? 1 + 20 * (1 << DIM) / 100
+				: (size == lhc_35_percent)? 1 + 35 * (1 << DIM) / 100
+				: (size == lhc_50_percent)? 1 + 50 * (1 << DIM) / 100
+				: (size == lhc_75_percent)? 1 + 75 * (1 << DIM) / 100
+				: (1 << DIM);
+	}
+
+	template <unsigned int PREF_BLOCKS>
+	inline static Node<DIM>* determineNodeType(size_t prefixBits, size_t nDirectInserts) {
+		const size_t prefixLength = prefixBits / DIM;
+		switch (determineNodeSize(nDirectInserts)) {
+		case lhc_two: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_two)>(prefixLength);
+		case lhc_10_percent: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_10_percent)>(prefixLength);
+		case lhc_20_percent: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_20_percent)>(prefixLength);
+		case lhc_35_percent: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_35_percent)>(prefixLength);
+		case lhc_50_percent: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_50_percent)>(prefixLength);
+		case lhc_75_percent: return new LHC<DIM, PREF_BLOCKS, capacity(lhc_75_percent)>(prefixLength);
+		case ahc: return new AHC<DIM, PREF_BLOCKS>(prefixLength);
+		}
+
+		throw runtime_error("unknown node size");
+	}
+
 	inline static Node<DIM>* buildNode(size_t prefixBits, size_t nDirectInserts) {
 			const size_t prefixBlocks = (prefixBits > 0)? 1 + ((prefixBits - 1) / (8 * sizeof (unsigned long))) : 0;
 			switch (prefixBlocks) {
@@ -247,33 +337,23 @@ private:
 			case 8: return determineNodeType<8>(prefixBits, nDirectInserts);
 			case 9: return determineNodeType<9>(prefixBits, nDirectInserts);
 			case 10: return determineNodeType<10>(prefixBits, nDirectInserts);
-			default: throw runtime_error("Only supports up to 10 prefix blocks right now.");
 			}
-		}
 
-	template<unsigned int PREF_BLOCKS>
-	inline static Node<DIM>* determineLhcSize(size_t prefixLength,
-			size_t nDirectInserts) {
-
-		assert(nDirectInserts > 0);
-		const float insertToRatio = float(nDirectInserts) / (1u << DIM);
-		assert(0 < insertToRatio && insertToRatio < 1);
+			// long prefixes only occur with many dimensions or long values (e.g. HighDimPHTree)
+			// so they share fewer node types with some unused prefix space
+			if (prefixBlocks <= 16) {
+				return determineNodeType<16>(prefixBits, nDirectInserts);
+			} else if (prefixBlocks <= 32) {
+				return determineNodeType<32>(prefixBits, nDirectInserts);
+			} else if (prefixBlocks <= maxPrefixBlocks) {
+				return determineNodeType<maxPrefixBlocks>(prefixBits, nDirectInserts);
+			}
 
-		if (nDirectInserts < 3) {
-			return new LHC<DIM, PREF_BLOCKS, 2>(prefixLength);
-		} else if (insertToRatio < 0.1) {
-			return new LHC<DIM, PREF_BLOCKS, 1 + 10 * (1 << DIM) / 100>(prefixLength);
-		} else if (insertToRatio < 0.2) {
-			return new LHC<DIM, PREF_BLOCKS, 1 + 20 * (1 << DIM) / 100>(prefixLength);
-		} else if (insertToRatio < 0.35) {
-			return new LHC<DIM, PREF_BLOCKS, 1 + 35 * (1 << DIM) / 100>(prefixLength);
-		} else if (insertToRatio < 0.5) {
-			return new LHC<DIM, PREF_BLOCKS, 1 + 50 * (1 << DIM) / 100>(prefixLength);
-		} else if (insertToRatio < 0.75) {
-			return new LHC<DIM, PREF_BLOCKS, 1 + 75 * (1 << DIM) / 100>(prefixLength);
-		} else {
-			return new LHC<DIM, PREF_BLOCKS, (1 << DIM)>(prefixLength);
+			throw runtime_error("Only supports up to 64 prefix blocks right now.");
 		}
+
+	inline static size_t determineMaximumNumberOfContents(size_t nDirectInserts) {
+		return capacity(determineNodeSize(nDirectInserts));
 	}
 };
 
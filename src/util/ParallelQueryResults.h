@@ -0,0 +1,214 @@
+/*
+ * ParallelQueryResults.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_PARALLELQUERYRESULTS_H_
+#define SRC_UTIL_PARALLELQUERYRESULTS_H_
+
+#include <vector>
+#include "Entry.h"
+#include "util/ResultStorage.h"
+
+// Results of a batch of range queries that were answered in parallel. Every thread appends
+// the results of its tasks (a query or a part of it) to its own chain of ResultStorage chunks
+// and only remembers where the results of each task start, so that the threads never need to
+// be synchronized and the results are not merged or copied afterwards.
+template <unsigned int DIM, unsigned int WIDTH>
+class ParallelQueryResults {
+public:
+	ParallelQueryResults(size_t nQueries, size_t nThreads);
+	ParallelQueryResults(const ParallelQueryResults<DIM, WIDTH>& other) = delete;
+	~ParallelQueryResults();
+
+	// number of queries in the batch
+	size_t nQueries() const;
+	// number of results of the query with the given index
+	size_t size(size_t queryIndex) const;
+	// number of results of all queries
+	size_t size() const;
+	// number of tasks with results of the query (more than one if the query was split)
+	size_t nSegments(size_t queryIndex) const;
+	// calls callback(const Entry<DIM, WIDTH>& entry) for all results of the query in the order of the tree
+	template <typename Callback>
+	void forEach(size_t queryIndex, Callback&& callback) const;
+	// appends the IDs of all results of the query
+	void appendIds(size_t queryIndex, std::vector<int>& outIds) const;
+
+	// used while the queries are answered: every thread only passes its own index
+	// a task is a query or a part of it whose results come before the ones of parts with a higher order
+	inline void beginTask(size_t threadIndex, size_t queryIndex, unsigned long order);
+	inline void add(size_t threadIndex, const Entry<DIM, WIDTH>& entry);
+	inline void endTask(size_t threadIndex);
+	// orders the results of the tasks after all threads finished
+	void finish();
+
+private:
+	// consecutive results of one task
+	struct Segment {
+		size_t queryIndex;
+		unsigned long order;
+		// chunk and position of the first result
+		const ResultStorage<DIM, WIDTH>* storage;
+		size_t index;
+		size_t nResults;
+	};
+
+	struct ThreadState {
+		// the chunk that results are appended to (it always has free space)
+		ResultStorage<DIM, WIDTH>* lastStorage;
+		Segment segment;
+		std::vector<Segment> segments;
+		// keeps the states of different threads in different cache lines
+		char padding[64];
+	};
+
+	// first chunk of every thread
+	std::vector<ResultStorage<DIM, WIDTH>*> threadStorages_;
+	std::vector<ThreadState> threadStates_;
+	// segments of all threads ordered by query and order (segments_[firstSegment_[q]] is the first one of query q)
+	std::vector<Segment> segments_;
+	std::vector<size_t> firstSegment_;
+};
+
+#include <assert.h>
+#include <algorithm>
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+ParallelQueryResults<DIM, WIDTH>::ParallelQueryResults(size_t nQueries, size_t nThreads)
+		: threadStorages_(nThreads), threadStates_(nThreads), segments_(), firstSegment_(nQueries + 1, 0) {
+	for (size_t t = 0; t < nThreads; ++t) {
+		threadStorages_[t] = new ResultStorage<DIM, WIDTH>();
+		threadStates_[t].lastStorage = threadStorages_[t];
+		threadStates_[t].segment.storage = NULL;
+		threadStates_[t].segment.nResults = 0;
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+ParallelQueryResults<DIM, WIDTH>::~ParallelQueryResults() {
+	for (auto storage : threadStorages_) {
+		storage->recursiveDelete();
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelQueryResults<DIM, WIDTH>::beginTask(size_t threadIndex, size_t queryIndex, unsigned long order) {
+	assert (threadIndex < threadStates_.size() && queryIndex < nQueries());
+	ThreadState& state = threadStates_[threadIndex];
+	state.segment.queryIndex = queryIndex;
+	state.segment.order = order;
+	state.segment.storage = state.lastStorage;
+	state.segment.index = state.lastStorage->nextIndex_;
+	state.segment.nResults = 0;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelQueryResults<DIM, WIDTH>::add(size_t threadIndex, const Entry<DIM, WIDTH>& entry) {
+	ThreadState& state = threadStates_[threadIndex];
+	state.lastStorage = state.lastStorage->add(entry);
+	++state.segment.nResults;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelQueryResults<DIM, WIDTH>::endTask(size_t threadIndex) {
+	ThreadState& state = threadStates_[threadIndex];
+	if (state.segment.nResults > 0) {
+		state.segments.push_back(state.segment);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelQueryResults<DIM, WIDTH>::finish() {
+	size_t nSegments = 0;
+	for (const auto& state : threadStates_) {
+		nSegments += state.segments.size();
+	}
+
+	segments_.clear();
+	segments_.reserve(nSegments);
+	for (auto& state : threadStates_) {
+		segments_.insert(segments_.end(), state.segments.begin(), state.segments.end());
+		vector<Segment>().swap(state.segments);
+	}
+
+	// most queries have a single segment so that this is close to a counting sort
+	sort(segments_.begin(), segments_.end(), [] (const Segment& s1, const Segment& s2) {
+		return s1.queryIndex < s2.queryIndex
+				|| (s1.queryIndex == s2.queryIndex && s1.order < s2.order);
+	});
+
+	const size_t nQueries = firstSegment_.size() - 1;
+	size_t segment = 0;
+	for (size_t query = 0; query <= nQueries; ++query) {
+		while (segment < segments_.size() && segments_[segment].queryIndex < query) {
+			++segment;
+		}
+		firstSegment_[query] = segment;
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t ParallelQueryResults<DIM, WIDTH>::nQueries() const {
+	return firstSegment_.size() - 1;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t ParallelQueryResults<DIM, WIDTH>::size(size_t queryIndex) const {
+	assert (queryIndex < nQueries());
+	size_t nResults = 0;
+	for (size_t s = firstSegment_[queryIndex]; s < firstSegment_[queryIndex + 1]; ++s) {
+		nResults += segments_[s].nResults;
+	}
+
+	return nResults;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t ParallelQueryResults<DIM, WIDTH>::size() const {
+	size_t nResults = 0;
+	for (const auto& segment : segments_) {
+		nResults += segment.nResults;
+	}
+
+	return nResults;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+size_t ParallelQueryResults<DIM, WIDTH>::nSegments(size_t queryIndex) const {
+	assert (queryIndex < nQueries());
+	return firstSegment_[queryIndex + 1] - firstSegment_[queryIndex];
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void ParallelQueryResults<DIM, WIDTH>::forEach(size_t queryIndex, Callback&& callback) const {
+	assert (queryIndex < nQueries());
+	for (size_t s = firstSegment_[queryIndex]; s < firstSegment_[queryIndex + 1]; ++s) {
+		const Segment& segment = segments_[s];
+		const ResultStorage<DIM, WIDTH>* storage = segment.storage;
+		size_t index = segment.index;
+		for (size_t i = 0; i < segment.nResults; ++i) {
+			if (index == ResultStorage<DIM, WIDTH>::CAPACITY) {
+				// the results continue in the next chunk of the same thread
+				storage = storage->nextStorage_;
+				index = 0;
+			}
+
+			assert (storage && index < storage->nextIndex_);
+			callback(storage->entries_[index++]);
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelQueryResults<DIM, WIDTH>::appendIds(size_t queryIndex, vector<int>& outIds) const {
+	outIds.reserve(outIds.size() + size(queryIndex));
+	forEach(queryIndex, [&outIds] (const Entry<DIM, WIDTH>& entry) { outIds.push_back(entry.id_); });
+}
+
+#endif /* SRC_UTIL_PARALLELQUERYRESULTS_H_ */
@@ -0,0 +1,175 @@
+/*
+ * ParallelRangeQueryUtil.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_PARALLELRANGEQUERYUTIL_H_
+#define SRC_UTIL_PARALLELRANGEQUERYUTIL_H_
+
+#include <vector>
+#include "Entry.h"
+#include "util/ParallelQueryResults.h"
+#include "util/SpatialSelectionOperationsUtil.h"
+#include "util/ThreadPool.h"
+
+template <unsigned int DIM>
+class Node;
+
+// Answers a single range query with several threads. The references of the first one or two
+// levels that are in the range are collected in Z-order and split into contiguous groups of
+// subtrees. Every group is a task of a WorkStealingExecutor that runs the push-based range
+// query on its subtrees, so that no state is shared between the threads.
+template <unsigned int DIM, unsigned int WIDTH>
+class ParallelRangeQueryUtil {
+public:
+	// stores the results of every thread of the pool in its own chunks of the results (a single query)
+	static void collect(const Node<DIM>* rootNode,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			ThreadPool& threads, ParallelQueryResults<DIM, WIDTH>& results);
+	// calls callback(size_t threadIndex, const Entry<DIM, WIDTH>& entry) for every result
+	// (concurrently from all threads but never concurrently with the same thread index)
+	template <typename Callback>
+	static void forEach(const Node<DIM>* rootNode,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			ThreadPool& threads, Callback& callback);
+
+private:
+	typedef typename SpatialSelectionOperationsUtil<DIM, WIDTH>::RangeSubtree RangeSubtree;
+
+	// the subtrees between the two indices (inclusive)
+	struct SubtreeTask {
+		size_t first;
+		size_t last;
+	};
+
+	// the query is split into at most this many tasks per thread
+	static const size_t partsPerThread = 4;
+	// number of levels below the root that are split if there are not enough subtrees
+	static const unsigned int maxSplitLevels = 2;
+
+	// the subtrees and entries in the range (Z-order) with enough subtrees for all threads if possible
+	static void split(const Node<DIM>* rootNode,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			size_t minSubtrees, std::vector<RangeSubtree>& outSubtrees);
+	// calls processResult(size_t threadIndex, const Entry<DIM, WIDTH>& entry) for every result between
+	// beforeTask(size_t threadIndex, size_t firstSubtree) and afterTask(size_t threadIndex) of its task
+	template <typename TaskProcessor, typename ResultProcessor, typename TaskFinisher>
+	static void run(const Node<DIM>* rootNode,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, ThreadPool& threads,
+			TaskProcessor& beforeTask, ResultProcessor& processResult, TaskFinisher& afterTask);
+};
+
+#include <assert.h>
+#include "nodes/Node.h"
+#include "util/WorkStealingExecutor.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelRangeQueryUtil<DIM, WIDTH>::split(const Node<DIM>* rootNode,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		size_t minSubtrees, vector<RangeSubtree>& outSubtrees) {
+	typedef SpatialSelectionOperationsUtil<DIM, WIDTH> SelectionUtil;
+	RangeSubtree root;
+	root.node = rootNode;
+	for (unsigned i = 0; i < RangeQueryMaskUtil<DIM, WIDTH>::nBlocks; ++i) {
+		root.values[i] = 0;
+	}
+	root.index = 0;
+	root.fullyContained = false;
+	root.id = 0;
+	SelectionUtil::splitInRange(root, lowerLeft, upperRight, outSubtrees);
+
+	vector<RangeSubtree> nextLevel;
+	for (unsigned int level = 1; level < maxSplitLevels && outSubtrees.size() < minSubtrees; ++level) {
+		// replacing every subtree by its parts keeps the Z-order
+		nextLevel.clear();
+		for (const RangeSubtree& subtree : outSubtrees) {
+			if (subtree.node) {
+				SelectionUtil::splitInRange(subtree, lowerLeft, upperRight, nextLevel);
+			} else {
+				nextLevel.push_back(subtree);
+			}
+		}
+
+		outSubtrees.swap(nextLevel);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename TaskProcessor, typename ResultProcessor, typename TaskFinisher>
+void ParallelRangeQueryUtil<DIM, WIDTH>::run(const Node<DIM>* rootNode,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, ThreadPool& threads,
+		TaskProcessor& beforeTask, ResultProcessor& processResult, TaskFinisher& afterTask) {
+	typedef SpatialSelectionOperationsUtil<DIM, WIDTH> SelectionUtil;
+	const size_t nThreads = threads.nThreads();
+	const size_t maxParts = partsPerThread * nThreads;
+	vector<RangeSubtree> subtrees;
+	split(rootNode, lowerLeft, upperRight, maxParts, subtrees);
+	if (subtrees.empty()) {
+		return;
+	}
+
+	// every thread starts with a contiguous block of tasks and takes the lowest one first
+	WorkStealingExecutor<SubtreeTask> executor(nThreads);
+	const size_t nParts = min(subtrees.size(), maxParts);
+	const size_t partsPerQueue = 1 + nParts / nThreads;
+	for (size_t threadIndex = 0; threadIndex < nThreads; ++threadIndex) {
+		const size_t start = min(partsPerQueue * threadIndex, nParts);
+		const size_t end = min(partsPerQueue * (threadIndex + 1), nParts);
+		for (size_t part = end; part > start; --part) {
+			const size_t first = (part - 1) * subtrees.size() / nParts;
+			const size_t last = part * subtrees.size() / nParts - 1;
+			executor.push(threadIndex, SubtreeTask{first, last});
+		}
+	}
+
+	auto processTask = [&subtrees, lowerLeft, upperRight, &beforeTask, &processResult, &afterTask]
+				(size_t threadIndex, const SubtreeTask& task) {
+		auto callback = [&processResult, threadIndex] (const Entry<DIM, WIDTH>& entry) {
+			processResult(threadIndex, entry);
+		};
+
+		beforeTask(threadIndex, task.first);
+		for (size_t i = task.first; i <= task.last; ++i) {
+			SelectionUtil::template forEachInRange<true>(subtrees[i], lowerLeft, upperRight, callback);
+		}
+		afterTask(threadIndex);
+	};
+
+	executor.run(processTask, threads);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void ParallelRangeQueryUtil<DIM, WIDTH>::collect(const Node<DIM>* rootNode,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		ThreadPool& threads, ParallelQueryResults<DIM, WIDTH>& results) {
+	assert (results.nQueries() == 1);
+	// the tasks are ordered by their first subtree
+	auto beforeTask = [&results] (size_t threadIndex, size_t firstSubtree) {
+		results.beginTask(threadIndex, 0, firstSubtree);
+	};
+	auto processResult = [&results] (size_t threadIndex, const Entry<DIM, WIDTH>& entry) {
+		results.add(threadIndex, entry);
+	};
+	auto afterTask = [&results] (size_t threadIndex) {
+		results.endTask(threadIndex);
+	};
+
+	run(rootNode, lowerLeft, upperRight, threads, beforeTask, processResult, afterTask);
+	results.finish();
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void ParallelRangeQueryUtil<DIM, WIDTH>::forEach(const Node<DIM>* rootNode,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		ThreadPool& threads, Callback& callback) {
+	auto ignoreTaskStart = [] (size_t, size_t) {};
+	auto ignoreTaskEnd = [] (size_t) {};
+	run(rootNode, lowerLeft, upperRight, threads, ignoreTaskStart, callback, ignoreTaskEnd);
+}
+
+#endif /* SRC_UTIL_PARALLELRANGEQUERYUTIL_H_ */
@@ -16,11 +16,15 @@
 #define AVERAGE_INSERT_DIM_PLOT_NAME 		"phtree_average_insert_dimensions"
 #define RANGE_QUERY_RATIO_PLOT_NAME 		"phtree_average_range_query_ratio"
 #define RANGE_QUERY_SELECTIVITY_PLOT_NAME 	"phtree_range_query_selectivity"
+#define RANGE_QUERY_ITERATORS_PLOT_NAME 	"phtree_range_query_iterators"
 #define AVERAGE_INSERT_ENTRIES_PLOT_NAME 	"phtree_average_insert_entries"
 #define INSERT_SERIES_PLOT_NAME 			"phtree_insert_series"
 #define AXONS_DENDRITES_PLOT_NAME 			"phtree_axons_dendrites"
 #define INSERT_ORDER_NAME		 			"phtree_insert_order"
 #define PARALLEL_INSERT_NAME				"phtree_parallel_insert"
+#define PARALLEL_QUERY_NAME					"phtree_parallel_query"
+#define PARALLEL_BULK_LOAD_NAME				"phtree_parallel_bulk_load"
+#define LOOKUP_BATCH_NAME					"phtree_lookup_batch"
 
 #define PLOT_DATA_PATH 			"./plot/data/"
 #define PLOT_DATA_EXTENSION 	".dat"
@@ -69,6 +73,10 @@ public:
 	static void plotRangeQueryTimePerSelectivity(std::vector<vector<unsigned long>>& entries);
 	static void plotRangeQueryTimePerSelectivityRandom();
 
+	template <unsigned int DIM, unsigned int WIDTH>
+	static void plotCompareRangeQueryIterators(std::vector<vector<unsigned long>>& entries);
+	static void plotCompareRangeQueryIteratorsRandom();
+
 	static void plotTimeSeriesOfInserts();
 
 	template <unsigned int DIM, unsigned int WIDTH>
@@ -86,6 +94,20 @@ public:
 	template <unsigned int DIM, unsigned int WIDTH>
 	static void plotCompareToRTreeBulk(std::string entryFile, bool isFloat);
 
+	// compares the work-stealing parallel intersection queries with a static split of the queries
+	template <unsigned int DIM, unsigned int WIDTH>
+	static void plotParallelQueryScheduling(std::string entryFile, std::string queryFile, bool isFloat);
+
+	// compares the parallel bulk load of uniformly distributed random entries with clustered ones
+	// (most entries in a small region that shares the highest bits of all values)
+	template <unsigned int DIM, unsigned int WIDTH>
+	static void plotParallelBulkLoad(size_t nEntries);
+
+	// compares single point lookups with batched lookups (lookupBatch) in trees of increasing size:
+	// half of the looked up entries are stored in the tree
+	template <unsigned int DIM, unsigned int WIDTH>
+	static void plotLookupBatch(size_t maxEntries);
+
 private:
 	static void plot(std::string gnuplotFileName);
 	static void clearPlotFile(std::string dataFileName);
@@ -101,6 +123,7 @@ private:
 
 #include <fstream>
 #include <algorithm>
+#include <numeric>
 #include <set>
 #include <stdexcept>
 #include <assert.h>
@@ -485,6 +508,202 @@ void PlotUtil::plotCompareParallelTreeToScanQuery(std::string entryFile, std::st
 	delete queries;
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+void PlotUtil::plotParallelQueryScheduling(std::string entryFile, std::string queryFile, bool isFloat) {
+	cout << "comparing parallel query scheduling for data from: " << entryFile << endl;
+	vector<vector<unsigned long>>* entries;
+	vector<vector<unsigned long>>* queries;
+	if (isFloat) {
+		entries = FileInputUtil::readFloatEntries<DIM>(entryFile, FLOAT_ACCURACY_DECIMALS);
+		queries = FileInputUtil::readFloatEntries<DIM>(queryFile, FLOAT_ACCURACY_DECIMALS);
+	} else {
+		entries = FileInputUtil::readEntries<DIM>(entryFile);
+		queries = FileInputUtil::readEntries<DIM>(queryFile);
+	}
+
+	PHTree<DIM, WIDTH>* tree = new PHTree<DIM, WIDTH>();
+	for (size_t i = 0; i < entries->size(); ++i) {
+		tree->insert(entries->at(i), i);
+	}
+
+	// skewed workload: the first query intersects all entries
+	vector<vector<unsigned long>> skewedQueries(*queries);
+	const unsigned long max = (WIDTH == 8 * sizeof (unsigned long))? -1 : (1uL << WIDTH) - 1;
+	vector<unsigned long> everything(DIM, 0);
+	fill(everything.begin() + DIM / 2, everything.end(), max);
+	skewedQueries.insert(skewedQueries.begin(), everything);
+
+	ofstream* plotFile = openPlotFile(PARALLEL_QUERY_NAME, true);
+	const size_t availableThreads = thread::hardware_concurrency();
+	for (unsigned t = 1; t <= availableThreads; ++t) {
+		for (const vector<vector<unsigned long>>* workload : {queries, &skewedQueries}) {
+			const string workloadLable = (workload == queries)? "uniform" : "skewed";
+
+			// --- static split: every thread answers a fixed chunk of the queries ---
+			chrono::steady_clock::time_point startStatic = chrono::steady_clock::now();
+			vector<size_t> nMatchesPerThread(t, 0);
+			const size_t chunkSize = 1 + workload->size() / t;
+			auto processChunk = [tree, workload, chunkSize, max, &nMatchesPerThread] (size_t threadIndex) {
+				const size_t start = chunkSize * threadIndex;
+				const size_t end = min(chunkSize * (threadIndex + 1), workload->size());
+				size_t nMatches = 0;
+				for (size_t i = start; i < end; ++i) {
+					// same window as PHTree::intersectionQuery
+					vector<unsigned long> lowerLeft(DIM, 0);
+					vector<unsigned long> upperRight(DIM, max);
+					for (unsigned k = 0; k < DIM / 2; ++k) {
+						upperRight[k] = workload->at(i)[k + DIM / 2];
+						lowerLeft[k + DIM / 2] = workload->at(i)[k];
+					}
+					tree->forEachInRange(lowerLeft, upperRight, [&nMatches] (const Entry<DIM, WIDTH>&) { ++nMatches; });
+				}
+				nMatchesPerThread[threadIndex] = nMatches;
+			};
+			vector<thread> threads;
+			for (size_t threadIndex = 1; threadIndex < t; ++threadIndex) {
+				threads.emplace_back(processChunk, threadIndex);
+			}
+			processChunk(0);
+			for (auto& thread : threads) {
+				thread.join();
+			}
+			size_t nMatchesStatic = 0;
+			for (size_t nMatches : nMatchesPerThread) {
+				nMatchesStatic += nMatches;
+			}
+			chrono::steady_clock::time_point endStatic = chrono::steady_clock::now();
+
+			// --- work stealing with split queries ---
+			chrono::steady_clock::time_point startStealing = chrono::steady_clock::now();
+			ParallelQueryResults<DIM, WIDTH>* results = tree->parallelIntersectionQuery(*workload, t);
+			const size_t nMatchesStealing = results->size();
+			// in the skewed workload the first query intersects all entries and should be answered by several tasks
+			const size_t nFirstQueryParts = results->nSegments(0);
+			delete results;
+			chrono::steady_clock::time_point endStealing = chrono::steady_clock::now();
+			assert (nMatchesStatic == nMatchesStealing);
+
+			const double staticMillis = chrono::duration_cast<chrono::microseconds>(endStatic - startStatic).count() / 1000.0;
+			const double stealingMillis = chrono::duration_cast<chrono::microseconds>(endStealing - startStealing).count() / 1000.0;
+			// throughput [queries per ms]
+			cout << "	#Threads=" << t << " (" << workloadLable << ")	static split: " << staticMillis
+					<< "ms,	work stealing: " << stealingMillis << "ms	#matches: " << nMatchesStealing;
+			if (workload != queries) {
+				cout << "	#parts of the huge query: " << nFirstQueryParts;
+			}
+			cout << endl;
+			(*plotFile) << t << "	static-" << workloadLable << "	" << staticMillis << "	" << double(workload->size()) / staticMillis << endl
+						<< t << "	stealing-" << workloadLable << "	" << stealingMillis << "	" << double(workload->size()) / stealingMillis << endl;
+		}
+	}
+
+	delete tree;
+	delete entries;
+	delete queries;
+	delete plotFile;
+	plot(PARALLEL_QUERY_NAME);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PlotUtil::plotParallelBulkLoad(size_t nEntries) {
+	cout << "measuring the parallel bulk load of " << nEntries << " uniform and clustered entries" << endl;
+	const unsigned long max = (WIDTH == 8 * sizeof (unsigned long))? -1 : (1uL << WIDTH) - 1;
+	const unsigned long clusterWidth = max >> (WIDTH / 2);
+	const unsigned long clusterStart = max / 3;
+	mt19937_64 generator(42);
+	vector<vector<unsigned long>> uniform(nEntries, vector<unsigned long>(DIM));
+	vector<vector<unsigned long>> clustered(nEntries, vector<unsigned long>(DIM));
+	for (size_t i = 0; i < nEntries; ++i) {
+		for (unsigned d = 0; d < DIM; ++d) {
+			uniform[i][d] = generator() & max;
+			// every tenth entry is outside of the cluster
+			clustered[i][d] = (i % 10 == 0)? generator() & max : clusterStart + generator() % clusterWidth;
+		}
+	}
+
+	ofstream* plotFile = openPlotFile(PARALLEL_BULK_LOAD_NAME, true);
+	const size_t availableThreads = thread::hardware_concurrency();
+	for (unsigned t = 1; t <= availableThreads; ++t) {
+		for (const vector<vector<unsigned long>>* workload : {&uniform, &clustered}) {
+			const string workloadLable = (workload == &uniform)? "uniform" : "clustered";
+			PHTree<DIM, WIDTH>* tree = new PHTree<DIM, WIDTH>();
+			chrono::steady_clock::time_point start = chrono::steady_clock::now();
+			tree->parallelBulkLoad(*workload, NULL, t);
+			chrono::steady_clock::time_point end = chrono::steady_clock::now();
+			delete tree;
+
+			const double millis = chrono::duration_cast<chrono::microseconds>(end - start).count() / 1000.0;
+			cout << "	#Threads=" << t << " (" << workloadLable << "): " << millis << "ms" << endl;
+			// throughput [entries per ms]
+			(*plotFile) << t << "	" << workloadLable << "	" << millis << "	" << double(nEntries) / millis << endl;
+		}
+	}
+
+	delete plotFile;
+	plot(PARALLEL_BULK_LOAD_NAME);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void PlotUtil::plotLookupBatch(size_t maxEntries) {
+	cout << "measuring single and batched lookups in trees with up to " << maxEntries << " entries" << endl;
+	const unsigned long max = (WIDTH == 8 * sizeof (unsigned long))? -1 : (1uL << WIDTH) - 1;
+	mt19937_64 generator(42);
+	ofstream* plotFile = openPlotFile(LOOKUP_BATCH_NAME, true);
+	// three tree sizes that differ by a factor of 10
+	for (size_t nEntries = std::max<size_t>(maxEntries / 100, 1); nEntries <= maxEntries; nEntries *= 10) {
+		vector<vector<unsigned long>> values(nEntries, vector<unsigned long>(DIM));
+		for (size_t i = 0; i < nEntries; ++i) {
+			for (unsigned d = 0; d < DIM; ++d) {
+				values[i][d] = generator() & max;
+			}
+		}
+
+		vector<int> ids(nEntries);
+		iota(ids.begin(), ids.end(), 0);
+		PHTree<DIM, WIDTH>* tree = new PHTree<DIM, WIDTH>();
+		tree->bulkLoad(values, ids);
+
+		// every other lookup is an entry of the tree in random order and the rest most likely misses
+		vector<Entry<DIM, WIDTH>> lookups;
+		lookups.reserve(nEntries);
+		for (size_t i = 0; i < nEntries; ++i) {
+			if (i % 2 == 0) {
+				lookups.push_back(Entry<DIM, WIDTH>(values[generator() % nEntries], 0));
+			} else {
+				vector<unsigned long> missValues(DIM);
+				for (unsigned d = 0; d < DIM; ++d) {
+					missValues[d] = generator() & max;
+				}
+				lookups.push_back(Entry<DIM, WIDTH>(missValues, 0));
+			}
+		}
+
+		vector<pair<bool, int>> singleResults(nEntries);
+		chrono::steady_clock::time_point startSingle = chrono::steady_clock::now();
+		for (size_t i = 0; i < nEntries; ++i) {
+			singleResults[i] = tree->lookup(lookups[i]);
+		}
+		chrono::steady_clock::time_point endSingle = chrono::steady_clock::now();
+
+		vector<pair<bool, int>> batchResults(nEntries);
+		chrono::steady_clock::time_point startBatch = chrono::steady_clock::now();
+		tree->lookupBatch(lookups.data(), nEntries, batchResults.data());
+		chrono::steady_clock::time_point endBatch = chrono::steady_clock::now();
+		assert (singleResults == batchResults);
+		delete tree;
+
+		const double singleMillis = chrono::duration_cast<chrono::microseconds>(endSingle - startSingle).count() / 1000.0;
+		const double batchMillis = chrono::duration_cast<chrono::microseconds>(endBatch - startBatch).count() / 1000.0;
+		cout << "	#Entries=" << nEntries << "	single: " << singleMillis << "ms,	batch: " << batchMillis << "ms" << endl;
+		// throughput [lookups per ms]
+		(*plotFile) << nEntries << "	single	" << singleMillis << "	" << double(nEntries) / singleMillis << endl
+					<< nEntries << "	batch	" << batchMillis << "	" << double(nEntries) / batchMillis << endl;
+	}
+
+	delete plotFile;
+	plot(LOOKUP_BATCH_NAME);
+}
+
 template <unsigned int DIM, unsigned int WIDTH>
 void PlotUtil::plotCompareToRTreeBulk(std::string entryFile, bool isFloat) {
 	assert (isFloat);
@@ -603,7 +822,9 @@ void PlotUtil::plotAxonsAndDendrites(vector<string> axonsFiles, vector<string> d
 		CALLGRIND_START_INSTRUMENTATION;
 		startRanges = chrono::steady_clock::now();
 		if (parallel) {
-			phtree->parallelIntersectionQuery(*axonsRectValues);
+			ParallelQueryResults<DIM, WIDTH>* results = phtree->parallelIntersectionQuery(*axonsRectValues);
+			nIntersectingDendrites = results->size();
+			delete results;
 		} else {
 			for (unsigned iAxon = 0; iAxon < nAxons; ++iAxon) {
 				const unsigned int startInitTime = clock();
@@ -812,6 +1033,105 @@ void PlotUtil::plotRangeQueryTimePerSelectivity(std::vector<vector<unsigned long
 		plot(RANGE_QUERY_SELECTIVITY_PLOT_NAME);
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+void PlotUtil::plotCompareRangeQueryIterators(std::vector<vector<unsigned long>>& entries) {
+
+	// create a PH-Tree with the given entries
+	cout << "inserting all entries into a PH-Tree..." << flush;
+	PHTree<DIM, WIDTH>* phtree = new PHTree<DIM, WIDTH>();
+	for (size_t iEntry = 0; iEntry < entries.size(); iEntry++) {
+		phtree->insert(entries[iEntry], iEntry);
+	}
+	cout << " ok" << endl;
+
+	entries.clear();
+
+	double selectivity[] = SELECTIVITY;
+	size_t nTests = sizeof (selectivity) / sizeof (double);
+
+	ofstream* plotFile = openPlotFile(RANGE_QUERY_ITERATORS_PLOT_NAME, true);
+	cout << "selectivity	reference [ms]	fast [ms]	IDs [ms]	callback [ms]	count [ms]	 #elements in range" << endl;
+	CALLGRIND_START_INSTRUMENTATION;
+	for (unsigned test = 0; test < nTests; ++test) {
+		// both iterators run the same query including their initialization
+		vector<unsigned long> lower;
+		vector<unsigned long> upper;
+		RangeQueryUtil<DIM, WIDTH>::generateSelectiveRangeRandom(selectivity[test], lower, upper);
+
+		unsigned int nElementsInRange = 0;
+		const unsigned int startReferenceTicks = clock();
+		RangeQueryIterator<DIM, WIDTH>* it = phtree->rangeQuery(lower, upper);
+		while (it->hasNext()) {
+			it->next();
+			++nElementsInRange;
+		}
+		const unsigned int referenceTicks = clock() - startReferenceTicks;
+		delete it;
+
+		unsigned int nFastElementsInRange = 0;
+		const unsigned int startFastTicks = clock();
+		FastRangeQueryIterator<DIM, WIDTH>* fastIt = phtree->fastRangeQuery(lower, upper);
+		while (fastIt->hasNext()) {
+			fastIt->next();
+			++nFastElementsInRange;
+		}
+		const unsigned int fastTicks = clock() - startFastTicks;
+		delete fastIt;
+		assert (nElementsInRange == nFastElementsInRange);
+
+		unsigned int nIdsInRange = 0;
+		const unsigned int startIdTicks = clock();
+		FastRangeQueryIterator<DIM, WIDTH>* idIt = phtree->rangeQueryIds(lower, upper);
+		while (idIt->hasNext()) {
+			idIt->nextId();
+			++nIdsInRange;
+		}
+		const unsigned int idTicks = clock() - startIdTicks;
+		delete idIt;
+		assert (nElementsInRange == nIdsInRange);
+
+		unsigned int nCallbacksInRange = 0;
+		const unsigned int startCallbackTicks = clock();
+		phtree->forEachIdInRange(lower, upper, [&nCallbacksInRange](int) { ++nCallbacksInRange; });
+		const unsigned int callbackTicks = clock() - startCallbackTicks;
+		assert (nElementsInRange == nCallbacksInRange);
+
+		const unsigned int startCountTicks = clock();
+		const size_t nCountedInRange = phtree->rangeCount(lower, upper);
+		const unsigned int countTicks = clock() - startCountTicks;
+		assert (nElementsInRange == nCountedInRange);
+
+		const double referenceMs = double(referenceTicks) / CLOCKS_PER_SEC * 1000;
+		const double fastMs = double(fastTicks) / CLOCKS_PER_SEC * 1000;
+		const double idMs = double(idTicks) / CLOCKS_PER_SEC * 1000;
+		const double callbackMs = double(callbackTicks) / CLOCKS_PER_SEC * 1000;
+		const double countMs = double(countTicks) / CLOCKS_PER_SEC * 1000;
+
+		cout << selectivity[test] << "\t\t" << referenceMs << "\t\t"
+				<< fastMs << "\t\t" << idMs << "\t\t" << callbackMs << "\t\t" << countMs << "\t\t"
+				<< nElementsInRange << endl;
+		(*plotFile) << test << "\t" << selectivity[test] << "\t"
+				<< referenceMs << "\t" << fastMs << "\t"
+				<< idMs << "\t" << callbackMs << "\t" << countMs << "\t"
+				<< nElementsInRange << endl;
+	}
+	CALLGRIND_STOP_INSTRUMENTATION;
+
+	plotFile->close();
+	delete plotFile;
+	delete phtree;
+
+	plot(RANGE_QUERY_ITERATORS_PLOT_NAME);
+}
+
+void PlotUtil::plotCompareRangeQueryIteratorsRandom() {
+	cout << "creating " << N_RANDOM_ENTRIES_RANGE_QUERY << " entries for the range query..." << flush;
+	vector<vector<unsigned long>>* entries = generateUniqueRandomEntriesList<ENTRY_DIM, BIT_LENGTH>(N_RANDOM_ENTRIES_RANGE_QUERY);
+	cout << " ok" << endl;
+	plotCompareRangeQueryIterators<ENTRY_DIM, BIT_LENGTH>(*entries);
+	delete entries;
+}
+
 void PlotUtil::plotRangeQueryTimePerSelectivityRandom() {
 	cout << "creating " << N_RANDOM_ENTRIES_RANGE_QUERY << " entries for the range query..." << flush;
 	vector<vector<unsigned long>>* entries = generateUniqueRandomEntriesList<ENTRY_DIM, BIT_LENGTH>(N_RANDOM_ENTRIES_RANGE_QUERY);
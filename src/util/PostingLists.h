@@ -0,0 +1,211 @@
+/*
+ * PostingLists.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_POSTINGLISTS_H_
+#define SRC_UTIL_POSTINGLISTS_H_
+
+#include <climits>
+#include <stdexcept>
+#include <type_traits>
+
+// Lists of values that are stored in cache line sized (and aligned) chunks of one shared pool.
+// A list is identified by the index of its first chunk which never moves so that
+// the tree only needs to store the index once per key.
+template <typename T>
+class PostingLists {
+	static_assert (std::is_trivially_copyable<T>::value, "values must be POD types");
+public:
+	PostingLists();
+	PostingLists(const PostingLists<T>& other) = delete;
+	~PostingLists();
+
+	// creates a new list that only contains the value and returns its ID
+	inline int create(const T& value);
+	inline void add(int list, const T& value);
+	// removes one occurrence of the value (returns false if the list does not contain it)
+	inline bool remove(int list, const T& value);
+	// frees all chunks of the list
+	inline void release(int list);
+	inline bool empty(int list) const;
+	// number of values in the list
+	inline size_t size(int list) const;
+	// calls callback(const T& value) for all values in the list
+	template <typename Callback>
+	inline void forEach(int list, Callback& callback) const;
+
+private:
+	static const unsigned int chunkBytes = 64;
+	static const unsigned int chunkCapacity = (sizeof (T) + 2 * sizeof (int) <= chunkBytes)?
+			(chunkBytes - 2 * sizeof (int)) / sizeof (T) : 1;
+
+	struct alignas(chunkBytes) Chunk {
+		// index of the next chunk of the list (or of the next free chunk), -1 if there is none
+		int next;
+		unsigned int size;
+		T values[chunkCapacity];
+	};
+
+	// over-aligned storage that is moved as a whole when it grows
+	Chunk* chunks_;
+	size_t nChunks_;
+	size_t chunkCapacity_;
+	int freeChunk_;
+
+	inline int allocateChunk();
+	inline void freeChunk(int chunk);
+};
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+using namespace std;
+
+template <typename T>
+PostingLists<T>::PostingLists() : chunks_(NULL), nChunks_(0), chunkCapacity_(0), freeChunk_(-1) { }
+
+template <typename T>
+PostingLists<T>::~PostingLists() {
+	free(chunks_);
+}
+
+template <typename T>
+int PostingLists<T>::allocateChunk() {
+	int chunk = freeChunk_;
+	if (chunk != -1) {
+		freeChunk_ = chunks_[chunk].next;
+	} else {
+		if (nChunks_ >= (size_t) INT_MAX) {
+			throw runtime_error("too many posting list chunks: indices must fit into the IDs of the nodes");
+		}
+
+		if (nChunks_ == chunkCapacity_) {
+			// the chunks are trivially copyable
+			const size_t newCapacity = (chunkCapacity_ == 0)? 16 : 2 * chunkCapacity_;
+			void* newChunks = NULL;
+			if (posix_memalign(&newChunks, alignof (Chunk), newCapacity * sizeof (Chunk)) != 0) {
+				throw std::bad_alloc();
+			}
+
+			if (nChunks_ > 0) {
+				memcpy(newChunks, chunks_, nChunks_ * sizeof (Chunk));
+			}
+			free(chunks_);
+			chunks_ = static_cast<Chunk*>(newChunks);
+			chunkCapacity_ = newCapacity;
+		}
+
+		chunk = nChunks_++;
+	}
+
+	chunks_[chunk].next = -1;
+	chunks_[chunk].size = 0;
+	return chunk;
+}
+
+template <typename T>
+void PostingLists<T>::freeChunk(int chunk) {
+	chunks_[chunk].next = freeChunk_;
+	freeChunk_ = chunk;
+}
+
+template <typename T>
+int PostingLists<T>::create(const T& value) {
+	const int list = allocateChunk();
+	chunks_[list].values[0] = value;
+	chunks_[list].size = 1;
+	return list;
+}
+
+template <typename T>
+void PostingLists<T>::add(int list, const T& value) {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	// the first chunk stays in place: new chunks are linked in directly behind it
+	int chunk = list;
+	if (chunks_[chunk].size == chunkCapacity) {
+		chunk = chunks_[list].next;
+		if (chunk == -1 || chunks_[chunk].size == chunkCapacity) {
+			const int newChunk = allocateChunk();
+			chunks_[newChunk].next = chunk;
+			chunks_[list].next = newChunk;
+			chunk = newChunk;
+		}
+	}
+
+	Chunk& c = chunks_[chunk];
+	c.values[c.size++] = value;
+}
+
+template <typename T>
+bool PostingLists<T>::remove(int list, const T& value) {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	for (int chunk = list; chunk != -1; chunk = chunks_[chunk].next) {
+		Chunk& c = chunks_[chunk];
+		for (unsigned i = 0; i < c.size; ++i) {
+			if (c.values[i] == value) {
+				// fill the gap with the last value of the first chunk
+				Chunk& first = chunks_[list];
+				assert (first.size > 0);
+				c.values[i] = first.values[--first.size];
+				const int second = first.next;
+				if (first.size == 0 && second != -1) {
+					// keep the first chunk in place and move the contents of the second one into it
+					first = chunks_[second];
+					freeChunk(second);
+				}
+
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+template <typename T>
+void PostingLists<T>::release(int list) {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	int chunk = list;
+	while (chunk != -1) {
+		const int next = chunks_[chunk].next;
+		freeChunk(chunk);
+		chunk = next;
+	}
+}
+
+template <typename T>
+bool PostingLists<T>::empty(int list) const {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	// only the first chunk can be empty
+	return chunks_[list].size == 0;
+}
+
+template <typename T>
+size_t PostingLists<T>::size(int list) const {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	size_t nValues = 0;
+	for (int chunk = list; chunk != -1; chunk = chunks_[chunk].next) {
+		nValues += chunks_[chunk].size;
+	}
+
+	return nValues;
+}
+
+template <typename T>
+template <typename Callback>
+void PostingLists<T>::forEach(int list, Callback& callback) const {
+	assert (list >= 0 && (size_t) list < nChunks_);
+	for (int chunk = list; chunk != -1; chunk = chunks_[chunk].next) {
+		const Chunk& c = chunks_[chunk];
+		for (unsigned i = 0; i < c.size; ++i) {
+			callback(c.values[i]);
+		}
+	}
+}
+
+#endif /* SRC_UTIL_POSTINGLISTS_H_ */
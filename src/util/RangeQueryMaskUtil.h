@@ -0,0 +1,198 @@
+/*
+ * RangeQueryMaskUtil.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_RANGEQUERYMASKUTIL_H_
+#define SRC_UTIL_RANGEQUERYMASKUTIL_H_
+
+#include <cstdint>
+#include "nodes/NodeContentArrays.h"
+
+// Stateless helpers for range queries that walk the reference arrays of the nodes.
+// All values are either interleaved (as in Entry) or per dimension (lower left / upper right).
+template <unsigned int DIM, unsigned int WIDTH>
+class RangeQueryMaskUtil {
+public:
+	static const unsigned long highestAddress = (1uL << DIM) - 1;
+	static const unsigned int bitsPerBlock = sizeof (unsigned long) * 8;
+	static const unsigned int nBlocks = 1 + (DIM * WIDTH - 1) / bitsPerBlock;
+
+	// a node at the given index covers all values that share the interleaved bits of the higher levels:
+	// returns false if this region does not intersect the range and otherwise calculates the masks
+	// that restrict the HC addresses of the node to the ones that can contain values in the range
+	static inline bool calculateMasks(const unsigned long* nodeValues, unsigned int currentIndex,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			unsigned long* outLowerMask, unsigned long* outUpperMask, bool* outFullyContained);
+	// same semantics as in RangeQueryIterator
+	static inline bool isInMaskRange(unsigned long hcAddress, unsigned long lowerMask, unsigned long upperMask);
+	// the next address in the mask range (requires: hcAddress is in the mask range and not the upper mask)
+	static inline unsigned long nextInMaskRange(unsigned long hcAddress, unsigned long lowerMask, unsigned long upperMask);
+	static inline bool isInRange(const unsigned long* values,
+			const unsigned long* lowerLeft, const unsigned long* upperRight);
+	static inline bool isSuffixInRange(const unsigned long* values,
+			const unsigned long* lowerLeft, const unsigned long* upperRight);
+	// appends the suffix stored at the given reference to the interleaved values of the higher levels
+	static inline void pushBackSuffix(const NodeContentArrays<DIM>& arrays, unsigned int currentIndex,
+			std::uintptr_t reference, unsigned long* values);
+	static inline unsigned long lookupLhcAddress(const unsigned long* addresses, unsigned long row);
+	// binary search for the first row with an address >= the given one
+	static inline unsigned long lowerBoundLhcRow(const unsigned long* addresses, unsigned long nRows,
+			unsigned long hcAddress);
+	// ORs the lowest fromNBits bits into the given block starting at bit toLsbIndex
+	static inline void pushBackBits(const unsigned long* fromStartBlock, unsigned int fromNBits,
+			unsigned long* toStartBlock, unsigned int toLsbIndex);
+};
+
+#include <assert.h>
+#include "util/MultiDimBitset.h"
+
+using namespace std;
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool RangeQueryMaskUtil<DIM, WIDTH>::calculateMasks(const unsigned long* nodeValues, unsigned int currentIndex,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		unsigned long* outLowerMask, unsigned long* outUpperMask, bool* outFullyContained) {
+	assert (currentIndex < WIDTH);
+	const unsigned int freeBits = WIDTH - currentIndex;
+	const unsigned long freeMask = (freeBits == bitsPerBlock)? -1uL : (1uL << freeBits) - 1uL;
+	const unsigned long halfBit = 1uL << (freeBits - 1);
+	unsigned long nodeLowerValues[DIM];
+	MultiDimBitset<DIM>::toLongs(nodeValues, DIM * WIDTH, nodeLowerValues);
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = highestAddress;
+	bool fullyContained = true;
+	for (unsigned d = 0; d < DIM; ++d) {
+		const unsigned long nodeLower = nodeLowerValues[d];
+		const unsigned long nodeUpper = nodeLower | freeMask;
+		if (nodeUpper < lowerLeft[d] || upperRight[d] < nodeLower) {
+			// the prefix is not in the range
+			return false;
+		}
+
+		fullyContained &= lowerLeft[d] <= nodeLower && nodeUpper <= upperRight[d];
+		// lower mask: 1 <=> only the upper half of the dimension can be in the range
+		// upper mask: 1 <=> the upper half of the dimension can be in the range
+		const unsigned long middle = nodeLower | halfBit;
+		lowerMask |= (unsigned long)(lowerLeft[d] >= middle) << d;
+		upperMask &= ~((unsigned long)(upperRight[d] < middle) << d);
+	}
+
+	assert ((lowerMask & upperMask) == lowerMask);
+	(*outLowerMask) = lowerMask;
+	(*outUpperMask) = upperMask;
+	(*outFullyContained) = fullyContained;
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool RangeQueryMaskUtil<DIM, WIDTH>::isInMaskRange(unsigned long hcAddress,
+		unsigned long lowerMask, unsigned long upperMask) {
+	return ((hcAddress | lowerMask) & upperMask) == hcAddress;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned long RangeQueryMaskUtil<DIM, WIDTH>::nextInMaskRange(unsigned long hcAddress,
+		unsigned long lowerMask, unsigned long upperMask) {
+	assert (isInMaskRange(hcAddress, lowerMask, upperMask) && hcAddress != upperMask);
+	// all addresses a with lowerMask <= a <= upperMask (bitwise) are visited in ascending order
+	return (((hcAddress | (~upperMask)) + 1uL) & upperMask) | lowerMask;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool RangeQueryMaskUtil<DIM, WIDTH>::isInRange(const unsigned long* values,
+		const unsigned long* lowerLeft, const unsigned long* upperRight) {
+	bool inRange = true;
+	for (unsigned d = 0; d < DIM; ++d) {
+		inRange &= lowerLeft[d] <= values[d] && values[d] <= upperRight[d];
+	}
+
+	return inRange;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool RangeQueryMaskUtil<DIM, WIDTH>::isSuffixInRange(const unsigned long* values,
+		const unsigned long* lowerLeft, const unsigned long* upperRight) {
+	unsigned long dimensionValues[DIM];
+	MultiDimBitset<DIM>::toLongs(values, DIM * WIDTH, dimensionValues);
+	return isInRange(dimensionValues, lowerLeft, upperRight);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void RangeQueryMaskUtil<DIM, WIDTH>::pushBackSuffix(const NodeContentArrays<DIM>& arrays,
+		unsigned int currentIndex, std::uintptr_t reference, unsigned long* values) {
+	const unsigned int suffixLength = WIDTH - currentIndex - 1;
+	if (suffixLength == 0) {
+		return;
+	}
+
+	// the suffix is either stored in the reference or in the suffix storage of the node
+	const bool isPointer = (reference >> 1uL) & 1uL;
+	const unsigned long suffixMask = (-1uL) >> 32;
+	const unsigned long suffixPart = (reference & suffixMask) >> 2;
+	const unsigned long* suffixStartBlock = &suffixPart;
+	if (isPointer) {
+		assert (arrays.suffixStartBlock);
+		suffixStartBlock = arrays.suffixStartBlock + suffixPart;
+	}
+
+	pushBackBits(suffixStartBlock, DIM * suffixLength, values, 0);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned long RangeQueryMaskUtil<DIM, WIDTH>::lookupLhcAddress(const unsigned long* addresses, unsigned long row) {
+	// same layout as in LHC: N rows of DIM bits packed into blocks
+	const unsigned long firstBit = row * DIM;
+	const unsigned long firstBlockIndex = firstBit / bitsPerBlock;
+	const unsigned long firstBitIndex = firstBit % bitsPerBlock;
+	const unsigned long addressMask = (1uL << DIM) - 1uL;
+	unsigned long hcAddress = addresses[firstBlockIndex] >> firstBitIndex;
+	if (firstBitIndex + DIM > bitsPerBlock) {
+		// the address is split into two blocks
+		hcAddress |= addresses[firstBlockIndex + 1] << (bitsPerBlock - firstBitIndex);
+	}
+
+	return hcAddress & addressMask;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+unsigned long RangeQueryMaskUtil<DIM, WIDTH>::lowerBoundLhcRow(const unsigned long* addresses,
+		unsigned long nRows, unsigned long hcAddress) {
+	unsigned long l = 0;
+	unsigned long r = nRows;
+	while (l < r) {
+		const unsigned long middle = (l + r) / 2;
+		if (lookupLhcAddress(addresses, middle) < hcAddress) {
+			l = middle + 1;
+		} else {
+			r = middle;
+		}
+	}
+
+	return l;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void RangeQueryMaskUtil<DIM, WIDTH>::pushBackBits(const unsigned long* fromStartBlock, unsigned int fromNBits,
+		unsigned long* toStartBlock, unsigned int toLsbIndex) {
+	assert (fromNBits > 0 && toLsbIndex + fromNBits <= DIM * WIDTH);
+	const unsigned int fromBlocks = 1 + (fromNBits - 1) / bitsPerBlock;
+	const unsigned int toBlockIndex = toLsbIndex / bitsPerBlock;
+	const unsigned int toBitIndex = toLsbIndex % bitsPerBlock;
+	const unsigned int lastBlockBits = fromNBits % bitsPerBlock;
+	for (unsigned i = 0; i < fromBlocks; ++i) {
+		unsigned long block = fromStartBlock[i];
+		if (i == fromBlocks - 1 && lastBlockBits != 0) {
+			block &= (1uL << lastBlockBits) - 1uL;
+		}
+
+		toStartBlock[toBlockIndex + i] |= block << toBitIndex;
+		if (toBitIndex != 0 && toBlockIndex + i + 1 < nBlocks) {
+			toStartBlock[toBlockIndex + i + 1] |= block >> (bitsPerBlock - toBitIndex);
+		}
+	}
+}
+
+#endif /* SRC_UTIL_RANGEQUERYMASKUTIL_H_ */
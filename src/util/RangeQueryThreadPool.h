@@ -9,46 +9,70 @@
 #define SRC_UTIL_RANGEQUERYTHREADPOOL_H_
 
 
-#include <thread>
-#include <queue>
-#include <functional>
 #include <vector>
-#include <atomic>
 #include "Entry.h"
 #include "util/ResultStorage.h"
+#include "util/ParallelQueryResults.h"
+#include "util/ThreadPool.h"
 
+template <unsigned int DIM>
+class Node;
 template <unsigned int DIM, unsigned int WIDTH>
 class PHTree;
 
-template <unsigned int DIM, unsigned int WIDTH>
-class ResultStorage;
-
 enum QueryType {
 	intersection_query,
 	inclusion_query
 };
 
+// Answers a batch of hyper rectangle queries with several threads. The queries are distributed
+// to the threads of a WorkStealingExecutor. A query whose root subtrees hold more than a thread's
+// share of the entries (or the last query of a thread) is split into tasks for groups of the
+// root's subtrees which idle threads can steal, so that queries with many results do not keep a
+// single thread busy while the others wait.
 template <unsigned int DIM, unsigned int WIDTH>
 class RangeQueryThreadPool {
 public:
 
-	RangeQueryThreadPool(size_t nAdditionalThreads,
+	// the queries are answered with all threads of the pool
+	RangeQueryThreadPool(ThreadPool& threads,
 			const std::vector<std::vector<unsigned long>>& ranges,
 			const PHTree<DIM, WIDTH>* tree, QueryType type);
 	~RangeQueryThreadPool();
-	void joinPool();
+	// answers all queries and stores the results of every thread in its own chunks of the results
+	void collect(ParallelQueryResults<DIM, WIDTH>& results);
+	// answers all queries and calls callback(size_t queryIndex, const Entry<DIM, WIDTH>& entry)
+	// for every result (concurrently from all threads)
+	template <typename Callback>
+	void forEach(Callback& callback);
 
 private:
+	// a query or the part of it below the root's references between the two addresses
+	struct QueryTask {
+		size_t queryIndex;
+		bool isPart;
+		unsigned long fromHcAddress;
+		unsigned long toHcAddress;
+	};
+
+	// a split query has at most this many tasks per thread
+	static const size_t partsPerThread = 4;
+
+	// upper bound of the results: number of entries below the root's references at the addresses
+	static size_t nEntriesBelow(const Node<DIM>* root, const std::vector<unsigned long>& hcAddresses);
+
 	QueryType type_;
+	ThreadPool& threads_;
 	size_t nThreads_;
-	std::vector<std::thread> threads_;
-	std::vector<ResultStorage<DIM, WIDTH>> startStorage_;
 	const std::vector<std::vector<unsigned long>>& ranges_;
 	const PHTree<DIM, WIDTH>* tree_;
 
-	void processNext(size_t threadIndex);
-	RangeQueryIterator<DIM, WIDTH>* getIteratorByType(size_t index);
-	void clearResults();
+	// calls processResult(size_t threadIndex, const QueryTask& task, const Entry<DIM, WIDTH>& entry) for every result
+	// between beforeTask(size_t threadIndex, const QueryTask& task) and afterTask(...) of its task
+	template <typename TaskProcessor, typename ResultProcessor, typename TaskFinisher>
+	void run(TaskProcessor& beforeTask, ResultProcessor& processResult, TaskFinisher& afterTask);
+	// per dimension range of 2k-dimensional points that contains the hyper rectangles of the query
+	void toWindow(size_t index, unsigned long* outLowerLeft, unsigned long* outUpperRight) const;
 };
 
 
@@ -56,72 +80,153 @@ using namespace std;
 
 #include <stdexcept>
 #include "PHTree.h"
+#include "util/WorkStealingExecutor.h"
+#include "util/SpatialSelectionOperationsUtil.h"
 
 template <unsigned int DIM, unsigned int WIDTH>
-RangeQueryThreadPool<DIM, WIDTH>::RangeQueryThreadPool(size_t nAdditionalThreads,
+RangeQueryThreadPool<DIM, WIDTH>::RangeQueryThreadPool(ThreadPool& threads,
 			const std::vector<std::vector<unsigned long>>& ranges,
 			const PHTree<DIM, WIDTH>* tree, QueryType type) :
-			type_(type), nThreads_(nAdditionalThreads + 1),
-			threads_(), startStorage_(nAdditionalThreads + 1), ranges_(ranges), tree_(tree) {
-	threads_.reserve(nAdditionalThreads);
-	for (unsigned tCount = 0; tCount < nAdditionalThreads; ++tCount) {
-		threads_.emplace_back(&RangeQueryThreadPool<DIM,WIDTH>::processNext, this, tCount);
-	}
+			type_(type), threads_(threads), nThreads_(threads.nThreads()),
+			ranges_(ranges), tree_(tree) {
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
 RangeQueryThreadPool<DIM, WIDTH>::~RangeQueryThreadPool() {
-	for (auto &t : threads_) {
-		t.join();
-	}
-
-	clearResults();
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryThreadPool<DIM, WIDTH>::joinPool() {
-	processNext(nThreads_ - 1);
+void RangeQueryThreadPool<DIM, WIDTH>::toWindow(size_t index,
+		unsigned long* outLowerLeft, unsigned long* outUpperRight) const {
+	assert (DIM % 2 == 0);
+	const vector<unsigned long>& range = ranges_[index];
+	assert (range.size() == DIM);
+	// with unsigned values 0 is the lowest and max the highest possible value
+	const unsigned long max = (WIDTH == 8 * sizeof (unsigned long))? -1 : (1uL << WIDTH) - 1;
+	for (unsigned k = 0; k < DIM / 2; ++k) {
+		const unsigned long lowerLeft = range[k];
+		const unsigned long upperRight = range[k + DIM / 2];
+		assert (lowerLeft <= upperRight);
+		switch (type_) {
+		case intersection_query:
+			// same as PHTree::intersectionQuery
+			outLowerLeft[k] = 0;
+			outUpperRight[k] = upperRight;
+			outLowerLeft[k + DIM / 2] = lowerLeft;
+			outUpperRight[k + DIM / 2] = max;
+			break;
+		case inclusion_query:
+			// same as PHTree::inclusionQuery
+			outLowerLeft[k] = lowerLeft;
+			outUpperRight[k] = upperRight;
+			outLowerLeft[k + DIM / 2] = lowerLeft;
+			outUpperRight[k + DIM / 2] = upperRight;
+			break;
+		default: throw runtime_error("unknown query type");
+		}
+	}
 }
 
-
 template <unsigned int DIM, unsigned int WIDTH>
-RangeQueryIterator<DIM, WIDTH>* RangeQueryThreadPool<DIM, WIDTH>::getIteratorByType(size_t index) {
-	switch (type_) {
-	case intersection_query: return tree_->intersectionQuery(ranges_[index]);
-	case inclusion_query: return tree_->inclusionQuery(ranges_[index]);
-	default: throw runtime_error("unknown query type");
+size_t RangeQueryThreadPool<DIM, WIDTH>::nEntriesBelow(const Node<DIM>* root, const vector<unsigned long>& hcAddresses) {
+	size_t nEntries = 0;
+	NodeAddressContent<DIM> content;
+	for (unsigned long hcAddress : hcAddresses) {
+		root->lookup(hcAddress, content, false);
+		assert (content.exists);
+		nEntries += (content.hasSubnode)? content.subnode->getNumberOfSubtreeEntries() : 1;
 	}
-}
 
+	return nEntries;
+}
 
 template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryThreadPool<DIM, WIDTH>::clearResults() {
-	for (auto &start : startStorage_) {
-		ResultStorage<DIM, WIDTH>* storage = start.nextStorage_;
-		while (storage != NULL) {
-			ResultStorage<DIM, WIDTH>* nextStorage = storage->nextStorage_;
-			delete storage;
-			storage = nextStorage;
+template <typename TaskProcessor, typename ResultProcessor, typename TaskFinisher>
+void RangeQueryThreadPool<DIM, WIDTH>::run(TaskProcessor& beforeTask, ResultProcessor& processResult, TaskFinisher& afterTask) {
+	typedef SpatialSelectionOperationsUtil<DIM, WIDTH> SelectionUtil;
+	WorkStealingExecutor<QueryTask> executor(nThreads_);
+	// every thread starts with a contiguous block of queries and takes the lowest index first
+	const size_t chunkSize = 1 + ranges_.size() / nThreads_;
+	for (size_t threadIndex = 0; threadIndex < nThreads_; ++threadIndex) {
+		const size_t start = chunkSize * threadIndex;
+		const size_t end = min(chunkSize * (threadIndex + 1), ranges_.size());
+		for (size_t i = end; i > start; --i) {
+			executor.push(threadIndex, QueryTask{i - 1, false, 0, 0});
 		}
 	}
+
+	const Node<DIM>* root = tree_->root_;
+	const size_t maxParts = partsPerThread * nThreads_;
+	const size_t nEntriesPerThread = root->getNumberOfSubtreeEntries() / nThreads_;
+	auto processTask = [this, root, maxParts, nEntriesPerThread, &executor, &beforeTask, &processResult, &afterTask]
+				(size_t threadIndex, const QueryTask& task) {
+		unsigned long lowerLeft[DIM];
+		unsigned long upperRight[DIM];
+		toWindow(task.queryIndex, lowerLeft, upperRight);
+		auto callback = [&processResult, threadIndex, &task] (const Entry<DIM, WIDTH>& entry) {
+			processResult(threadIndex, task, entry);
+		};
+
+		if (task.isPart) {
+			beforeTask(threadIndex, task);
+			SelectionUtil::template forEachInRangeOfRootAddresses<true>(root, task.fromHcAddress, task.toHcAddress,
+					lowerLeft, upperRight, callback);
+			afterTask(threadIndex, task);
+			return;
+		}
+
+		if (nThreads_ > 1) {
+			// a large query or the last one of this thread is split so that idle threads can help
+			vector<unsigned long> hcAddresses;
+			SelectionUtil::rootAddressesInRange(root, lowerLeft, upperRight, hcAddresses);
+			if (hcAddresses.size() > 1 && (nEntriesBelow(root, hcAddresses) > nEntriesPerThread
+					|| executor.isLocalQueueEmpty(threadIndex))) {
+				const size_t nParts = min(hcAddresses.size(), maxParts);
+				for (size_t part = nParts; part > 0; --part) {
+					const size_t first = (part - 1) * hcAddresses.size() / nParts;
+					const size_t last = part * hcAddresses.size() / nParts - 1;
+					executor.push(threadIndex, QueryTask{task.queryIndex, true, hcAddresses[first], hcAddresses[last]});
+				}
+
+				return;
+			}
+		}
+
+		const unsigned long rootValues[RangeQueryMaskUtil<DIM, WIDTH>::nBlocks] = {};
+		beforeTask(threadIndex, task);
+		SelectionUtil::template forEachInRange<true>(root, rootValues, 0, false, lowerLeft, upperRight, callback);
+		afterTask(threadIndex, task);
+	};
+
+	executor.run(processTask, threads_);
 }
 
 template <unsigned int DIM, unsigned int WIDTH>
-void RangeQueryThreadPool<DIM, WIDTH>::processNext(size_t threadIndex) {
-	const size_t chunkSize = 1 + ranges_.size() / nThreads_;
-	const size_t start = chunkSize * threadIndex;
-	const size_t end = min(chunkSize * (threadIndex + 1), ranges_.size());
-	ResultStorage<DIM, WIDTH>* storage = &startStorage_[threadIndex];
-
-	for (size_t i = start; i < end; ++i) {
-		RangeQueryIterator<DIM, WIDTH>* it = getIteratorByType(i);
-		while (it->hasNext()) {
-			const Entry<DIM, WIDTH> entry = it->next();
-			storage = storage->add(entry);
-		}
+void RangeQueryThreadPool<DIM, WIDTH>::collect(ParallelQueryResults<DIM, WIDTH>& results) {
+	assert (results.nQueries() == ranges_.size());
+	// the parts of a split query are ordered by the root addresses they start at
+	auto beforeTask = [&results] (size_t threadIndex, const QueryTask& task) {
+		results.beginTask(threadIndex, task.queryIndex, task.fromHcAddress);
+	};
+	auto processResult = [&results] (size_t threadIndex, const QueryTask&, const Entry<DIM, WIDTH>& entry) {
+		results.add(threadIndex, entry);
+	};
+	auto afterTask = [&results] (size_t threadIndex, const QueryTask&) {
+		results.endTask(threadIndex);
+	};
+
+	run(beforeTask, processResult, afterTask);
+	results.finish();
+}
 
-		delete it;
-	}
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void RangeQueryThreadPool<DIM, WIDTH>::forEach(Callback& callback) {
+	auto processResult = [&callback] (size_t, const QueryTask& task, const Entry<DIM, WIDTH>& entry) {
+		callback(task.queryIndex, entry);
+	};
+	auto ignoreTask = [] (size_t, const QueryTask&) {};
+	run(ignoreTask, processResult, ignoreTask);
 }
 
 #endif /* SRC_UTIL_RANGEQUERYTHREADPOOL_H_ */
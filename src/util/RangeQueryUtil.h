@@ -27,6 +27,14 @@ public:
 	static RangeQueryIterator<DIM, WIDTH>* getSelectiveRangeIteratorRandom(
 			const PHTree<DIM, WIDTH>& tree,
 			double selectivity) {
+		std::vector<unsigned long> lower;
+		std::vector<unsigned long> upper;
+		generateSelectiveRangeRandom(selectivity, lower, upper);
+		return tree.rangeQuery(lower, upper);
+	}
+
+	static void generateSelectiveRangeRandom(double selectivity,
+			std::vector<unsigned long>& outLower, std::vector<unsigned long>& outUpper) {
 
 		assert (selectivity > 0.0 && selectivity <= 1.0);
 
@@ -37,14 +45,12 @@ public:
 		const unsigned long hyperRectSize = domainSize * perDimSelectivity;
 		const unsigned long domainWidth = domainSize - hyperRectSize;
 
-		std::vector<unsigned long> lower = RandUtil::generateRandValues(DIM, 0, domainWidth);
-		std::vector<unsigned long> upper(DIM);
+		outLower = RandUtil::generateRandValues(DIM, 0, domainWidth);
+		outUpper.resize(DIM);
 		for (unsigned d = 0; d < DIM; ++d) {
-			upper[d] = lower[d] + hyperRectSize;
-			assert (lower[d] < upper[d] && upper[d] < domainSize);
+			outUpper[d] = outLower[d] + hyperRectSize;
+			assert (outLower[d] < outUpper[d] && outUpper[d] < domainSize);
 		}
-
-		return tree.rangeQuery(lower, upper);
 	}
 
 	static RangeQueryIterator<DIM, WIDTH>* getSkewedRangeIterator(
@@ -20,6 +20,7 @@ public:
 	ResultStorage();
 	~ResultStorage();
 	ResultStorage<DIM, WIDTH>* add(const Entry<DIM,WIDTH>& entry);
+	// deletes this storage and all following ones
 	void recursiveDelete();
 };
 
@@ -45,5 +46,15 @@ ResultStorage<DIM, WIDTH>* ResultStorage<DIM, WIDTH>::add(
 	}
 }
 
+template <unsigned int DIM, unsigned int WIDTH>
+void ResultStorage<DIM, WIDTH>::recursiveDelete() {
+	ResultStorage<DIM, WIDTH>* storage = this;
+	while (storage != NULL) {
+		ResultStorage<DIM, WIDTH>* nextStorage = storage->nextStorage_;
+		delete storage;
+		storage = nextStorage;
+	}
+}
+
 
 #endif /* SRC_UTIL_RESULTSTORAGE_H_ */
@@ -9,9 +9,14 @@
 #define SRC_UTIL_SPATIALSELECTIONOPERATIONSUTIL_H_
 
 #include <vector>
+#include <cstdint>
+#include <type_traits>
+#include "util/RangeQueryMaskUtil.h"
 
 template <unsigned int DIM>
 class Node;
+template <unsigned int DIM>
+struct NodeContentArrays;
 template <unsigned int DIM, unsigned int WIDTH>
 class Entry;
 
@@ -21,11 +26,130 @@ public:
 	static std::pair<bool, int> lookup(const Entry<DIM, WIDTH>& e,
 			const Node<DIM>* rootNode,
 			std::vector<std::pair<unsigned long, const Node<DIM>*>>* visitedNodes);
+	// starts the lookup at the given node whose prefix starts at the given index
+	static std::pair<bool, int> lookup(const Entry<DIM, WIDTH>& e,
+			const Node<DIM>* startNode, size_t startIndex,
+			std::vector<std::pair<unsigned long, const Node<DIM>*>>* visitedNodes);
+	// looks up all entries with interleaved groups of lookups that prefetch the next node
+	static void lookupBatch(const Entry<DIM, WIDTH>* entries, size_t nEntries,
+			const Node<DIM>* rootNode, std::pair<bool, int>* outResults);
+	// lookup that can run while writers change the tree (the caller has to be in an epoch of the tree, see
+	// EpochGuard): the nodes are read without locks, each node is validated with its version before
+	// anything it references is accessed and the lookup restarts at the root if a node changed
+	static std::pair<bool, int> optimisticLookup(const Entry<DIM, WIDTH>& e, Node<DIM>* const* root);
+
+	// push-based range query: recursively calls callback(const Entry<DIM, WIDTH>&) or, if !WITH_VALUES,
+	// callback(int id) for every entry below the node that is in the range (per dimension values)
+	template <bool WITH_VALUES, typename Callback>
+	static void forEachInRange(const Node<DIM>* node, const unsigned long* higherValues,
+			unsigned int index, bool parentFullyContained,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+	// appends the HC addresses of the root's references that can contain entries in the range (ascending)
+	static void rootAddressesInRange(const Node<DIM>* rootNode,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			std::vector<unsigned long>& outHcAddresses);
+	// same as forEachInRange on the root but only visits the references with addresses between the
+	// given ones (inclusive, both returned by rootAddressesInRange) so that the root can be split
+	template <bool WITH_VALUES, typename Callback>
+	static void forEachInRangeOfRootAddresses(const Node<DIM>* rootNode,
+			unsigned long fromHcAddress, unsigned long toHcAddress,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+
+	// a subtree below a reference in the range or, if node is NULL, a single entry in the range
+	struct RangeSubtree {
+		const Node<DIM>* node;
+		// bits of the higher levels of the subtree or all bits of the entry
+		unsigned long values[RangeQueryMaskUtil<DIM, WIDTH>::nBlocks];
+		unsigned int index;
+		bool fullyContained;
+		int id;
+	};
+	// appends the subtrees and entries of the references of the subtree's node that are in the range
+	// (in Z-order) so that a range query can be split into independent parts
+	static void splitInRange(const RangeSubtree& subtree,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			std::vector<RangeSubtree>& outSubtrees);
+	// same as forEachInRange for a part returned by splitInRange
+	template <bool WITH_VALUES, typename Callback>
+	static void forEachInRange(const RangeSubtree& subtree,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+	// push-based range query with the same guarantees as optimisticLookup: a restarted traversal
+	// skips all entries up to the last one that was passed to callback(const Entry<DIM, WIDTH>&)
+	template <typename Callback>
+	static void optimisticForEachInRange(Node<DIM>* const* root,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+
+private:
+	// number of lookups that advance together in lookupBatch
+	static const size_t lookupBatchSize = 16;
+
+	// processes the node of a lookup: returns the subnode to continue with or NULL if the result is known
+	static inline const Node<DIM>* lookupInNode(const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+			size_t* index, unsigned long* lastHcAddress,
+			std::vector<std::pair<unsigned long, const Node<DIM>*>>* visitedNodes,
+			std::pair<bool, int>* outResult);
+	// first part of lookupInNode: returns false if the prefix of the node does not match (the result is known then)
+	// and otherwise moves the index behind the prefix
+	static inline bool lookupPrefix(const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+			size_t* index, unsigned long lastHcAddress,
+			std::vector<std::pair<unsigned long, const Node<DIM>*>>* visitedNodes,
+			std::pair<bool, int>* outResult);
+	// second part of lookupInNode: looks up the HC address of the entry at the index
+	static inline const Node<DIM>* lookupAddress(const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+			unsigned long hcAddress, size_t* index, unsigned long* lastHcAddress,
+			std::pair<bool, int>* outResult);
+	// prefetches the reference of the HC address (AHC) or the row where it probably is (LHC)
+	static inline void prefetchAddress(const Node<DIM>* node, unsigned long hcAddress);
+	// processes the node of an optimistic lookup: returns false if the node changed while it was read and
+	// otherwise sets the subnode to continue with or NULL if the result is known
+	static inline bool optimisticLookupInNode(const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+			size_t* index, const Node<DIM>** outNextNode, std::pair<bool, int>* outResult);
+	// returns false if a node changed while it was read: if hasLastKey, the entries up to the one with
+	// the interleaved values lastKey were already passed to the callback and are skipped
+	template <typename Callback>
+	static bool optimisticForEachInRange(const Node<DIM>* node, const unsigned long* higherValues,
+			unsigned int index, bool parentFullyContained,
+			const unsigned long* lowerLeft, const unsigned long* upperRight,
+			bool* hasLastKey, unsigned long* lastKey, Callback& callback);
+	// true if all interleaved values that only differ from the given ones in the lowest bits are <= the key
+	static inline bool isNotAfter(const unsigned long* values, unsigned int nFreeBits, const unsigned long* key);
+
+	// visits the references with addresses in the mask range between the given addresses
+	template <bool WITH_VALUES, typename Callback>
+	static inline void forEachInRangeOfAddresses(const NodeContentArrays<DIM>& arrays,
+			const unsigned long* values, unsigned int currentIndex, bool fullyContained,
+			unsigned long lowerMask, unsigned long upperMask,
+			unsigned long fromHcAddress, unsigned long toHcAddress,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+	// calls visit(unsigned long hcAddress, std::uintptr_t reference) for every reference with an address
+	// in the mask range between the given addresses (inclusive, ascending)
+	template <typename Visitor>
+	static inline void forEachReferenceInMaskRange(const NodeContentArrays<DIM>& arrays,
+			unsigned long lowerMask, unsigned long upperMask,
+			unsigned long fromHcAddress, unsigned long toHcAddress, Visitor& visit);
+	template <bool WITH_VALUES, typename Callback>
+	static inline void forEachInRangeVisitReference(const NodeContentArrays<DIM>& arrays,
+			const unsigned long* nodeValues, unsigned int currentIndex, bool fullyContained,
+			unsigned long hcAddress, std::uintptr_t reference,
+			const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback);
+	template <typename Callback>
+	static inline void forEachInRangeCall(const unsigned long* values, int id,
+			Callback& callback, std::true_type withValues);
+	template <typename Callback>
+	static inline void forEachInRangeCall(const unsigned long* values, int id,
+			Callback& callback, std::false_type withValues);
+	// returns true if the callback was called without the values of the entry
+	template <typename Callback>
+	static inline bool forEachInRangeCallWithoutValues(int id, Callback& callback, std::true_type withValues);
+	template <typename Callback>
+	static inline bool forEachInRangeCallWithoutValues(int id, Callback& callback, std::false_type withValues);
 };
 
 #include <assert.h>
 #include "nodes/Node.h"
 #include "nodes/NodeAddressContent.h"
+#include "nodes/NodeContentArrays.h"
+#include "util/RangeQueryMaskUtil.h"
 
 using namespace std;
 
@@ -34,76 +158,698 @@ pair<bool, int> SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(
 		const Entry<DIM, WIDTH>& e,
 		const Node<DIM>* rootNode,
 		vector<pair<unsigned long, const Node<DIM>*>>* visitedNodes) {
+	return lookup(e, rootNode, 0, visitedNodes);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool, int> SpatialSelectionOperationsUtil<DIM, WIDTH>::lookup(
+		const Entry<DIM, WIDTH>& e,
+		const Node<DIM>* startNode, size_t startIndex,
+		vector<pair<unsigned long, const Node<DIM>*>>* visitedNodes) {
 
-	const Node<DIM>* currentNode = rootNode;
+	const Node<DIM>* currentNode = startNode;
 	unsigned long lastHcAddress = 0;
-	size_t index = 0;
-	NodeAddressContent<DIM> content;
+	size_t index = startIndex;
+	pair<bool, int> result;
+	while (currentNode) {
+		currentNode = lookupInNode(e, currentNode, &index, &lastHcAddress, visitedNodes, &result);
+	}
 
-	while (true) {
+	return result;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::lookupBatch(const Entry<DIM, WIDTH>* entries,
+		size_t nEntries, const Node<DIM>* rootNode, pair<bool, int>* outResults) {
+	// state of the lookups of one group: all lookups of the group advance one step per round
+	// so the memory the next step of a lookup needs can be prefetched while the others are processed:
+	// the prefix step prefetches the slot of the HC address and the address step the next node
+	const Node<DIM>* currentNodes[lookupBatchSize];
+	size_t indices[lookupBatchSize];
+	unsigned long lastHcAddresses[lookupBatchSize];
+	unsigned long hcAddresses[lookupBatchSize];
+	bool prefixValidated[lookupBatchSize];
+	// unfinished lookups are kept at the front
+	size_t active[lookupBatchSize];
+
+	for (size_t start = 0; start < nEntries; start += lookupBatchSize) {
+		size_t nActive = (nEntries - start < lookupBatchSize)? nEntries - start : lookupBatchSize;
+		for (size_t i = 0; i < nActive; ++i) {
+			currentNodes[i] = rootNode;
+			indices[i] = 0;
+			lastHcAddresses[i] = 0;
+			prefixValidated[i] = false;
+			active[i] = i;
+		}
+
+		while (nActive > 0) {
+			for (size_t a = 0; a < nActive;) {
+				const size_t i = active[a];
+				const Entry<DIM, WIDTH>& entry = entries[start + i];
+				if (!prefixValidated[i]) {
+					if (lookupPrefix(entry, currentNodes[i], &indices[i], lastHcAddresses[i], NULL, &outResults[start + i])) {
+						// the slot is only accessed in the next round
+						hcAddresses[i] = MultiDimBitset<DIM>::interleaveBits(entry.values_, indices[i], DIM * WIDTH);
+						prefetchAddress(currentNodes[i], hcAddresses[i]);
+						prefixValidated[i] = true;
+						++a;
+					} else {
+						active[a] = active[--nActive];
+					}
+
+					continue;
+				}
 
-		const size_t prefixLength = currentNode->getPrefixLength();
-		if (prefixLength > 0) {
-			// validate prefix
-			const pair<bool, size_t> prefixComp = MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
-					index, index + prefixLength,
-					currentNode->getFixPrefixStartBlock(), prefixLength * DIM);
-
-			if (!prefixComp.first) {
-				#ifdef PRINT
-					cout << "prefix mismatch at prefix index " << prefixComp.second << endl;
-				#endif
-				return pair<bool, int>(false, 0);
+				const Node<DIM>* nextNode = lookupAddress(entry, currentNodes[i], hcAddresses[i],
+						&indices[i], &lastHcAddresses[i], &outResults[start + i]);
+				if (nextNode) {
+					// the node is only accessed in the next round
+					__builtin_prefetch(nextNode);
+					__builtin_prefetch(reinterpret_cast<const char*>(nextNode) + 64);
+					currentNodes[i] = nextNode;
+					prefixValidated[i] = false;
+					++a;
+				} else {
+					active[a] = active[--nActive];
+				}
 			}
 		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::prefetchAddress(const Node<DIM>* node, unsigned long hcAddress) {
+	NodeContentArrays<DIM> arrays;
+	node->getContentArrays(arrays);
+	if (arrays.isAhc) {
+		__builtin_prefetch(arrays.references + hcAddress);
+	} else if (arrays.nReferences > 0) {
+		// the row is only known after the binary search: estimate it for uniformly distributed addresses
+		const unsigned long row = (unsigned long) ((double) hcAddress / (RangeQueryMaskUtil<DIM, WIDTH>::highestAddress + 1.0)
+				* arrays.nReferences);
+		assert (row < arrays.nReferences);
+		__builtin_prefetch(arrays.addresses + row * DIM / (8 * sizeof (unsigned long)));
+		__builtin_prefetch(arrays.references + row);
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+const Node<DIM>* SpatialSelectionOperationsUtil<DIM, WIDTH>::lookupInNode(
+		const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+		size_t* index, unsigned long* lastHcAddress,
+		vector<pair<unsigned long, const Node<DIM>*>>* visitedNodes,
+		pair<bool, int>* outResult) {
+	if (!lookupPrefix(e, currentNode, index, (*lastHcAddress), visitedNodes, outResult)) {
+		return NULL;
+	}
+
+	const unsigned long hcAddress = MultiDimBitset<DIM>::interleaveBits(e.values_, (*index), DIM * WIDTH);
+	return lookupAddress(e, currentNode, hcAddress, index, lastHcAddress, outResult);
+}
 
-		if (visitedNodes)
-			visitedNodes->push_back(pair<unsigned long, const Node<DIM>*>(lastHcAddress, currentNode));
+template <unsigned int DIM, unsigned int WIDTH>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::lookupPrefix(
+		const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+		size_t* index, unsigned long lastHcAddress,
+		vector<pair<unsigned long, const Node<DIM>*>>* visitedNodes,
+		pair<bool, int>* outResult) {
 
-		// validate HC address
-		index += prefixLength;
-		const unsigned long hcAddress = MultiDimBitset<DIM>::interleaveBits(e.values_, index, DIM * WIDTH);
-		currentNode->lookup(hcAddress, content, true);
-		assert (!content.exists || !content.hasSpecialPointer);
+	const size_t prefixLength = currentNode->getPrefixLength();
+	if (prefixLength > 0) {
+		// validate prefix
+		const pair<bool, size_t> prefixComp = MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
+				(*index), (*index) + prefixLength,
+				currentNode->getFixPrefixStartBlock(), prefixLength * DIM);
 
-		if (!content.exists) {
+		if (!prefixComp.first) {
 			#ifdef PRINT
-				cout << "HC address mismatch" << endl;
+				cout << "prefix mismatch at prefix index " << prefixComp.second << endl;
 			#endif
-			return pair<bool, int>(false, 0);
+			(*outResult) = pair<bool, int>(false, 0);
+			return false;
 		}
+	}
+
+	if (visitedNodes)
+		visitedNodes->push_back(pair<unsigned long, const Node<DIM>*>(lastHcAddress, currentNode));
+
+	(*index) += prefixLength;
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+const Node<DIM>* SpatialSelectionOperationsUtil<DIM, WIDTH>::lookupAddress(
+		const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+		unsigned long hcAddress, size_t* index, unsigned long* lastHcAddress,
+		pair<bool, int>* outResult) {
+
+	// validate HC address
+	assert (hcAddress == MultiDimBitset<DIM>::interleaveBits(e.values_, (*index), DIM * WIDTH));
+	NodeAddressContent<DIM> content;
+	currentNode->lookup(hcAddress, content, true);
+	assert (!content.exists || !content.hasSpecialPointer);
+
+	if (!content.exists) {
+		#ifdef PRINT
+			cout << "HC address mismatch" << endl;
+		#endif
+		(*outResult) = pair<bool, int>(false, 0);
+		return NULL;
+	}
 
-		if (content.hasSubnode) {
-			// recurse
+	if (content.hasSubnode) {
+		// recurse
+		#ifdef PRINT
+			cout << "ok up to index " << (*index) << " > ";
+		#endif
+		++(*index);
+		assert (content.subnode);
+		(*lastHcAddress) = content.address;
+		return content.subnode;
+	}
+
+	const size_t suffixBits = DIM * (WIDTH - (*index) - 1);
+	if (suffixBits > 0) {
+		// validate suffix which is either directly stored or a reference
+		const pair<bool, size_t> suffixComp = MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
+						(*index) + 1, WIDTH,
+						content.getSuffixStartBlock(), suffixBits);
+		if (!suffixComp.first) {
 			#ifdef PRINT
-				cout << "ok up to index " << index << " > ";
+				cout << "suffix mismatch at suffix index " << suffixComp.second << endl;
 			#endif
-			++index;
-			assert (content.subnode);
-			currentNode = content.subnode;
-			lastHcAddress = content.address;
+			(*outResult) = pair<bool, int>(false, 0);
+			return NULL;
+		}
+	}
+
+	#ifdef PRINT
+		cout << "found" << endl;
+	#endif
+
+	(*outResult) = pair<bool, int>(true, content.id);
+	return NULL;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+pair<bool, int> SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticLookup(
+		const Entry<DIM, WIDTH>& e, Node<DIM>* const* root) {
+	pair<bool, int> result;
+	while (true) {
+		const Node<DIM>* currentNode = __atomic_load_n(root, __ATOMIC_ACQUIRE);
+		size_t index = 0;
+		while (currentNode && optimisticLookupInNode(e, currentNode, &index, &currentNode, &result)) {}
+
+		if (!currentNode) {
+			return result;
+		}
+
+		// a node changed while it was read
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticLookupInNode(
+		const Entry<DIM, WIDTH>& e, const Node<DIM>* currentNode,
+		size_t* index, const Node<DIM>** outNextNode, pair<bool, int>* outResult) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	const unsigned long version = currentNode->readVersion();
+	if (Node<DIM>::isObsolete(version)) {
+		return false;
+	}
+
+	NodeContentArrays<DIM> arrays;
+	currentNode->getContentArrays(arrays);
+	if (arrays.prefixLength > 0 && !MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
+			(*index), (*index) + arrays.prefixLength,
+			arrays.prefixStartBlock, arrays.prefixLength * DIM).first) {
+		if (!currentNode->validateVersion(version)) {
+			return false;
+		}
+
+		(*outResult) = pair<bool, int>(false, 0);
+		(*outNextNode) = NULL;
+		return true;
+	}
+
+	const size_t currentIndex = (*index) + arrays.prefixLength;
+	const unsigned long hcAddress = MultiDimBitset<DIM>::interleaveBits(e.values_, currentIndex, DIM * WIDTH);
+	uintptr_t reference = 0;
+	if (arrays.isAhc) {
+		reference = arrays.references[hcAddress];
+	} else {
+		const unsigned long row = MaskUtil::lowerBoundLhcRow(arrays.addresses, arrays.nReferences, hcAddress);
+		if (row < arrays.nReferences && MaskUtil::lookupLhcAddress(arrays.addresses, row) == hcAddress) {
+			reference = arrays.references[row];
+		}
+	}
+
+	// the reference and the suffix storage are only used if they belong to the same version
+	if (!currentNode->validateVersion(version)) {
+		return false;
+	}
+
+	// flags in the 2 lowest bits: isPointer | isSuffix
+	const bool isPointer = (reference >> 1uL) & 1uL;
+	const bool isSuffix = reference & 1uL;
+	if (!isPointer && !isSuffix) {
+		// no entry or a buffer of a running parallel insert
+		(*outResult) = pair<bool, int>(false, 0);
+		(*outNextNode) = NULL;
+		return true;
+	}
+
+	if (!isSuffix) {
+		(*index) = currentIndex + 1;
+		(*outNextNode) = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+		return true;
+	}
+
+	const size_t suffixBits = DIM * (WIDTH - currentIndex - 1);
+	if (suffixBits > 0) {
+		// the suffix is either stored in the reference or in the suffix storage of the node
+		const unsigned long suffixPart = (reference & ((-1uL) >> 32)) >> 2;
+		const unsigned long* suffixStartBlock = &suffixPart;
+		if (isPointer) {
+			assert (arrays.suffixStartBlock);
+			suffixStartBlock = arrays.suffixStartBlock + suffixPart;
+		}
+
+		const bool suffixMatches = MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
+				currentIndex + 1, WIDTH, suffixStartBlock, suffixBits).first;
+		// the suffix storage might have been changed while it was read
+		if (!currentNode->validateVersion(version)) {
+			return false;
+		}
+
+		if (!suffixMatches) {
+			(*outResult) = pair<bool, int>(false, 0);
+			(*outNextNode) = NULL;
+			return true;
+		}
+	}
+
+	(*outResult) = pair<bool, int>(true, reference >> 32);
+	(*outNextNode) = NULL;
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRange(const Node<DIM>* node,
+		const unsigned long* higherValues, unsigned int index, bool parentFullyContained,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	// all state of the traversal lives on the call stack (at most one node per level)
+	NodeContentArrays<DIM> arrays;
+	node->getContentArrays(arrays);
+	const unsigned int currentIndex = index + arrays.prefixLength;
+	assert (currentIndex < WIDTH);
+
+	// add the prefix to the bits of the higher levels
+	unsigned long values[MaskUtil::nBlocks];
+	for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+		values[i] = higherValues[i];
+	}
+	if (arrays.prefixLength > 0) {
+		MaskUtil::pushBackBits(arrays.prefixStartBlock, DIM * arrays.prefixLength,
+				values, DIM * (WIDTH - currentIndex));
+	}
+
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = parentFullyContained;
+	if (!parentFullyContained && !MaskUtil::calculateMasks(values, currentIndex,
+			lowerLeft, upperRight, &lowerMask, &upperMask, &fullyContained)) {
+		// the prefix is not in the range
+		return;
+	}
+
+	forEachInRangeOfAddresses<WITH_VALUES>(arrays, values, currentIndex, fullyContained,
+			lowerMask, upperMask, lowerMask, upperMask, lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeOfAddresses(
+		const NodeContentArrays<DIM>& arrays, const unsigned long* values,
+		unsigned int currentIndex, bool fullyContained,
+		unsigned long lowerMask, unsigned long upperMask,
+		unsigned long fromHcAddress, unsigned long toHcAddress,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	auto visit = [&arrays, values, currentIndex, fullyContained, lowerLeft, upperRight, &callback]
+				(unsigned long hcAddress, uintptr_t reference) {
+		forEachInRangeVisitReference<WITH_VALUES>(arrays, values, currentIndex, fullyContained,
+				hcAddress, reference, lowerLeft, upperRight, callback);
+	};
+	forEachReferenceInMaskRange(arrays, lowerMask, upperMask, fromHcAddress, toHcAddress, visit);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Visitor>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachReferenceInMaskRange(
+		const NodeContentArrays<DIM>& arrays,
+		unsigned long lowerMask, unsigned long upperMask,
+		unsigned long fromHcAddress, unsigned long toHcAddress, Visitor& visit) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	assert (MaskUtil::isInMaskRange(fromHcAddress, lowerMask, upperMask));
+	assert (MaskUtil::isInMaskRange(toHcAddress, lowerMask, upperMask));
+	if (arrays.isAhc) {
+		unsigned long hcAddress = fromHcAddress;
+		while (true) {
+			const uintptr_t reference = arrays.references[hcAddress];
+			if (reference != 0) {
+				visit(hcAddress, reference);
+			}
+
+			if (hcAddress >= toHcAddress) {
+				break;
+			}
+			hcAddress = MaskUtil::nextInMaskRange(hcAddress, lowerMask, upperMask);
+		}
+	} else {
+		// addresses are sorted so the search can start at the first row that can be in the range
+		for (unsigned long row = MaskUtil::lowerBoundLhcRow(arrays.addresses, arrays.nReferences, fromHcAddress);
+				row < arrays.nReferences; ++row) {
+			const unsigned long hcAddress = MaskUtil::lookupLhcAddress(arrays.addresses, row);
+			if (hcAddress > toHcAddress) {
+				break;
+			}
+
+			if (MaskUtil::isInMaskRange(hcAddress, lowerMask, upperMask)) {
+				visit(hcAddress, arrays.references[row]);
+			}
+		}
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::rootAddressesInRange(const Node<DIM>* rootNode,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		vector<unsigned long>& outHcAddresses) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	NodeContentArrays<DIM> arrays;
+	rootNode->getContentArrays(arrays);
+	assert (arrays.prefixLength == 0);
+	const unsigned long rootValues[MaskUtil::nBlocks] = {};
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = false;
+	MaskUtil::calculateMasks(rootValues, 0, lowerLeft, upperRight, &lowerMask, &upperMask, &fullyContained);
+	auto visit = [&outHcAddresses] (unsigned long hcAddress, uintptr_t) { outHcAddresses.push_back(hcAddress); };
+	forEachReferenceInMaskRange(arrays, lowerMask, upperMask, lowerMask, upperMask, visit);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeOfRootAddresses(const Node<DIM>* rootNode,
+		unsigned long fromHcAddress, unsigned long toHcAddress,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	assert (fromHcAddress <= toHcAddress);
+	NodeContentArrays<DIM> arrays;
+	rootNode->getContentArrays(arrays);
+	assert (arrays.prefixLength == 0);
+	const unsigned long rootValues[MaskUtil::nBlocks] = {};
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = false;
+	MaskUtil::calculateMasks(rootValues, 0, lowerLeft, upperRight, &lowerMask, &upperMask, &fullyContained);
+	forEachInRangeOfAddresses<WITH_VALUES>(arrays, rootValues, 0, fullyContained,
+			lowerMask, upperMask, fromHcAddress, toHcAddress, lowerLeft, upperRight, callback);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::splitInRange(const RangeSubtree& subtree,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		vector<RangeSubtree>& outSubtrees) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	assert (subtree.node);
+	// same as forEachInRange but the references are collected instead of visited
+	NodeContentArrays<DIM> arrays;
+	subtree.node->getContentArrays(arrays);
+	const unsigned int currentIndex = subtree.index + arrays.prefixLength;
+	assert (currentIndex < WIDTH);
+
+	unsigned long values[MaskUtil::nBlocks];
+	for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+		values[i] = subtree.values[i];
+	}
+	if (arrays.prefixLength > 0) {
+		MaskUtil::pushBackBits(arrays.prefixStartBlock, DIM * arrays.prefixLength,
+				values, DIM * (WIDTH - currentIndex));
+	}
+
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = subtree.fullyContained;
+	if (!subtree.fullyContained && !MaskUtil::calculateMasks(values, currentIndex,
+			lowerLeft, upperRight, &lowerMask, &upperMask, &fullyContained)) {
+		return;
+	}
+
+	const unsigned int suffixLength = WIDTH - currentIndex - 1;
+	auto visit = [&arrays, &values, currentIndex, suffixLength, fullyContained, lowerLeft, upperRight, &outSubtrees]
+				(unsigned long hcAddress, uintptr_t reference) {
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		assert ((isPointer || isSuffix) && "special pointers are only used during parallel inserts");
+		RangeSubtree part;
+		for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+			part.values[i] = values[i];
+		}
+		MultiDimBitset<DIM>::pushBackValue(hcAddress, part.values, DIM * suffixLength);
+		part.index = currentIndex + 1;
+		part.fullyContained = fullyContained;
+		if (isPointer && !isSuffix) {
+			part.node = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+			part.id = 0;
 		} else {
-			const size_t suffixBits = DIM * (WIDTH - index - 1);
-			if (suffixBits > 0) {
-				// validate suffix which is either directly stored or a reference
-				const pair<bool, size_t> suffixComp = MultiDimBitset<DIM>::compare(e.values_, DIM * WIDTH,
-								index + 1, WIDTH,
-								content.getSuffixStartBlock(), suffixBits);
-				if (!suffixComp.first) {
-					#ifdef PRINT
-						cout << "suffix mismatch at suffix index " << suffixComp.second << endl;
-					#endif
-					return pair<bool, int>(false, 0);
-				}
+			MaskUtil::pushBackSuffix(arrays, currentIndex, reference, part.values);
+			if (!fullyContained && !MaskUtil::isSuffixInRange(part.values, lowerLeft, upperRight)) {
+				return;
 			}
+			part.node = NULL;
+			part.id = reference >> 32;
+		}
 
-			#ifdef PRINT
-				cout << "found" << endl;
-			#endif
+		outSubtrees.push_back(part);
+	};
+	forEachReferenceInMaskRange(arrays, lowerMask, upperMask, lowerMask, upperMask, visit);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRange(const RangeSubtree& subtree,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	if (subtree.node) {
+		forEachInRange<WITH_VALUES>(subtree.node, subtree.values, subtree.index, subtree.fullyContained,
+				lowerLeft, upperRight, callback);
+	} else {
+		forEachInRangeCall(subtree.values, subtree.id, callback, std::integral_constant<bool, WITH_VALUES>());
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticForEachInRange(Node<DIM>* const* root,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	const unsigned long rootValues[MaskUtil::nBlocks] = {};
+	// the entries are passed in Z-order so a restart only needs to remember the last one
+	bool hasLastKey = false;
+	unsigned long lastKey[MaskUtil::nBlocks];
+	while (!optimisticForEachInRange(__atomic_load_n(root, __ATOMIC_ACQUIRE), rootValues, 0, false,
+			lowerLeft, upperRight, &hasLastKey, lastKey, callback)) {
+		// a node changed while it was read
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::optimisticForEachInRange(const Node<DIM>* node,
+		const unsigned long* higherValues, unsigned int index, bool parentFullyContained,
+		const unsigned long* lowerLeft, const unsigned long* upperRight,
+		bool* hasLastKey, unsigned long* lastKey, Callback& callback) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	const unsigned long version = node->readVersion();
+	if (Node<DIM>::isObsolete(version)) {
+		return false;
+	}
+
+	// same as forEachInRange but every reference is validated before it is followed or passed on
+	NodeContentArrays<DIM> arrays;
+	node->getContentArrays(arrays);
+	const unsigned int currentIndex = index + arrays.prefixLength;
+	assert (currentIndex < WIDTH);
 
-			return pair<bool, int>(true, content.id);
+	unsigned long values[MaskUtil::nBlocks];
+	for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+		values[i] = higherValues[i];
+	}
+	if (arrays.prefixLength > 0) {
+		MaskUtil::pushBackBits(arrays.prefixStartBlock, DIM * arrays.prefixLength,
+				values, DIM * (WIDTH - currentIndex));
+	}
+
+	unsigned long lowerMask = 0;
+	unsigned long upperMask = MaskUtil::highestAddress;
+	bool fullyContained = parentFullyContained;
+	if (!parentFullyContained && !MaskUtil::calculateMasks(values, currentIndex,
+			lowerLeft, upperRight, &lowerMask, &upperMask, &fullyContained)) {
+		// the prefix is not in the range
+		return true;
+	}
+
+	const unsigned int suffixLength = WIDTH - currentIndex - 1;
+	bool valid = true;
+	auto visit = [node, version, &arrays, &values, currentIndex, suffixLength, fullyContained,
+				lowerLeft, upperRight, hasLastKey, lastKey, &callback, &valid]
+				(unsigned long hcAddress, uintptr_t reference) {
+		// flags in the 2 lowest bits: isPointer | isSuffix
+		const bool isPointer = (reference >> 1uL) & 1uL;
+		const bool isSuffix = reference & 1uL;
+		if (!valid || (!isPointer && !isSuffix)) {
+			// entries in buffers of a running parallel insert are skipped
+			return;
+		}
+
+		unsigned long entryValues[MaskUtil::nBlocks];
+		for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+			entryValues[i] = values[i];
+		}
+		MultiDimBitset<DIM>::pushBackValue(hcAddress, entryValues, DIM * suffixLength);
+		if (*hasLastKey && isNotAfter(entryValues, DIM * suffixLength, lastKey)) {
+			// all entries below the reference were passed before the restart
+			return;
+		}
+
+		if (!node->validateVersion(version)) {
+			valid = false;
+			return;
+		}
+
+		if (!isSuffix) {
+			const Node<DIM>* subnode = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+			valid = optimisticForEachInRange(subnode, entryValues, currentIndex + 1, fullyContained,
+					lowerLeft, upperRight, hasLastKey, lastKey, callback);
+			return;
+		}
+
+		MaskUtil::pushBackSuffix(arrays, currentIndex, reference, entryValues);
+		if (!node->validateVersion(version)) {
+			valid = false;
+			return;
+		}
+
+		if ((fullyContained || MaskUtil::isSuffixInRange(entryValues, lowerLeft, upperRight))
+				&& !(*hasLastKey && isNotAfter(entryValues, 0, lastKey))) {
+			for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+				lastKey[i] = entryValues[i];
+			}
+			(*hasLastKey) = true;
+			forEachInRangeCall(entryValues, reference >> 32, callback, std::true_type());
+		}
+	};
+	forEachReferenceInMaskRange(arrays, lowerMask, upperMask, lowerMask, upperMask, visit);
+
+	// references that were skipped are only missing if the node changed in the meantime
+	return valid && node->validateVersion(version);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::isNotAfter(const unsigned long* values,
+		unsigned int nFreeBits, const unsigned long* key) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	// compare the highest possible values with the key starting at the most significant block
+	for (int i = MaskUtil::nBlocks - 1; i >= 0; --i) {
+		const unsigned int blockStart = i * MaskUtil::bitsPerBlock;
+		unsigned long freeMask = 0;
+		if (nFreeBits >= blockStart + MaskUtil::bitsPerBlock) {
+			freeMask = -1uL;
+		} else if (nFreeBits > blockStart) {
+			freeMask = (1uL << (nFreeBits - blockStart)) - 1uL;
+		}
+
+		const unsigned long highestBlock = values[i] | freeMask;
+		if (highestBlock != key[i]) {
+			return highestBlock < key[i];
 		}
 	}
+
+	return true;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <bool WITH_VALUES, typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeVisitReference(
+		const NodeContentArrays<DIM>& arrays, const unsigned long* nodeValues,
+		unsigned int currentIndex, bool fullyContained,
+		unsigned long hcAddress, std::uintptr_t reference,
+		const unsigned long* lowerLeft, const unsigned long* upperRight, Callback& callback) {
+	typedef RangeQueryMaskUtil<DIM, WIDTH> MaskUtil;
+	// flags in the 2 lowest bits: isPointer | isSuffix
+	const bool isPointer = (reference >> 1uL) & 1uL;
+	const bool isSuffix = reference & 1uL;
+	assert ((isPointer || isSuffix) && "special pointers are only used during parallel inserts");
+	const int id = reference >> 32;
+
+	if (fullyContained && !(isPointer && !isSuffix)
+			&& forEachInRangeCallWithoutValues(id, callback, std::integral_constant<bool, WITH_VALUES>())) {
+		// no need to reconstruct the values of the suffix
+		return;
+	}
+
+	// msb       [interleaved format]       lsb
+	// [ higher levels |curr|    suffix     ]
+	unsigned long values[MaskUtil::nBlocks];
+	for (unsigned i = 0; i < MaskUtil::nBlocks; ++i) {
+		values[i] = nodeValues[i];
+	}
+	const unsigned int suffixLength = WIDTH - currentIndex - 1;
+	MultiDimBitset<DIM>::pushBackValue(hcAddress, values, DIM * suffixLength);
+
+	if (isPointer && !isSuffix) {
+		const Node<DIM>* subnode = reinterpret_cast<const Node<DIM>*>(reference & (~3uL));
+		forEachInRange<WITH_VALUES>(subnode, values, currentIndex + 1, fullyContained,
+				lowerLeft, upperRight, callback);
+		return;
+	}
+
+	MaskUtil::pushBackSuffix(arrays, currentIndex, reference, values);
+	if (fullyContained || MaskUtil::isSuffixInRange(values, lowerLeft, upperRight)) {
+		forEachInRangeCall(values, id, callback, std::integral_constant<bool, WITH_VALUES>());
+	}
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeCall(const unsigned long* values,
+		int id, Callback& callback, std::true_type) {
+	const Entry<DIM, WIDTH> entry(values, id);
+	callback(entry);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+void SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeCall(const unsigned long*,
+		int id, Callback& callback, std::false_type) {
+	callback(id);
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeCallWithoutValues(int,
+		Callback&, std::true_type) {
+	return false;
+}
+
+template <unsigned int DIM, unsigned int WIDTH>
+template <typename Callback>
+bool SpatialSelectionOperationsUtil<DIM, WIDTH>::forEachInRangeCallWithoutValues(int id,
+		Callback& callback, std::false_type) {
+	callback(id);
+	return true;
 }
 
 #endif /* SRC_UTIL_SPATIALSELECTIONOPERATIONSUTIL_H_ */
@@ -0,0 +1,176 @@
+/*
+ * ThreadPool.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_THREADPOOL_H_
+#define SRC_UTIL_THREADPOOL_H_
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+#include <exception>
+
+// Long-lived worker threads for the parallel operations of one or more trees (see
+// PHTree::bindThreadPool). The workers sleep between jobs so that frequent small parallel
+// operations do not pay for starting and joining threads. Workers can be pinned to CPUs.
+class ThreadPool {
+public:
+	// nThreads includes the thread that calls run()
+	explicit ThreadPool(size_t nThreads = std::thread::hardware_concurrency(), bool pinThreads = false);
+	ThreadPool(const ThreadPool& other) = delete;
+	~ThreadPool();
+
+	size_t nThreads() const;
+	// runs job(size_t threadIndex) once on every thread and returns after all of them finished:
+	// the workers have the indices 0 to nThreads - 2 and the calling thread has the last one
+	// if the job throws on any thread, the first exception is rethrown after all threads finished
+	template <typename Job>
+	void run(Job& job);
+
+private:
+	// only one job runs at a time
+	std::mutex runMutex_;
+	// protects the state below
+	std::mutex mutex_;
+	std::condition_variable jobAvailable_;
+	std::condition_variable jobFinished_;
+	std::function<void (size_t)> job_;
+	// incremented for every job so that the workers run each job exactly once
+	unsigned long generation_;
+	size_t nRunningWorkers_;
+	// first exception thrown by the current job
+	std::exception_ptr error_;
+	bool stopping_;
+	std::vector<std::thread> workers_;
+
+	inline void work(size_t threadIndex);
+	static inline void pin(std::thread& thread, size_t cpu);
+};
+
+#include <assert.h>
+#include <algorithm>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+inline ThreadPool::ThreadPool(size_t nThreads, bool pinThreads) : job_(), generation_(0),
+		nRunningWorkers_(0), error_(), stopping_(false), workers_() {
+	nThreads = max(nThreads, size_t(1));
+	const size_t nCpus = max(thread::hardware_concurrency(), 1u);
+	workers_.reserve(nThreads - 1);
+	for (size_t threadIndex = 0; threadIndex < nThreads - 1; ++threadIndex) {
+		workers_.emplace_back(&ThreadPool::work, this, threadIndex);
+		if (pinThreads) {
+			pin(workers_.back(), threadIndex % nCpus);
+		}
+	}
+}
+
+inline ThreadPool::~ThreadPool() {
+	{
+		lock_guard<mutex> lock(mutex_);
+		stopping_ = true;
+	}
+
+	jobAvailable_.notify_all();
+	for (auto& worker : workers_) {
+		worker.join();
+	}
+}
+
+inline size_t ThreadPool::nThreads() const {
+	return workers_.size() + 1;
+}
+
+void ThreadPool::pin(thread& thread, size_t cpu) {
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	// pinning is only a hint: the worker keeps running unpinned if it fails
+	pthread_setaffinity_np(thread.native_handle(), sizeof (cpu_set_t), &cpus);
+}
+
+void ThreadPool::work(size_t threadIndex) {
+	unsigned long lastGeneration = 0;
+	while (true) {
+		function<void (size_t)>* job;
+		{
+			unique_lock<mutex> lock(mutex_);
+			jobAvailable_.wait(lock, [this, lastGeneration] () { return stopping_ || generation_ != lastGeneration; });
+			if (stopping_) {
+				return;
+			}
+
+			lastGeneration = generation_;
+			job = &job_;
+		}
+
+		// the job is not changed before all workers finished it
+		exception_ptr error;
+		try {
+			(*job)(threadIndex);
+		} catch (...) {
+			error = current_exception();
+		}
+
+		bool lastWorker;
+		{
+			lock_guard<mutex> lock(mutex_);
+			if (error && !error_) {
+				error_ = error;
+			}
+
+			lastWorker = --nRunningWorkers_ == 0;
+		}
+
+		if (lastWorker) {
+			jobFinished_.notify_one();
+		}
+	}
+}
+
+template <typename Job>
+void ThreadPool::run(Job& job) {
+	lock_guard<mutex> runLock(runMutex_);
+	if (!workers_.empty()) {
+		{
+			lock_guard<mutex> lock(mutex_);
+			job_ = [&job] (size_t threadIndex) { job(threadIndex); };
+			nRunningWorkers_ = workers_.size();
+			++generation_;
+		}
+
+		jobAvailable_.notify_all();
+	}
+
+	exception_ptr error;
+	try {
+		job(workers_.size());
+	} catch (...) {
+		error = current_exception();
+	}
+
+	{
+		// the job must outlive the workers that still run it
+		unique_lock<mutex> lock(mutex_);
+		jobFinished_.wait(lock, [this] () { return nRunningWorkers_ == 0; });
+		job_ = nullptr;
+		if (!error) {
+			error = error_;
+		}
+
+		error_ = nullptr;
+	}
+
+	if (error) {
+		rethrow_exception(error);
+	}
+}
+
+#endif /* SRC_UTIL_THREADPOOL_H_ */
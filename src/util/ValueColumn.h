@@ -0,0 +1,116 @@
+/*
+ * ValueColumn.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_VALUECOLUMN_H_
+#define SRC_UTIL_VALUECOLUMN_H_
+
+#include <vector>
+#include <climits>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+// Maps the values of a PHTreeMap to the 32 bit IDs that the nodes store next to each suffix.
+// The values are stored in a separate column so that the nodes only store the row of the value
+// (see InlineValues for values that fit into the IDs).
+template <typename T>
+class ValueColumn {
+	static_assert (std::is_trivially_copyable<T>::value, "values must be POD types");
+public:
+	static const bool isInline = false;
+
+	// returns the ID that the tree stores for the value
+	inline int store(const T& value);
+	inline const T& load(int id) const;
+	inline void replace(int id, const T& value);
+	// the ID is not referenced by the tree anymore
+	inline void release(int id);
+	// number of stored values
+	inline size_t size() const;
+	inline void reserve(size_t nValues);
+	inline void swap(ValueColumn<T>& other);
+
+private:
+	std::vector<T> rows_;
+	std::vector<int> freeRows_;
+};
+
+// Values with up to 32 bits are stored directly in the node references (same layout as the
+// IDs of PHTree) with the same interface as ValueColumn.
+template <typename T>
+class InlineValues {
+	static_assert (std::is_trivially_copyable<T>::value, "values must be POD types");
+	static_assert (sizeof (T) <= sizeof (int), "inline values must fit into the IDs");
+public:
+	static const bool isInline = true;
+
+	// the bits of the value are the ID
+	inline int store(const T& value) { int id = 0; memcpy(&id, &value, sizeof (T)); return id; }
+	inline T load(int id) const { T value; memcpy(&value, &id, sizeof (T)); return value; }
+	inline void replace(int, const T&) { }
+	inline void release(int) { }
+	inline size_t size() const { return 0; }
+	inline void reserve(size_t) { }
+	inline void swap(InlineValues<T>&) { }
+};
+
+#include <assert.h>
+
+using namespace std;
+
+template <typename T>
+int ValueColumn<T>::store(const T& value) {
+	if (!freeRows_.empty()) {
+		const int row = freeRows_.back();
+		freeRows_.pop_back();
+		rows_[row] = value;
+		return row;
+	}
+
+	if (rows_.size() >= (size_t) INT_MAX) {
+		throw runtime_error("too many values: rows must fit into the IDs of the nodes");
+	}
+
+	rows_.push_back(value);
+	return rows_.size() - 1;
+}
+
+template <typename T>
+const T& ValueColumn<T>::load(int id) const {
+	assert (id >= 0 && (size_t) id < rows_.size());
+	return rows_[id];
+}
+
+template <typename T>
+void ValueColumn<T>::replace(int id, const T& value) {
+	assert (id >= 0 && (size_t) id < rows_.size());
+	rows_[id] = value;
+}
+
+template <typename T>
+void ValueColumn<T>::release(int id) {
+	assert (id >= 0 && (size_t) id < rows_.size());
+	freeRows_.push_back(id);
+}
+
+template <typename T>
+size_t ValueColumn<T>::size() const {
+	return rows_.size() - freeRows_.size();
+}
+
+template <typename T>
+void ValueColumn<T>::reserve(size_t nValues) {
+	rows_.reserve(nValues);
+}
+
+template <typename T>
+void ValueColumn<T>::swap(ValueColumn<T>& other) {
+	rows_.swap(other.rows_);
+	freeRows_.swap(other.freeRows_);
+}
+
+#endif /* SRC_UTIL_VALUECOLUMN_H_ */
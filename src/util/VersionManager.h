@@ -0,0 +1,141 @@
+/*
+ * VersionManager.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_VERSIONMANAGER_H_
+#define SRC_UTIL_VERSIONMANAGER_H_
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <vector>
+
+template <unsigned int DIM>
+class Node;
+
+// Versions of a tree in copy-on-write mode. A writer replaces the nodes it changes by copies
+// (see CopyOnWriteUtil) and publishes the new root once the change is complete. Snapshots acquire
+// the published root of a version and the nodes that a writer replaced are only freed once no
+// snapshot of a version that contains them remains.
+template <unsigned int DIM>
+class VersionManager {
+public:
+	explicit VersionManager(const Node<DIM>* root);
+	VersionManager(const VersionManager<DIM>& other) = delete;
+	// frees all retired objects (no snapshot may remain)
+	~VersionManager();
+
+	// registers a snapshot of the published version and returns its root
+	const Node<DIM>* acquire(unsigned long* outVersion);
+	// releases a snapshot and frees the objects that are only contained in versions without snapshots
+	void release(unsigned long version);
+	// the object is contained in the published version but not in the one the writer builds
+	// (only the writer may call this)
+	template <typename T>
+	void retire(const T* object);
+	// makes the root the published version and frees the objects no snapshot contains any more
+	void publish(const Node<DIM>* root);
+
+private:
+	struct RetiredObject {
+		const void* object;
+		void (*deleter)(const void*);
+		// the newest version that contains the object
+		unsigned long version;
+	};
+
+	// protects the state below except the pending retirements that only the writer accesses
+	std::mutex mutex_;
+	const Node<DIM>* root_;
+	unsigned long version_;
+	// number of snapshots per version
+	std::map<unsigned long, size_t> snapshots_;
+	// in ascending order of their versions
+	std::deque<RetiredObject> retired_;
+	std::vector<RetiredObject> pending_;
+
+	// frees the retired objects of versions that are older than the oldest one with a snapshot
+	inline void freeUnreferenced();
+};
+
+#include <assert.h>
+#include "util/EpochManager.h"
+
+using namespace std;
+
+template <unsigned int DIM>
+VersionManager<DIM>::VersionManager(const Node<DIM>* root) : mutex_(), root_(root), version_(1),
+		snapshots_(), retired_(), pending_() {
+	assert (root);
+}
+
+template <unsigned int DIM>
+VersionManager<DIM>::~VersionManager() {
+	assert (snapshots_.empty() && "all snapshots have to be deleted before the tree");
+	for (const RetiredObject& retired : retired_) {
+		retired.deleter(retired.object);
+	}
+
+	for (const RetiredObject& retired : pending_) {
+		retired.deleter(retired.object);
+	}
+}
+
+template <unsigned int DIM>
+const Node<DIM>* VersionManager<DIM>::acquire(unsigned long* outVersion) {
+	lock_guard<mutex> lock(mutex_);
+	++snapshots_[version_];
+	(*outVersion) = version_;
+	return root_;
+}
+
+template <unsigned int DIM>
+void VersionManager<DIM>::release(unsigned long version) {
+	lock_guard<mutex> lock(mutex_);
+	auto snapshot = snapshots_.find(version);
+	assert (snapshot != snapshots_.end() && snapshot->second > 0);
+	if (--snapshot->second == 0) {
+		snapshots_.erase(snapshot);
+		freeUnreferenced();
+	}
+}
+
+template <unsigned int DIM>
+template <typename T>
+void VersionManager<DIM>::retire(const T* object) {
+	assert (object);
+	// optimistic readers of the changed tree might still read the object after the last snapshot
+	auto deleter = [] (const void* retired) { EpochManager::retireOrDelete(static_cast<const T*>(retired)); };
+	// the version is set once the writer publishes its change
+	pending_.push_back(RetiredObject{object, deleter, 0});
+}
+
+template <unsigned int DIM>
+void VersionManager<DIM>::publish(const Node<DIM>* root) {
+	assert (root);
+	lock_guard<mutex> lock(mutex_);
+	for (RetiredObject& retired : pending_) {
+		retired.version = version_;
+		retired_.push_back(retired);
+	}
+
+	pending_.clear();
+	root_ = root;
+	++version_;
+	freeUnreferenced();
+}
+
+template <unsigned int DIM>
+void VersionManager<DIM>::freeUnreferenced() {
+	const unsigned long oldestVersion = (snapshots_.empty())? version_ : snapshots_.begin()->first;
+	while (!retired_.empty() && retired_.front().version < oldestVersion) {
+		const RetiredObject retired = retired_.front();
+		retired_.pop_front();
+		retired.deleter(retired.object);
+	}
+}
+
+#endif /* SRC_UTIL_VERSIONMANAGER_H_ */
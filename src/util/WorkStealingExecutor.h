@@ -0,0 +1,177 @@
+/*
+ * WorkStealingExecutor.h
+ *
+ *  Created on: Oct 18, 2016
+ *      Author: max
+ */
+
+#ifndef SRC_UTIL_WORKSTEALINGEXECUTOR_H_
+#define SRC_UTIL_WORKSTEALINGEXECUTOR_H_
+
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <exception>
+#include "util/ThreadPool.h"
+
+// Runs tasks with a fixed number of threads that each own a deque of tasks. A thread takes its
+// newest task first and steals the oldest task of another thread if its own deque is empty,
+// so that threads with expensive tasks are relieved by the others. Tasks can add new tasks
+// (e.g. parts of themselves) which are then available for stealing.
+template <typename Task>
+class WorkStealingExecutor {
+public:
+	explicit WorkStealingExecutor(size_t nThreads);
+	WorkStealingExecutor(const WorkStealingExecutor<Task>& other) = delete;
+	~WorkStealingExecutor();
+
+	size_t nThreads() const;
+	// adds a task to the deque of the thread (before run() or from a task processed by that thread)
+	void push(size_t threadIndex, const Task& task);
+	// true if the thread has no more tasks of its own
+	bool isLocalQueueEmpty(size_t threadIndex);
+	// processes all tasks with process(size_t threadIndex, const Task& task) on the threads of the pool
+	// (which has one thread per deque) and returns after all tasks (including the ones added while running) are processed
+	// if a task throws, the remaining tasks are dropped and the first exception is rethrown once all threads stopped
+	template <typename Processor>
+	void run(Processor& process, ThreadPool& threads);
+
+private:
+	struct TaskQueue {
+		std::mutex mutex;
+		std::deque<Task> tasks;
+		// keeps the queues of different threads in different cache lines
+		char padding[64];
+	};
+
+	std::vector<TaskQueue> queues_;
+	// tasks that were pushed but are not processed yet
+	std::atomic<size_t> nPendingTasks_;
+	// set after the first exception of a task: the other tasks are only removed from the deques
+	std::atomic<bool> failed_;
+	std::mutex errorMutex_;
+	std::exception_ptr error_;
+
+	inline bool popLocal(size_t threadIndex, Task* outTask);
+	inline bool steal(size_t threadIndex, Task* outTask);
+	template <typename Processor>
+	void work(size_t threadIndex, Processor& process);
+	inline void fail(std::exception_ptr error);
+};
+
+#include <assert.h>
+
+using namespace std;
+
+template <typename Task>
+WorkStealingExecutor<Task>::WorkStealingExecutor(size_t nThreads) : queues_(nThreads), nPendingTasks_(0),
+		failed_(false), errorMutex_(), error_() {
+	assert (nThreads > 0);
+}
+
+template <typename Task>
+WorkStealingExecutor<Task>::~WorkStealingExecutor() {
+	assert (nPendingTasks_ == 0);
+}
+
+template <typename Task>
+size_t WorkStealingExecutor<Task>::nThreads() const {
+	return queues_.size();
+}
+
+template <typename Task>
+void WorkStealingExecutor<Task>::push(size_t threadIndex, const Task& task) {
+	assert (threadIndex < queues_.size());
+	// count first so that no thread can see all queues empty while the task is added
+	nPendingTasks_.fetch_add(1);
+	TaskQueue& queue = queues_[threadIndex];
+	lock_guard<mutex> lock(queue.mutex);
+	queue.tasks.push_back(task);
+}
+
+template <typename Task>
+bool WorkStealingExecutor<Task>::isLocalQueueEmpty(size_t threadIndex) {
+	TaskQueue& queue = queues_[threadIndex];
+	lock_guard<mutex> lock(queue.mutex);
+	return queue.tasks.empty();
+}
+
+template <typename Task>
+bool WorkStealingExecutor<Task>::popLocal(size_t threadIndex, Task* outTask) {
+	TaskQueue& queue = queues_[threadIndex];
+	lock_guard<mutex> lock(queue.mutex);
+	if (queue.tasks.empty()) {
+		return false;
+	}
+
+	*outTask = queue.tasks.back();
+	queue.tasks.pop_back();
+	return true;
+}
+
+template <typename Task>
+bool WorkStealingExecutor<Task>::steal(size_t threadIndex, Task* outTask) {
+	for (size_t i = 1; i < queues_.size(); ++i) {
+		TaskQueue& victim = queues_[(threadIndex + i) % queues_.size()];
+		lock_guard<mutex> lock(victim.mutex);
+		if (!victim.tasks.empty()) {
+			// the oldest task of the victim is usually the largest one
+			*outTask = victim.tasks.front();
+			victim.tasks.pop_front();
+			return true;
+		}
+	}
+
+	return false;
+}
+
+template <typename Task>
+template <typename Processor>
+void WorkStealingExecutor<Task>::work(size_t threadIndex, Processor& process) {
+	Task task;
+	while (true) {
+		if (popLocal(threadIndex, &task) || steal(threadIndex, &task)) {
+			if (!failed_) {
+				try {
+					process(threadIndex, task);
+				} catch (...) {
+					// the other threads wait for all pending tasks, so a failed task still has to be counted as done
+					fail(current_exception());
+				}
+			}
+
+			nPendingTasks_.fetch_sub(1);
+		} else if (nPendingTasks_ == 0) {
+			return;
+		} else {
+			// other threads are still processing tasks that can add new ones
+			this_thread::yield();
+		}
+	}
+}
+
+template <typename Task>
+template <typename Processor>
+void WorkStealingExecutor<Task>::run(Processor& process, ThreadPool& threads) {
+	assert (threads.nThreads() == queues_.size());
+	auto job = [this, &process] (size_t threadIndex) { work(threadIndex, process); };
+	threads.run(job);
+	if (failed_) {
+		exception_ptr error = error_;
+		error_ = nullptr;
+		failed_ = false;
+		rethrow_exception(error);
+	}
+}
+
+template <typename Task>
+void WorkStealingExecutor<Task>::fail(exception_ptr error) {
+	lock_guard<mutex> lock(errorMutex_);
+	if (!failed_) {
+		error_ = error;
+		failed_ = true;
+	}
+}
+
+#endif /* SRC_UTIL_WORKSTEALINGEXECUTOR_H_ */
@@ -61,15 +61,19 @@ void AssertionVisitor<DIM>::visitSub(PHTree<DIM, WIDTH>* tree) {
 template <unsigned int DIM>
 template <unsigned int PREF_BLOCKS, unsigned int N>
 void AssertionVisitor<DIM>::visitSub(LHC<DIM, PREF_BLOCKS, N>* node, unsigned int depth) {
-	assert (node->getNumberOfContents() > 0);
+	validateContents(node, node->begin(), node->end());
+	// only the root can be empty (before the first insertion or after removing all entries)
+	if (node->getNumberOfContents() == 0) {
+		return;
+	}
 
 	unsigned long lastHcAddress = -1;
 	NodeAddressContent<DIM> content;
 	node->lookupIndex(0, &lastHcAddress);
 	for (unsigned int i = 1; i < node->m; ++i) {
 		unsigned long hcAddress = 0;
-		assert (hcAddress > lastHcAddress);
 		node->lookupIndex(i, &hcAddress);
+		assert (hcAddress > lastHcAddress);
 		unsigned int indexTest = -1;
 		bool exists = false;
 		node->lookupAddress(hcAddress, &exists, &indexTest);
@@ -89,6 +93,15 @@ void AssertionVisitor<DIM>::visitSub(AHC<DIM, PREF_BLOCKS>* node, unsigned int d
 
 template <unsigned int DIM>
 void AssertionVisitor<DIM>::validateContents(const Node<DIM>* node, NodeIterator<DIM>* begin, NodeIterator<DIM>* end) {
+	// the number of entries in the subtree is the sum of the suffixes and the entries of all subnodes
+	size_t nSubtreeEntries = 0;
+	for (; (*begin) != (*end); ++(*begin)) {
+		const NodeAddressContent<DIM> content = *(*begin);
+		assert (content.exists && !content.hasSpecialPointer);
+		nSubtreeEntries += (content.hasSubnode)? content.subnode->getNumberOfSubtreeEntries() : 1;
+	}
+
+	assert (nSubtreeEntries == node->getNumberOfSubtreeEntries());
 	delete begin;
 	delete end;
 }